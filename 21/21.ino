@@ -4,6 +4,7 @@ SerialUI ui;
 float tempC = 25.4;
 
 void setup() {
+    // python3 21.py --sweep project.uiproj shows paint and update times per baud rate
 //    ui.begin(230400);
 //    ui.begin(500000);
     ui.begin(1000000);
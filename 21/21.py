@@ -7,11 +7,13 @@ import threading
 import queue
 import json
 import time
+import hashlib
 import sys
 import tkinter as tk
 from tkinter import scrolledtext, ttk, simpledialog
 from enum import Enum, auto
 from dataclasses import dataclass, field, asdict
+from collections import deque, OrderedDict
 from pathlib import Path
 from typing import List, Dict, Any, Optional
 
@@ -34,9 +36,14 @@ SERIAL_UI_HEADER = r"""
   #include <stdint.h>
   #include <string.h>
   #include <math.h>
+  #include <atomic>
+  #include <thread>
+  #include <mutex>
+  #include <condition_variable>
   #define PROGMEM
   #define pgm_read_ptr(ptr) (*(ptr))
   #define pgm_read_byte(ptr) (*(const uint8_t*)(ptr))
+  #define pgm_read_word(ptr) (*(const uint16_t*)(ptr))
 
   class MockSerial {
   public:
@@ -50,6 +57,7 @@ SERIAL_UI_HEADER = r"""
       void println(const char* s = "") { printf("%s\n", s); }
       void println(int n, int base = 10) { print(n, base); printf("\n"); }
       void write(uint8_t c) { putchar(c); }
+      void write(const uint8_t* buf, size_t len) { fwrite(buf, 1, len, stdout); }
       operator bool() { return true; }
   };
   static MockSerial Serial;
@@ -62,6 +70,10 @@ SERIAL_UI_HEADER = r"""
       auto now = std::chrono::steady_clock::now();
       return std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
   }
+  inline uint32_t micros() {
+      static auto start = std::chrono::steady_clock::now();
+      return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  }
   inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
       return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
   }
@@ -84,47 +96,995 @@ struct UI_Text { int16_t x, y; const char* content; UI_Color color; };
 struct UI_Line { int16_t x1, y1, x2, y2; UI_Color color; };
 struct UI_Freehand { int16_t x, y; const char* const* lines; uint8_t count; UI_Color color; };
 
+// Terminal capabilities; drawing falls back to plain ASCII for what is missing.
+enum : uint8_t { UI_CAP_UTF8 = 0x01 };
+#ifndef SERIALUI_CAPS
+  #define SERIALUI_CAPS 0
+#endif
+
+// What a bar, gauge or progress bar currently shows: the fill in 1/8 cells
+// (0xFFFF: unknown, draw all) and its colour. `band` is a hysteresis in value
+// units: the display holds while the value stays within `band` of one that would
+// show the current fill, so noise around a cell boundary does not flicker.
+struct UI_BarState {
+    uint16_t shown = 0xFFFF;
+    uint16_t band = 0;
+    UI_Color color = UI_Color::WHITE;
+    UI_BarState() {}
+    explicit UI_BarState(uint16_t hysteresis) : band(hysteresis) {}
+    void reset() { shown = 0xFFFF; }
+};
+
+// Braille dot canvas over the interior of a box: 2x4 dots per cell. Each cell is
+// one byte of dot bits (the braille pattern) plus one byte for what the terminal
+// shows. Drawing only touches RAM; SerialUI::drawCanvas() sends changed cells.
+// Declare a UI_Canvas<COLS, ROWS>, which holds both buffers.
+class UI_CanvasBase {
+public:
+    UI_CanvasBase(const UI_CanvasBase&) = delete;
+    UI_CanvasBase& operator=(const UI_CanvasBase&) = delete;
+
+    int16_t width() const { return cols * 2; }
+    int16_t height() const { return rows * 4; }
+    void clear() { memset(dots, 0, (size_t)cols * rows); }
+    void setPixel(int16_t x, int16_t y, bool on = true) {
+        if (x < 0 || y < 0 || x >= cols * 2 || y >= rows * 4) return;
+        uint8_t& c = dots[(y >> 2) * cols + (x >> 1)];
+        uint8_t bit = dotBit(x & 1, y & 3);
+        c = on ? (c | bit) : (c & ~bit);
+    }
+    bool pixel(int16_t x, int16_t y) const {
+        if (x < 0 || y < 0 || x >= cols * 2 || y >= rows * 4) return false;
+        return dots[(y >> 2) * cols + (x >> 1)] & dotBit(x & 1, y & 3);
+    }
+    // Bresenham; dots outside the canvas are clipped.
+    void line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, bool on = true) {
+        int16_t dx = x1 > x0 ? x1 - x0 : x0 - x1, dy = y1 > y0 ? y0 - y1 : y1 - y0;
+        int16_t sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1, err = dx + dy;
+        for (;;) {
+            setPixel(x0, y0, on);
+            if (x0 == x1 && y0 == y1) break;
+            int16_t e2 = 2 * err;
+            if (e2 >= dy) { err += dy; x0 += sx; }
+            if (e2 <= dx) { err += dx; y0 += sy; }
+        }
+    }
+    // The next drawCanvas() sends every cell, e.g. after drawScreen_X cleared the area.
+    void invalidate() { stale = true; }
+
+    UI_Box box;
+    UI_Color color;
+
+protected:
+    UI_CanvasBase(const UI_Box& b, UI_Color c, int16_t w, int16_t h, uint8_t* buf)
+        : box(b), color(c), cols(w), rows(h), dots(buf), shown(buf + w * h) { clear(); }
+
+private:
+    friend class SerialUI;
+    // braille dot numbering: 1-3 and 7 down the left column, 4-6 and 8 down the right
+    static uint8_t dotBit(uint8_t dx, uint8_t dy) { return dy < 3 ? 1 << (dy + 3 * dx) : 0x40 << dx; }
+    int16_t cols, rows;
+    uint8_t* dots;
+    uint8_t* shown;
+    bool stale = true;
+};
+
+template<int16_t COLS, int16_t ROWS>
+class UI_Canvas : public UI_CanvasBase {
+public:
+    explicit UI_Canvas(const UI_Box& b, UI_Color c = UI_Color::WHITE) : UI_CanvasBase(b, c, COLS, ROWS, buf) {}
+private:
+    uint8_t buf[2 * COLS * ROWS];
+};
+
+// Seven-segment number, 4 cells per digit (3x3 glyph + gap/decimal point).
+// `shown` is a RAM array of `digits` bytes holding the segments on screen.
+struct UI_BigNum { int16_t x, y; uint8_t digits; UI_Color color; uint8_t* shown; };
+
+// Localized text: the content is string `id` of the current language's table.
+struct UI_LText { int16_t x, y; uint16_t id; UI_Color color; };
+
+// One language's strings in PROGMEM, byte-pair compressed by the generator:
+// bytes flagged in `codes` (a 256-bit set) expand to the pair listed for them in
+// `pairs` (code, first, second), recursively. Strings are 0-terminated in `data`.
+struct UI_StringTable {
+    const uint8_t* data;
+    const uint16_t* offsets;
+    const uint8_t* pairs;
+    const uint8_t* codes;
+    uint8_t npairs;
+};
+
+#ifndef SERIALUI_STR_STACK
+  #define SERIALUI_STR_STACK 8 // pair nesting depth + 1; the generator keeps within it
+#endif
+
+// Streams one decoded string out of a table without a RAM copy.
+class UI_StrReader {
+public:
+    UI_StrReader(const UI_StringTable* t, uint16_t id) {
+        if (!t) return;
+        p = (const uint8_t*)pgm_read_ptr(&t->data) + pgm_read_word((const uint16_t*)pgm_read_ptr(&t->offsets) + id);
+        pairs = (const uint8_t*)pgm_read_ptr(&t->pairs);
+        codes = (const uint8_t*)pgm_read_ptr(&t->codes);
+        np = pgm_read_byte(&t->npairs);
+    }
+    // Next byte of the string, or -1 at its end.
+    int next() {
+        for (;;) {
+            uint8_t c;
+            if (sp) c = stack[--sp];
+            else {
+                if (!p) return -1;
+                c = pgm_read_byte(p++);
+                if (!c) { p = nullptr; return -1; }
+            }
+            if (!(pgm_read_byte(codes + (c >> 3)) & (1 << (c & 7)))) return c;
+            for (uint8_t i = 0; i < np; i++) {
+                if (pgm_read_byte(pairs + 3 * i) != c) continue;
+                stack[sp++] = pgm_read_byte(pairs + 3 * i + 2);
+                stack[sp++] = pgm_read_byte(pairs + 3 * i + 1);
+                break;
+            }
+        }
+    }
+    // Next character cell (a byte plus any UTF-8 continuation bytes) into g; 0 at the end.
+    uint8_t glyph(uint8_t* g) {
+        int c = next();
+        if (c < 0) return 0;
+        uint8_t n = 0; g[n++] = (uint8_t)c;
+        uint8_t tail = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+        while (tail-- && (c = next()) >= 0) g[n++] = (uint8_t)c;
+        return n;
+    }
+private:
+    const uint8_t* p = nullptr;
+    const uint8_t* pairs = nullptr;
+    const uint8_t* codes = nullptr;
+    uint8_t np = 0, sp = 0;
+    uint8_t stack[SERIALUI_STR_STACK];
+};
+
+// Output classes for SERIALUI_PRIORITY_LANES; without lanes everything is sent in call order.
+enum class UI_Priority : uint8_t { CRITICAL = 0, NORMAL = 1, BACKGROUND = 2 };
+
+#ifdef SERIALUI_BINARY
+  #ifdef SERIALUI_PRIORITY_LANES
+    #error "SERIALUI_BINARY cannot be combined with SERIALUI_PRIORITY_LANES"
+  #endif
+// --- BINARY DISPLAY PROTOCOL ---
+// For links where both ends are ours (see UI_BinaryDecoder). Bytes 0x20..0xFF
+// are glyphs and pass through as is; 0x00..0x1F are opcodes with fixed arguments.
+enum : uint8_t {
+    UI_OP_MOVE = 0x01,   // x, y: cursor to cell (x, y), both < 256
+    UI_OP_MOVE16 = 0x02, // x, y as 16-bit little-endian values
+    UI_OP_STYLE = 0x03,  // SGR code, 0 resets
+    UI_OP_FILL = 0x04,   // x, y, w, h, glyph in the current style
+    UI_OP_BLIT = 0x05,   // id (16-bit LE): draw element `id` of the UI_ElementTable
+    UI_OP_HELLO = 0x06,  // version, element count (16-bit LE)
+    UI_OP_LIT = 0x1F     // next byte is literal: control bytes and raw escape sequences
+};
+#define UI_PROTOCOL_VERSION 1
+
+// Layout elements a BLIT can name. The generated ui_layout.cpp registers its
+// table at startup, so a device and a viewer built from it agree on the ids.
+struct UI_ElementRef { const void* e; uint8_t kind; };
+
+class UI_ElementTable {
+public:
+    enum : uint8_t { BOX, TEXT, LINE, FREEHAND };
+    UI_ElementTable(const UI_ElementRef* refs, uint16_t count) : refs(refs), count(count) {
+        for (uint16_t i = 0; i < count; i++) {
+            uintptr_t a = (uintptr_t)pgm_read_ptr(&refs[i].e);
+            if (!i || a < lo) lo = a;
+            if (!i || a > hi) hi = a;
+        }
+        active() = this;
+    }
+    static const UI_ElementTable*& active() { static const UI_ElementTable* t = nullptr; return t; }
+    // Screens draw their elements in table order, so the scan starts after the
+    // last hit and a paint costs O(1) per element. Copies (a recoloured box on
+    // the stack) fall outside the table's address range and miss at once.
+    int16_t find(const void* e) const {
+        uintptr_t a = (uintptr_t)e;
+        if (!count || a < lo || a > hi) return -1;
+        for (uint16_t k = 0, i = next; k < count; k++, i = i + 1 < count ? i + 1 : 0) {
+            if (pgm_read_ptr(&refs[i].e) != e) continue;
+            next = i + 1 < count ? i + 1 : 0;
+            return (int16_t)i;
+        }
+        return -1;
+    }
+    const void* get(uint16_t id, uint8_t& kind) const {
+        if (id >= count) return nullptr;
+        kind = pgm_read_byte(&refs[id].kind);
+        return pgm_read_ptr(&refs[id].e);
+    }
+    const UI_ElementRef* const refs;
+    const uint16_t count;
+private:
+    uintptr_t lo = 0, hi = 0;
+    mutable uint16_t next = 0;
+};
+
+  #ifndef SERIALUI_VIEWPORT
+    // A layout element sent whole is one BLIT (the viewer cannot clip to a window).
+    #define SERIALUI_BLIT(e) if (blit(e)) return
+  #endif
+#endif
+#ifndef SERIALUI_BLIT
+  #define SERIALUI_BLIT(e)
+#endif
+enum class UI_Protocol : uint8_t { ANSI, BINARY };
+
+#ifdef SERIALUI_COMPRESS
+  #ifdef SERIALUI_PRIORITY_LANES
+    #error "SERIALUI_COMPRESS cannot be combined with SERIALUI_PRIORITY_LANES"
+  #endif
+// --- STREAM COMPRESSION ---
+// LZ77 over a sliding window plus a PROGMEM dictionary of escape sequences and
+// the project's strings (emitted by the generator). Literal bytes pass through
+// unchanged; 0xFF, which never occurs in UTF-8, starts a token:
+//   FF 00             literal 0xFF
+//   FF 01 n lo hi     reset: empty window of 1 << n bytes, dictionary of lo|hi<<8 bytes;
+//                     n = 0 ends compression and later bytes pass through as-is
+//   FF L D            L = 2..127: copy L + 1 bytes from D + 1 bytes back in the window
+//   FF L lo hi        L = 128..255: copy L - 125 bytes from dictionary offset lo|hi<<8
+  #ifndef SERIALUI_LZ_WINDOW_BITS
+    #define SERIALUI_LZ_WINDOW_BITS 7   // 128 bytes of RAM; at most 8
+  #endif
+  #define SERIALUI_LZ_WINDOW (1 << SERIALUI_LZ_WINDOW_BITS)
+  #define SERIALUI_LZ_HASH 64           // window hash heads in RAM; the dictionary has 256 in flash
+
+inline uint8_t uiLzHash(uint8_t a, uint8_t b, uint8_t c) { return (uint8_t)((a << 4) ^ (b << 2) ^ c ^ (a >> 4)); }
+
+// Registered at startup by the generated ui_layout.cpp, like UI_ElementTable.
+class UI_LzDict {
+public:
+    UI_LzDict(const uint8_t* data, uint16_t size, const uint16_t* heads) : data(data), size(size), heads(heads) { active() = this; }
+    static const UI_LzDict*& active() { static const UI_LzDict* d = nullptr; return d; }
+    const uint8_t* const data;
+    const uint16_t size;
+    const uint16_t* const heads;  // 256 first offsets per hash, 0xFFFF when none
+};
+#endif
+
+#ifdef SERIALUI_PRIORITY_LANES
+  #ifndef SERIALUI_ASYNC_TX
+    #define SERIALUI_ASYNC_TX
+  #endif
+  // Ring sizes per lane. A record bigger than its lane is sent in pieces.
+  #ifndef SERIALUI_LANE_CRITICAL
+    #define SERIALUI_LANE_CRITICAL 64
+  #endif
+  #ifndef SERIALUI_LANE_NORMAL
+    #define SERIALUI_LANE_NORMAL 256
+  #endif
+  #ifndef SERIALUI_LANE_BACKGROUND
+    #define SERIALUI_LANE_BACKGROUND 128
+  #endif
+  // Pending value updates tracked for latest-value-wins coalescing (0 disables).
+  #ifndef SERIALUI_COALESCE_SLOTS
+    #define SERIALUI_COALESCE_SLOTS 8
+  #endif
+  // Each public drawing call becomes one record: the unit lanes are switched on.
+  // Keyed records target the region they paint; a newer one of the same kind
+  // replaces an unsent older one.
+  #define SERIALUI_RECORD() RecordScope uiRecord_(*this)
+  #define SERIALUI_RECORD_KEYED(kind, x, y, w) RecordScope uiRecord_(*this, kind, x, y, w)
+#else
+  #define SERIALUI_RECORD()
+  #define SERIALUI_RECORD_KEYED(kind, x, y, w)
+#endif
+
+#ifdef SERIALUI_TRACE
+  #ifndef SERIALUI_TRACE_RING
+    #define SERIALUI_TRACE_RING 16  // most recent calls kept
+  #endif
+  #ifndef SERIALUI_TRACE_SITES
+    #define SERIALUI_TRACE_SITES 12 // call sites summed up for dump()
+  #endif
+  #define SERIALUI_TRACE_DEPTH 8    // nesting tracked for self time
+// --- TRACE ---
+// Traced calls (public SerialUI entry points and generated drawScreen_*/user
+// functions) record entry time, duration and the bytes produced while they
+// ran. The ring keeps the latest calls; sites keep totals per call site, with
+// self time and bytes excluding nested traced calls.
+class UI_Trace {
+public:
+    struct Event { const char* name; uint32_t at, us; uint16_t bytes; uint8_t depth; };
+    struct Site { const char* name; uint32_t calls, us, selfUs, maxUs, bytes; };
+    static UI_Trace& get() { static UI_Trace t; return t; }
+
+    uint32_t bytes = 0; // every byte SerialUI has produced
+
+#ifndef ARDUINO
+    // Host tools such as UI_ChromeTrace see every finished call and TX wait.
+    class Observer {
+    public:
+        virtual ~Observer() {}
+        virtual void call(const Event& e) = 0;
+        virtual void blocked(uint32_t at, uint32_t us) = 0;
+    };
+    void setObserver(Observer* o) { observer = o; }
+#endif
+
+    void enter() {
+        if (depth < SERIALUI_TRACE_DEPTH) { childUs[depth] = 0; childBytes[depth] = 0; }
+        depth++;
+    }
+    void leave(const char* name, uint32_t at, uint32_t bytes0) {
+        uint32_t us = micros() - at, b = bytes - bytes0, selfUs = us, selfB = b;
+        depth--;
+        if (depth < SERIALUI_TRACE_DEPTH) { selfUs -= childUs[depth]; selfB -= childBytes[depth]; }
+        if (depth && depth <= SERIALUI_TRACE_DEPTH) { childUs[depth - 1] += us; childBytes[depth - 1] += b; }
+        Event& e = ring[head];
+        e.name = name; e.at = at; e.us = us; e.bytes = b > 0xFFFF ? 0xFFFF : (uint16_t)b; e.depth = depth;
+        head = (head + 1) % SERIALUI_TRACE_RING;
+        if (held < SERIALUI_TRACE_RING) held++;
+        calls++;
+#ifndef ARDUINO
+        if (observer) observer->call(e);
+#endif
+        Site* st = site(name);
+        if (!st) { dropped++; return; }
+        st->calls++; st->us += us; st->selfUs += selfUs; st->bytes += selfB;
+        if (us > st->maxUs) st->maxUs = us;
+    }
+    // Time the composer spent waiting for the TX backend to take a chunk.
+    void blocked(uint32_t at, uint32_t us) {
+        blockedUs += us;
+#ifndef ARDUINO
+        if (observer) observer->blocked(at, us);
+#endif
+    }
+    // i = 0 is the oldest call still in the ring.
+    uint8_t events() const { return held; }
+    const Event& event(uint8_t i) const { return ring[(head + SERIALUI_TRACE_RING - held + i) % SERIALUI_TRACE_RING]; }
+    // Clears the ring and the sites; call it outside traced calls.
+    void reset() { head = held = 0; calls = dropped = blockedUs = 0; memset(sites, 0, sizeof(sites)); }
+
+    // Prints the `top` sites by self time, then the `recent` latest calls. On the
+    // host this goes to stderr, on a board to Serial.
+    void dump(uint8_t top = 8, uint8_t recent = 0) const {
+        char line[96], nm[28];
+        snprintf(line, sizeof(line), "trace: %lu calls, %lu outside the site table, %lu us blocked on TX\n",
+                 (unsigned long)calls, (unsigned long)dropped, (unsigned long)blockedUs);
+        out(line);
+        out("site                          calls   total_us    self_us     max_us      bytes\n");
+        uint32_t shown = 0;
+        for (uint8_t k = 0; k < top; k++) {
+            int8_t best = -1;
+            for (uint8_t i = 0; i < SERIALUI_TRACE_SITES; i++)
+                if (sites[i].name && !(shown >> i & 1) && (best < 0 || sites[i].selfUs > sites[best].selfUs)) best = i;
+            if (best < 0) break;
+            shown |= 1UL << best;
+            const Site& st = sites[best];
+            snprintf(line, sizeof(line), "%-28s %6lu %10lu %10lu %10lu %10lu\n", name(st.name, nm, sizeof(nm)), (unsigned long)st.calls,
+                     (unsigned long)st.us, (unsigned long)st.selfUs, (unsigned long)st.maxUs, (unsigned long)st.bytes);
+            out(line);
+        }
+        if (recent > held) recent = held;
+        for (uint8_t i = held - recent; i < held; i++) {
+            const Event& e = event(i);
+            snprintf(line, sizeof(line), "%10lu %*s%s %luus %ub\n", (unsigned long)e.at, 2 * e.depth, "", name(e.name, nm, sizeof(nm)),
+                     (unsigned long)e.us, (unsigned)e.bytes);
+            out(line);
+        }
+    }
+
+private:
+    static_assert(SERIALUI_TRACE_SITES <= 32, "dump() marks sites in a 32-bit mask");
+    Site* site(const char* name) {
+        for (uint8_t i = 0; i < SERIALUI_TRACE_SITES; i++) {
+            if (sites[i].name == name) return &sites[i];
+            if (!sites[i].name) { sites[i].name = name; return &sites[i]; }
+        }
+        return nullptr;
+    }
+    static const char* name(const char* p, char* buf, uint8_t n) {
+        uint8_t i = 0;
+        for (char c; i < n - 1 && (c = (char)pgm_read_byte(p + i)); i++) buf[i] = c;
+        buf[i] = 0;
+        return buf;
+    }
+#ifdef ARDUINO
+    static void out(const char* s) { Serial.print(s); }
+#else
+    static void out(const char* s) { fputs(s, stderr); }
+#endif
+
+    Event ring[SERIALUI_TRACE_RING];
+    Site sites[SERIALUI_TRACE_SITES] = {};
+    uint32_t childUs[SERIALUI_TRACE_DEPTH], childBytes[SERIALUI_TRACE_DEPTH];
+    uint32_t calls = 0, dropped = 0, blockedUs = 0;
+    uint8_t head = 0, held = 0, depth = 0;
+#ifndef ARDUINO
+    Observer* observer = nullptr;
+#endif
+};
+
+class UI_TraceScope {
+public:
+    explicit UI_TraceScope(const char* name) : name(name), bytes(UI_Trace::get().bytes) { UI_Trace::get().enter(); at = micros(); }
+    ~UI_TraceScope() { UI_Trace::get().leave(name, at, bytes); }
+private:
+    const char* name;
+    uint32_t bytes, at;
+};
+  // Names live in flash; each use is one call site.
+  #define SERIALUI_TRACE_CALL(name) static const char uiTraceName_[] PROGMEM = name; UI_TraceScope uiTrace_(uiTraceName_)
+#else
+  #define SERIALUI_TRACE_CALL(name)
+#endif
+
+#ifdef SERIALUI_SERVICE
+  // Elements and callbacks that can wait for service() at the same time.
+  #ifndef SERIALUI_PENDING
+    #define SERIALUI_PENDING 16
+  #endif
+#endif
+
+#ifdef SERIALUI_VIEWPORT
+  // Terminal size the canvas is shown through until setViewport() is called.
+  #ifndef SERIALUI_VIEW_W
+    #define SERIALUI_VIEW_W 80
+  #endif
+  #ifndef SERIALUI_VIEW_H
+    #define SERIALUI_VIEW_H 24
+  #endif
+#endif
+
+#ifdef SERIALUI_ASYNC_TX
+// --- ASYNC TX BACKEND ---
+// A backend moves one buffer to the wire in the background (DMA, UART ISR,
+// host thread) and calls complete() once the buffer may be reused. SerialUI
+// keeps two chunks: one in flight, one being composed.
+#ifndef SERIALUI_TX_CHUNK
+  #define SERIALUI_TX_CHUNK 64
+#endif
+
+#ifdef ARDUINO
+  typedef volatile bool UI_TxFlag;
+#else
+  typedef std::atomic<bool> UI_TxFlag;
+#endif
+
+class UI_TxBackend {
+public:
+    typedef void (*CompleteFn)(void* ctx);
+    virtual ~UI_TxBackend() {}
+    // buf must stay untouched until the completion callback fires.
+    virtual bool startTransfer(const uint8_t* buf, uint16_t len) = 0;
+    virtual bool busy() const = 0;
+    void setCompleteCallback(CompleteFn fn, void* ctx) { onComplete = fn; onCompleteCtx = ctx; }
+protected:
+    void complete() { if (onComplete) onComplete(onCompleteCtx); }
+private:
+    CompleteFn onComplete = nullptr;
+    void* onCompleteCtx = nullptr;
+};
+
+#ifndef ARDUINO
+// Host stand-in for a DMA UART: a worker thread writes each buffer to `out`
+// and holds the backend busy for as long as the bytes would take on an 8N1
+// link at `baud`, so the pipeline can be exercised without hardware.
+class HostThreadTx : public UI_TxBackend {
+public:
+    explicit HostThreadTx(long baud = 115200, FILE* out = stdout)
+        : baud(baud), out(out), wireFree(std::chrono::steady_clock::now()), worker(&HostThreadTx::run, this) {}
+    ~HostThreadTx() {
+        {
+            std::unique_lock<std::mutex> lk(m);
+            idle.wait(lk, [this] { return !pending && !inFlight; });
+            stop = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+    bool startTransfer(const uint8_t* b, uint16_t n) override {
+        std::lock_guard<std::mutex> lk(m);
+        if (inFlight) return false;
+        buf = b; len = n; inFlight = true; pending = true;
+        wake.notify_one();
+        return true;
+    }
+    bool busy() const override { return inFlight; }
+    void setBaud(long b) { baud = b; }
+    // Called on the worker thread for each buffer with its slot on the simulated
+    // wire, in micros() time.
+    typedef void (*WireFn)(uint32_t at, uint32_t us, uint16_t n, void* ctx);
+    void setWireHook(WireFn fn, void* ctx) { std::lock_guard<std::mutex> lk(m); wireFn = fn; wireCtx = ctx; }
+    uint32_t bytesSent() const { return sent; }
+    // Total time the simulated wire spent shifting bytes out.
+    uint32_t wireMicros() const { return wireUs; }
+private:
+    void run() {
+        std::unique_lock<std::mutex> lk(m);
+        while (true) {
+            wake.wait(lk, [this] { return stop || pending; });
+            if (!pending) return;
+            const uint8_t* b = buf; uint16_t n = len; long bd = baud;
+            WireFn hook = wireFn; void* hookCtx = wireCtx;
+            pending = false;
+            lk.unlock();
+            if (out) { fwrite(b, 1, n, out); fflush(out); }
+            auto dur = std::chrono::microseconds((long long)n * 10 * 1000000 / (bd > 0 ? bd : 1));
+            auto now = std::chrono::steady_clock::now();
+            if (wireFree < now) wireFree = now;
+            if (hook) hook(micros() + (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(wireFree - now).count(),
+                           (uint32_t)dur.count(), n, hookCtx);
+            wireFree += dur;
+            std::this_thread::sleep_until(wireFree);
+            sent += n; wireUs += (uint32_t)dur.count();
+            inFlight = false;
+            complete();
+            lk.lock();
+            idle.notify_all();
+        }
+    }
+    long baud;
+    FILE* out;
+    std::chrono::steady_clock::time_point wireFree;
+    std::mutex m;
+    std::condition_variable wake, idle;
+    const uint8_t* buf = nullptr;
+    uint16_t len = 0;
+    std::atomic<bool> inFlight{false};
+    bool pending = false, stop = false;
+    std::atomic<uint32_t> sent{0}, wireUs{0};
+    WireFn wireFn = nullptr;
+    void* wireCtx = nullptr;
+    std::thread worker;
+};
+#endif
+#endif
+
+#ifdef SERIALUI_FRAME_SINK
+  #ifdef ARDUINO
+    #error "SERIALUI_FRAME_SINK needs a POSIX host (Linux)"
+  #endif
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+// --- FRAME CAPTURE ---
+// Keeps the cells the terminal shows in a memory-mapped file (e.g. under
+// /dev/shm), so screenshotters and test harnesses can read the screen without
+// parsing the serial stream. A seqlock guards the cells: seq is odd while they
+// change and every publish makes it even, so a reader copies the cells, reads
+// seq again, and retries if it moved or was odd.
+struct UI_FrameHeader {
+    uint32_t magic;             // 'SUIF'
+    uint16_t version, headerSize;
+    uint16_t width, height;
+    std::atomic<uint32_t> seq;  // seq / 2 frames published
+    int16_t cursorX, cursorY;
+    uint32_t reserved;
+};
+// fg/bg hold SGR codes (0 = terminal default); attr bits are bold, dim,
+// italic, underline, blink, reverse from bit 0.
+struct UI_Cell { uint32_t ch; uint8_t fg, bg, attr, pad; };
+static_assert(sizeof(UI_FrameHeader) == 24 && sizeof(UI_Cell) == 8, "frame file layout");
+
+class UI_FrameSink {
+public:
+    UI_FrameSink(const char* path, uint16_t w = 80, uint16_t h = 24) : w(w), h(h), bot(h - 1) {
+        size = sizeof(UI_FrameHeader) + (size_t)w * h * sizeof(UI_Cell);
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, (off_t)size)) { if (fd >= 0) close(fd); return; }
+        void* m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (m == MAP_FAILED) return;
+        hdr = new (m) UI_FrameHeader();
+        hdr->magic = 0x46495553; hdr->version = 1; hdr->headerSize = sizeof(UI_FrameHeader);
+        hdr->width = w; hdr->height = h;
+        cells = (UI_Cell*)(hdr + 1);
+        clear(0, (size_t)w * h);
+        publish();
+    }
+    ~UI_FrameSink() { if (hdr) munmap(hdr, size); }
+    UI_FrameSink(const UI_FrameSink&) = delete;
+    UI_FrameSink& operator=(const UI_FrameSink&) = delete;
+
+    bool ok() const { return hdr != nullptr; }
+    uint32_t frames() const { return hdr ? hdr->seq.load(std::memory_order_relaxed) / 2 : 0; }
+
+    // Ends a frame: readers see every cell written so far.
+    void publish() {
+        if (!writing) return;
+        writing = false;
+        hdr->cursorX = cx; hdr->cursorY = cy;
+        hdr->seq.store(hdr->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // One byte of the ANSI stream, as the terminal would interpret it.
+    void put(uint8_t c) {
+        if (!hdr) return;
+        if (state == 1) { esc(c); return; }
+        if (state == 2) { csi(c); return; }
+        if (utfLeft) {
+            if ((c & 0xC0) == 0x80) { utf = utf << 6 | (c & 0x3F); if (--utfLeft == 0) glyph(utf); return; }
+            utfLeft = 0;
+        }
+        if (c == 0x1b) state = 1;
+        else if (c == '\r') cx = 0;
+        else if (c == '\n') { if (cy < h - 1) cy++; }
+        else if (c == '\b') { if (cx) cx--; }
+        else if (c >= 0xC0) { utf = c & (c >= 0xF0 ? 0x07 : c >= 0xE0 ? 0x0F : 0x1F); utfLeft = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : 1; }
+        else if (c >= 0x20 && c != 0x7F) glyph(c);
+    }
+
+private:
+    void esc(uint8_t c) {
+        state = 0;
+        if (c == '[') { state = 2; np = 0; par[0] = 0; priv = false; }
+        else if (c == '7') { sx = cx; sy = cy; sfg = fg; sbg = bg; sattr = attr; }
+        else if (c == '8') { cx = sx; cy = sy; fg = sfg; bg = sbg; attr = sattr; }
+    }
+    void csi(uint8_t c) {
+        if (c >= '0' && c <= '9') { par[np] = par[np] * 10 + (c - '0'); return; }
+        if (c == ';') { if (np < 7) par[++np] = 0; return; }
+        if (c == '?') { priv = true; return; }
+        state = 0;
+        if (priv) return;
+        uint16_t n = par[0] ? par[0] : 1;
+        int ex = std::min<int>(cx, w - 1); // past the last glyph cx == w; erase as a pending wrap would
+        switch (c) {
+            case 'H': case 'f': cy = clampY(n - 1); cx = clampX((np ? (par[1] ? par[1] : 1) : 1) - 1); break;
+            case 'A': cy = clampY(cy - n); break;
+            case 'B': cy = clampY(cy + n); break;
+            case 'C': cx = clampX(cx + n); break;
+            case 'D': cx = clampX(cx - n); break;
+            case 'G': cx = clampX(n - 1); break;
+            case 'J':
+                if (par[0] == 0) clear(at(ex, cy), (size_t)w * h);
+                else if (par[0] == 1) clear(0, at(ex, cy) + 1);
+                else clear(0, (size_t)w * h);
+                break;
+            case 'K':
+                if (par[0] == 0) clear(at(ex, cy), at(0, cy) + w);
+                else if (par[0] == 1) clear(at(0, cy), at(ex, cy) + 1);
+                else clear(at(0, cy), at(0, cy) + w);
+                break;
+            case 'X': clear(at(cx, cy), at(cx, cy) + std::min<int>(n, w - cx)); break;
+            case 'P': case '@': shiftRow(c == 'P' ? n : -(int)n); break;
+            case 'S': case 'T': scroll(c == 'S' ? n : -(int)n); break;
+            case 'r': // scroll region, cursor homes
+                top = (int16_t)(n - 1); bot = (int16_t)(np && par[1] ? par[1] - 1 : h - 1);
+                if (top >= bot || bot >= h) { top = 0; bot = h - 1; }
+                cx = cy = 0;
+                break;
+            case 'm': for (uint8_t i = 0; i <= np; i++) sgr(par[i]); break;
+        }
+    }
+    void sgr(uint16_t p) {
+        static const uint8_t bits[] = { 0, 1, 2, 4, 8, 16, 0, 32 };
+        if (p == 0) { fg = bg = attr = 0; }
+        else if (p <= 7) attr |= bits[p];
+        else if ((p >= 30 && p <= 37) || (p >= 90 && p <= 97)) fg = (uint8_t)p;
+        else if ((p >= 40 && p <= 47) || (p >= 100 && p <= 107)) bg = (uint8_t)p;
+        else if (p == 39) fg = 0;
+        else if (p == 49) bg = 0;
+    }
+    void glyph(uint32_t ch) {
+        if (cx >= w) return; // no autowrap; the library positions every run
+        begin();
+        UI_Cell& k = cells[at(cx, cy)];
+        k.ch = ch; k.fg = fg; k.bg = bg; k.attr = attr;
+        cx++;
+    }
+    void clear(size_t from, size_t to) {
+        begin();
+        for (size_t i = from; i < to; i++) { cells[i].ch = ' '; cells[i].fg = 0; cells[i].bg = bg; cells[i].attr = 0; cells[i].pad = 0; }
+    }
+    void shiftRow(int n) {
+        if (n >= w - cx) n = w - cx;
+        if (-n >= w - cx) n = cx - w;
+        begin();
+        UI_Cell* row = cells + at(0, cy);
+        if (n > 0) { memmove(row + cx, row + cx + n, (w - cx - n) * sizeof(UI_Cell)); clear(at(w - n, cy), at(0, cy) + w); }
+        else if (n < 0) { memmove(row + cx - n, row + cx, (w - cx + n) * sizeof(UI_Cell)); clear(at(cx, cy), at(cx - n, cy)); }
+    }
+    void scroll(int n) {
+        int span = bot - top + 1;
+        if (n > span) n = span;
+        if (n < -span) n = -span;
+        begin();
+        UI_Cell* band = cells + at(0, top);
+        size_t rows = (size_t)(span - (n > 0 ? n : -n)) * w;
+        if (n > 0) { memmove(band, band + (size_t)n * w, rows * sizeof(UI_Cell)); clear(at(0, top) + rows, at(0, bot + 1)); }
+        else if (n < 0) { memmove(band - (ptrdiff_t)n * w, band, rows * sizeof(UI_Cell)); clear(at(0, top), at(0, top - n)); }
+    }
+    void begin() {
+        if (writing) return;
+        writing = true;
+        hdr->seq.store(hdr->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    size_t at(int x, int y) const { return (size_t)y * w + x; }
+    int16_t clampX(int x) const { return (int16_t)(x < 0 ? 0 : x >= w ? w - 1 : x); }
+    int16_t clampY(int y) const { return (int16_t)(y < 0 ? 0 : y >= h ? h - 1 : y); }
+
+    UI_FrameHeader* hdr = nullptr;
+    UI_Cell* cells = nullptr;
+    size_t size = 0;
+    uint16_t w, h;
+    int16_t cx = 0, cy = 0, sx = 0, sy = 0, top = 0, bot = 0;
+    uint8_t fg = 0, bg = 0, attr = 0, sfg = 0, sbg = 0, sattr = 0;
+    uint8_t state = 0, np = 0, utfLeft = 0;
+    uint16_t par[8];
+    uint32_t utf = 0;
+    bool priv = false, writing = false;
+};
+#endif
+
 class SerialUI {
 public:
+#ifdef SERIALUI_PRIORITY_LANES
+    SerialUI() {
+        lanes[0].init(laneMem, SERIALUI_LANE_CRITICAL);
+        lanes[1].init(laneMem + SERIALUI_LANE_CRITICAL, SERIALUI_LANE_NORMAL);
+        lanes[2].init(laneMem + SERIALUI_LANE_CRITICAL + SERIALUI_LANE_NORMAL, SERIALUI_LANE_BACKGROUND);
+    }
+#endif
+
     void begin(long baud = 115200) {
+        SERIALUI_TRACE_CALL("begin");
+        SERIALUI_RECORD();
         Serial.begin(baud);
         while (!Serial) delay(10);
-        Serial.print("\x1b[?25l"); // Hide cursor
+        put("\x1b[?25l"); // Hide cursor
         clearScreen();
     }
-    void clearScreen() { Serial.print("\x1b[2J\x1b[H"); }
-    void resetAttr() { Serial.print("\x1b[0m"); }
+    void clearScreen() { SERIALUI_RECORD(); SERIALUI_TRACE_CALL("clearScreen"); put("\x1b[2J\x1b[H"); settle(); }
+#ifdef SERIALUI_VIEWPORT
+    // Colours are held back until something visible is drawn, so elements
+    // that are entirely clipped cost no bytes at all.
+    void resetAttr() {
+        pendFg = pendBg = 0;
+        if (attrSent) { attrSent = false; sgr(0); }
+        settle();
+    }
 
     void setColor(UI_Color color) {
-        Serial.print("\x1b["); Serial.print((int)color); Serial.print("m");
+        int c = (int)color;
+        if ((c >= 40 && c <= 47) || c >= 100) pendBg = (uint8_t)c; else pendFg = (uint8_t)c;
     }
+#else
+    void resetAttr() { sgr(0); settle(); }
+
+    void setColor(UI_Color color) { sgr((uint8_t)color); }
+#endif
 
     void moveCursor(int x, int y) {
-        Serial.print("\x1b["); Serial.print(y + 1); Serial.print(";"); Serial.print(x + 1); Serial.print("H");
+#ifdef SERIALUI_VIEWPORT
+        vcx = x; vcy = y;
+        curValid = visible(x, y);
+        if (!curValid) return;
+        x -= vpX; y -= vpY;
+#endif
+        cursorTo(x, y);
+    }
+
+#ifdef SERIALUI_COMPRESS
+    // Compresses everything sent from now on (ANSI or binary). A reset token
+    // starts the stream, so a decoder can join at that point.
+    void setCompression(bool on) {
+        SERIALUI_TRACE_CALL("setCompression");
+        lzFlush();
+        if (!on && !lzOn) return;
+        lzOn = false;
+        const UI_LzDict* d = UI_LzDict::active();
+        uint16_t n = on && d ? d->size : 0;
+        uint8_t hdr[5] = { 0xFF, 0x01, (uint8_t)(on ? SERIALUI_LZ_WINDOW_BITS : 0), (uint8_t)(n & 0xFF), (uint8_t)(n >> 8) };
+        for (uint8_t i = 0; i < 5; i++) wireByte(hdr[i]);
+        if (!on) return;
+        memset(lzHead, 0, sizeof(lzHead));
+        lzPos = 0; lzFill = 0; lzHeld = 0; lzLen = 0;
+        lzOn = true;
+    }
+    // Bytes handed to the compressor and bytes that left it, for the ratio.
+    uint32_t rawBytes() const { return lzRaw; }
+    uint32_t wireBytes() const { return lzWire; }
+#endif
+
+#ifdef SERIALUI_FRAME_SINK
+    // Mirrors the ANSI output into a capture file; nullptr detaches. Each drawing
+    // call publishes one frame. Binary output is not interpreted: capture it
+    // with the viewer's --capture instead.
+    void setFrameSink(UI_FrameSink* s) { settle(); frameSink = s; }
+#endif
+
+#ifdef SERIALUI_BINARY
+    // Switches between ANSI and the binary protocol; drawing code stays the same.
+    // Switching to BINARY announces it, so a viewer can check its layout.
+    void setProtocol(UI_Protocol p) {
+        SERIALUI_TRACE_CALL("setProtocol");
+        bin = p == UI_Protocol::BINARY;
+        if (!bin) return;
+        const UI_ElementTable* t = UI_ElementTable::active();
+        uint16_t n = t ? t->count : 0;
+        putByte(UI_OP_HELLO); putByte(UI_PROTOCOL_VERSION); putByte(n & 0xFF); putByte(n >> 8);
+    }
+    UI_Protocol protocol() const { return bin ? UI_Protocol::BINARY : UI_Protocol::ANSI; }
+#endif
+
+#ifdef SERIALUI_ASYNC_TX
+    ~SerialUI() { flush(); }
+
+    // Route all output through a background transmitter; nullptr returns to Serial.
+    void setTxBackend(UI_TxBackend* backend) {
+        SERIALUI_TRACE_CALL("setTxBackend");
+        flush();
+        tx = backend;
+        if (tx) tx->setCompleteCallback(&SerialUI::txDone, this);
+    }
+    // Hands a partially composed chunk to the backend if it is idle. Call from loop().
+    void poll() {
+        SERIALUI_TRACE_CALL("poll");
+        settle();
+        if (!tx) return;
+#ifdef SERIALUI_PRIORITY_LANES
+        if (!recDepth) laneCommit(lanes[(uint8_t)prio], 0);
+        fillChunk();
+#endif
+        if (txLen && !txInFlight && !tx->busy()) sendChunk();
+    }
+    // Blocks until every composed byte has left the backend.
+    void flush() {
+        SERIALUI_TRACE_CALL("flush");
+        settle();
+        if (!tx) return;
+#ifdef SERIALUI_PRIORITY_LANES
+        laneCommit(lanes[(uint8_t)prio], 0);
+        for (fillChunk(); txLen; fillChunk()) sendChunk();
+#else
+        if (txLen) sendChunk();
+#endif
+        txDrain();
+    }
+#else
+    void poll() { SERIALUI_TRACE_CALL("poll"); settle(); }
+    void flush() { SERIALUI_TRACE_CALL("flush"); settle(); }
+#endif
+
+#ifdef SERIALUI_PRIORITY_LANES
+    // Updates dropped because a newer one for the same region replaced them.
+    uint32_t coalescedCount() const { return coalesced; }
+#endif
+
+    // Selects the lane for subsequent drawing calls and returns the previous one.
+    // CRITICAL output overtakes queued NORMAL/BACKGROUND output.
+    UI_Priority setPriority(UI_Priority p) {
+        SERIALUI_TRACE_CALL("setPriority");
+        UI_Priority prev = prio;
+#ifdef SERIALUI_PRIORITY_LANES
+        if (p != prio) laneCommit(lanes[(uint8_t)prio], 0);
+#endif
+        prio = p;
+        return prev;
+    }
+
+    typedef void (*RedrawFn)(SerialUI& ui);
+
+#ifdef SERIALUI_SERVICE
+    // Marks a layout element, canvas or render callback (e.g. one that prints a
+    // value) for the next service(). Marking one that is already pending costs
+    // nothing, so the app may invalidate as often as it produces data. With the
+    // table full the item is drawn at once and false is returned.
+    bool invalidate(const UI_Box& e) { return pend(item(&e, PEND_BOX, e.x, e.y)); }
+    bool invalidate(const UI_Line& e) { return pend(item(&e, PEND_LINE, e.x1 < e.x2 ? e.x1 : e.x2, e.y1 < e.y2 ? e.y1 : e.y2)); }
+    bool invalidate(const UI_Freehand& e) { return pend(item(&e, PEND_FREEHAND, e.x, e.y)); }
+    bool invalidate(const UI_Text& e) { return pend(item(&e, PEND_TEXT, e.x, e.y)); }
+    bool invalidate(const UI_LText& e) { return pend(item(&e, PEND_LTEXT, e.x, e.y)); }
+    // A big number is drawn from the value it was last invalidated with.
+    bool invalidate(const UI_BigNum& e, long value, uint8_t decimals = 0) {
+        Pending p = item(&e, PEND_BIGNUM, e.x, e.y); p.value = value; p.decimals = decimals;
+        return pend(p);
     }
+    bool invalidate(UI_CanvasBase& e) { return pend(item(&e, PEND_CANVAS, e.box.x, e.box.y)); }
+    bool invalidate(RedrawFn fn) { Pending p = item(nullptr, PEND_FN, 0x7FFF, 0x7FFF); p.fn = fn; return pend(p); }
+    uint8_t pendingCount() const { return nPending; }
+
+    // Draws what is pending: frames first, then lines and art, then text, canvases
+    // and callbacks, each group top to bottom and left to right so cursor moves stay
+    // short. No new item is started once budgetUs microseconds have passed (0: no
+    // limit); the rest waits for the next call. Returns the number drawn.
+    uint8_t service(uint32_t budgetUs = 0) {
+        SERIALUI_TRACE_CALL("service");
+        uint32_t t0 = micros();
+        uint8_t done = 0;
+        while (nPending) {
+            uint8_t best = 0;
+            for (uint8_t i = 1; i < nPending; i++)
+                if (pendBefore(pendq[i], pendq[best])) best = i;
+            Pending p = pendq[best];
+            pendq[best] = pendq[--nPending];
+            pendDraw(p);
+            done++;
+            if (budgetUs && micros() - t0 >= budgetUs) break;
+        }
+        poll();
+        return done;
+    }
+#endif
+
+#ifdef SERIALUI_VIEWPORT
+    // Drawing uses canvas coordinates; the terminal shows a w x h window of it in
+    // its top h rows. Rows below the window (a status line) are left alone, but w
+    // must be the terminal's full width: DCH/ICH shift whole terminal rows.
+    void setViewport(int16_t w, int16_t h) { vpW = w; vpH = h; clipAll(); }
+    int16_t viewX() const { return vpX; }
+    int16_t viewY() const { return vpY; }
+
+    // Moves the window to canvas (x, y). What stays in view is shifted on the
+    // terminal (SU/SD within a DECSTBM region for rows, DCH/ICH for columns) and
+    // redraw runs with output clipped to the rows, then the columns, that came
+    // into view. A jump of a whole window or more clears and redraws the window.
+    void scrollTo(int16_t x, int16_t y, RedrawFn redraw) {
+        SERIALUI_TRACE_CALL("scrollTo");
+        int16_t dx = x - vpX, dy = y - vpY;
+        if (!dx && !dy) return;
+        resetAttr();
+        vpX = x; vpY = y; curValid = false;
+        if (abs(dx) >= vpW || abs(dy) >= vpH) {
+            if (vpH > 1) scrollRows(vpH);
+            else put("\x1b[H\x1b[2K"); // a one-row region is invalid
+            clipAll();
+            if (redraw) redraw(*this);
+        } else {
+            if (dy) scrollRows(dy);
+            // rows outside the vertical band: shifted sideways, then their new columns drawn
+            int16_t keep0 = dy > 0 ? 0 : -dy, keep1 = dy > 0 ? vpH - dy : vpH;
+            if (dx) {
+                for (int16_t r = keep0; r < keep1; r++) {
+                    put("\x1b["); putNum(r + 1); put(";1H\x1b["); putNum(abs(dx)); put(dx > 0 ? "P" : "@");
+                }
+            }
+            if (dy && redraw) { clipX0 = 0; clipX1 = vpW; clipY0 = dy > 0 ? keep1 : 0; clipY1 = dy > 0 ? vpH : keep0; redraw(*this); }
+            if (dx && redraw) { clipX0 = dx > 0 ? vpW - dx : 0; clipX1 = dx > 0 ? vpW : -dx; clipY0 = keep0; clipY1 = keep1; redraw(*this); }
+            clipAll();
+        }
+        curValid = false;
+#ifdef SERIALUI_PRIORITY_LANES
+        // output composed after this point is already translated; keep CRITICAL from overtaking the shift
+        flush();
+#endif
+    }
+#endif
 
     // --- DRAWING METHODS ---
     void draw(const UI_Text& t) {
-        setColor(t.color); moveCursor(t.x, t.y); Serial.print(t.content); resetAttr();
+        SERIALUI_TRACE_CALL("draw(UI_Text)");
+        SERIALUI_RECORD();
+        SERIALUI_BLIT(&t);
+        setColor(t.color); moveCursor(t.x, t.y); putText(t.content); resetAttr();
     }
 
     void draw(const UI_Box& b) {
+        SERIALUI_TRACE_CALL("draw(UI_Box)");
+        SERIALUI_RECORD();
+        SERIALUI_BLIT(&b);
         setColor(b.color);
-        for (int i = 0; i < b.w; i++) { moveCursor(b.x + i, b.y); Serial.print("-"); moveCursor(b.x + i, b.y + b.h - 1); Serial.print("-"); }
-        for (int i = 0; i < b.h; i++) { moveCursor(b.x, b.y + i); Serial.print("|"); moveCursor(b.x + b.w - 1, b.y + i); Serial.print("|"); }
-        moveCursor(b.x, b.y); Serial.print("+"); moveCursor(b.x + b.w - 1, b.y); Serial.print("+");
-        moveCursor(b.x, b.y + b.h - 1); Serial.print("+"); moveCursor(b.x + b.w - 1, b.y + b.h - 1); Serial.print("+");
+        for (int i = 0; i < b.w; i++) { moveCursor(b.x + i, b.y); putGlyph('-'); moveCursor(b.x + i, b.y + b.h - 1); putGlyph('-'); }
+        for (int i = 0; i < b.h; i++) { moveCursor(b.x, b.y + i); putGlyph('|'); moveCursor(b.x + b.w - 1, b.y + i); putGlyph('|'); }
+        moveCursor(b.x, b.y); putGlyph('+'); moveCursor(b.x + b.w - 1, b.y); putGlyph('+');
+        moveCursor(b.x, b.y + b.h - 1); putGlyph('+'); moveCursor(b.x + b.w - 1, b.y + b.h - 1); putGlyph('+');
         resetAttr();
     }
 
     void draw(const UI_Line& l) {
+        SERIALUI_TRACE_CALL("draw(UI_Line)");
+        SERIALUI_RECORD();
+        SERIALUI_BLIT(&l);
         setColor(l.color);
         int dx = abs(l.x2 - l.x1), sx = l.x1 < l.x2 ? 1 : -1;
         int dy = -abs(l.y2 - l.y1), sy = l.y1 < l.y2 ? 1 : -1;
         int err = dx + dy, e2;
         int x = l.x1, y = l.y1;
         while (true) {
-            moveCursor(x, y); Serial.print("#");
+            moveCursor(x, y); putGlyph('#');
             if (x == l.x2 && y == l.y2) break;
             e2 = 2 * err;
             if (e2 >= dy) { err += dy; x += sx; }
@@ -134,51 +1094,1213 @@ public:
     }
 
     void draw(const UI_Freehand& f) {
+        SERIALUI_TRACE_CALL("draw(UI_Freehand)");
+        SERIALUI_RECORD();
+        SERIALUI_BLIT(&f);
         setColor(f.color);
         for(int i=0; i<f.count; i++) {
             moveCursor(f.x, f.y + i);
             const char* strPtr = (const char*)pgm_read_ptr(&(f.lines[i]));
-            while(uint8_t c = pgm_read_byte(strPtr++)) { Serial.write(c); }
+            while(uint8_t c = pgm_read_byte(strPtr++)) { putGlyph(c); }
+        }
+        resetAttr();
+    }
+
+    void draw(const UI_LText& t) {
+        SERIALUI_TRACE_CALL("draw(UI_LText)");
+        SERIALUI_RECORD();
+        setColor(t.color); moveCursor(t.x, t.y);
+        UI_StrReader r(table(lang), t.id);
+        for (int c; (c = r.next()) >= 0; ) putGlyph((uint8_t)c);
+        resetAttr();
+    }
+
+    // Clears the digit area; the next drawBigNumber() then draws every lit segment.
+    void draw(const UI_BigNum& b) {
+        SERIALUI_TRACE_CALL("draw(UI_BigNum)");
+        fillRect(b.x, b.y, b.digits * 4, 3, ' ', b.color);
+        memset(b.shown, 0, b.digits);
+    }
+
+    // Shows text right-aligned (digits, '-', ' ', '.', and A b C d E F H L n o P r U _).
+    // Only segments that differ from what is shown are sent; a '.' lights the decimal
+    // point of the glyph before it. Text that does not fit shows all dashes.
+    void drawBigNumber(const UI_BigNum& b, const char* text) {
+        SERIALUI_TRACE_CALL("drawBigNumber");
+        uint8_t m[16], n = 0, t[16];
+        for (const char* p = text; *p; p++) {
+            if (*p == '.' || *p == ',') { if (!n) m[n++] = 0; m[n - 1] |= 0x80; continue; }
+            if (n == sizeof(m)) { n = 0xFF; break; }
+            m[n++] = segMask(*p);
         }
+        uint8_t digits = b.digits < sizeof(t) ? b.digits : sizeof(t);
+        for (uint8_t d = 0; d < digits; d++) t[d] = n > digits ? 0x40 : (d + n >= digits ? m[d + n - digits] : 0);
+        if (!memcmp(t, b.shown, digits)) return;
+        SERIALUI_RECORD();
+        setColor(b.color);
+        // row-major walk over changed cells; gaps of a few cells are bridged by
+        // resending what they show, which is cheaper than a cursor move
+        for (uint8_t row = 0; row < 3; row++) {
+            int16_t at = -1;
+            for (int16_t cx = 0; cx < digits * 4; cx++) {
+                uint8_t d = cx >> 2, bit = segBit(row, cx & 3);
+                if (!bit || !((t[d] ^ b.shown[d]) & bit)) continue;
+                if (at < 0 || cx - at > 4) moveCursor(b.x + cx, b.y + row);
+                else for (int16_t g = at; g < cx; g++) putGlyph((t[g >> 2] & segBit(row, g & 3)) ? segGlyph(g & 3) : ' ');
+                putGlyph((t[d] & bit) ? segGlyph(cx & 3) : ' ');
+                at = cx + 1;
+            }
+        }
+        memcpy(b.shown, t, digits);
         resetAttr();
     }
 
+    // Terminal capability flags (UI_CAP_*), SERIALUI_CAPS by default.
+    void setCaps(uint8_t c) { capFlags = c; }
+    uint8_t caps() const { return capFlags; }
+
+    // Horizontal bar in the box interior, value out of full. With UI_CAP_UTF8 it
+    // moves in 1/8-cell steps using the left block elements, otherwise in whole
+    // cells of '#'. Only the cells between the old and new end of the fill are
+    // sent: a change within one cell rewrites one cell per row.
+    void drawBar(const UI_Box& b, uint16_t value, uint16_t full, UI_Color color, UI_BarState& st) {
+        SERIALUI_TRACE_CALL("drawBar");
+        fillBar(b, value, full, color, st, false, capFlags & UI_CAP_UTF8);
+    }
+
+    // Vertical gauge filling the box interior from the bottom, with the lower
+    // block elements for 1/8-cell steps; otherwise as drawBar().
+    void drawGauge(const UI_Box& b, uint16_t value, uint16_t full, UI_Color color, UI_BarState& st) {
+        SERIALUI_TRACE_CALL("drawGauge");
+        fillBar(b, value, full, color, st, true, capFlags & UI_CAP_UTF8);
+    }
+
+    // Integer drawProgressBar: whole cells of '#' on any terminal, no float math,
+    // and no output unless the number of filled cells or the colour changes.
+    // With UI_BarState(band) the value must move `band` past a cell boundary.
+    void drawProgress(const UI_Box& b, uint16_t value, uint16_t full, UI_Color color, UI_BarState& st) {
+        SERIALUI_TRACE_CALL("drawProgress");
+        fillBar(b, value, full, color, st, false, false);
+    }
+
+    // Sends the canvas cells whose dot pattern changed since the last call (every
+    // cell after invalidate()); nothing at all if none did. Without UI_CAP_UTF8 a
+    // cell shows ' . \' :' depending on which half has dots.
+    void drawCanvas(UI_CanvasBase& c) {
+        SERIALUI_TRACE_CALL("drawCanvas");
+        size_t n = (size_t)c.cols * c.rows;
+        if (!c.stale && !memcmp(c.dots, c.shown, n)) return;
+        SERIALUI_RECORD();
+        setColor(c.color);
+        for (int16_t r = 0; r < c.rows; r++) {
+            const uint8_t* d = c.dots + r * c.cols;
+            uint8_t* s = c.shown + r * c.cols;
+            int16_t at = -1;
+            for (int16_t x = 0; x < c.cols; x++) {
+                if (!c.stale && d[x] == s[x]) continue;
+                if (at < 0 || x - at > 2) moveCursor(c.box.x + 1 + x, c.box.y + 1 + r);
+                else for (int16_t g = at; g < x; g++) putDots(d[g]);
+                putDots(d[x]);
+                s[x] = d[x];
+                at = x + 1;
+            }
+        }
+        c.stale = false;
+        resetAttr();
+    }
+
+    // Integer or fixed-point value: drawBigNumber(b, 2315, 2) shows 23.15.
+    void drawBigNumber(const UI_BigNum& b, long value, uint8_t decimals = 0) {
+        SERIALUI_TRACE_CALL("drawBigNumber(value)");
+        char buf[24]; uint8_t i = sizeof(buf) - 1; // every digit of a 64-bit long, '.' and '-'
+        bool neg = value < 0;
+        unsigned long v = neg ? 0ul - (unsigned long)value : (unsigned long)value;
+        buf[i] = 0;
+        do {
+            buf[--i] = (char)('0' + v % 10); v /= 10;
+            if (decimals && !--decimals) buf[--i] = '.';
+        } while ((v || decimals || buf[i] == '.') && i > 2);
+        if (neg) buf[--i] = '-';
+        drawBigNumber(b, buf + i);
+    }
+
+    // --- LOCALIZED STRINGS ---
+    // Tables are emitted by the generator as UI_STRINGS[UI_Lang::COUNT]; drawScreen_*
+    // and relabelScreen_* install them, so sketches normally only pick a language.
+    void setStrings(const UI_StringTable* tables) { strTables = tables; }
+    void setLanguage(uint8_t l) { lang = l; }
+    uint8_t language() const { return lang; }
+
+    // Copies string `id` of the current language into buf (always terminated).
+    size_t getString(uint16_t id, char* buf, size_t n) {
+        UI_StrReader r(table(lang), id);
+        size_t i = 0;
+        for (int c; i + 1 < n && (c = r.next()) >= 0; ) buf[i++] = (char)c;
+        if (n) buf[i] = 0;
+        return i;
+    }
+
+    // Repaints t after a language change, sending only the cells whose glyph
+    // differs from what language `prev` showed there. Strings with escape
+    // sequences or line breaks are blanked and redrawn whole.
+    void relabel(const UI_LText& t, uint8_t prev) {
+        SERIALUI_TRACE_CALL("relabel");
+        if (prev == lang) return;
+        SERIALUI_RECORD();
+        if (!plainString(prev, t.id) || !plainString(lang, t.id)) {
+            UI_StrReader o(table(prev), t.id);
+            moveCursor(t.x, t.y);
+            for (int c, esc = 0; (c = o.next()) >= 0; ) {
+                if (esc) { if (esc == 1) esc = c == '[' ? 2 : 0; else if (c >= 0x40 && c <= 0x7E) esc = 0; continue; }
+                if (c == 0x1b) esc = 1;
+                else if (c == '\n') putGlyph('\n');
+                else if ((c & 0xC0) != 0x80) putGlyph(' ');
+            }
+            draw(t);
+            return;
+        }
+        setColor(t.color);
+        UI_StrReader a(table(prev), t.id), b(table(lang), t.id);
+        uint8_t ga[4], gb[4], gap[4], gapLen = 0;
+        bool placed = false; // terminal cursor sits at cell x
+        for (int16_t x = t.x; ; x++) {
+            uint8_t na = a.glyph(ga), nb = b.glyph(gb);
+            if (!na && !nb) break;
+            if (na == nb && !memcmp(ga, gb, na)) {
+                // short unchanged runs are resent instead of paying for a cursor move
+                if (placed && na == 1 && gapLen < sizeof(gap)) gap[gapLen++] = ga[0];
+                else { placed = false; gapLen = 0; }
+                continue;
+            }
+            if (!placed) moveCursor(x, t.y);
+            for (uint8_t i = 0; i < gapLen; i++) putGlyph(gap[i]);
+            gapLen = 0; placed = true;
+            if (nb) for (uint8_t i = 0; i < nb; i++) putGlyph(gb[i]);
+            else putGlyph(' ');
+        }
+        resetAttr();
+    }
+
+    void printfText(const UI_LText& text, ...) {
+        SERIALUI_TRACE_CALL("printfText(UI_LText)");
+        char fmt[64], buffer[128];
+        getString(text.id, fmt, sizeof(fmt));
+        va_list args;
+        va_start(args, text);
+        vsnprintf(buffer, sizeof(buffer), fmt, args);
+        va_end(args);
+        drawText(text.x, text.y, buffer, text.color);
+    }
+
     // --- DEVELOPER HELPER METHODS ---
     void drawText(int16_t x, int16_t y, const char* text, UI_Color color) {
+        SERIALUI_TRACE_CALL("drawText");
+        SERIALUI_RECORD_KEYED(KEY_TEXT, x, y, strlen(text));
         setColor(color);
         moveCursor(x, y);
-        Serial.print(text);
+        putText(text);
         resetAttr();
     }
 
-    void printfText(const UI_Text& text, ...) {
-        char buffer[128]; // Be mindful of stack size
-        va_list args;
-        va_start(args, text);
-        vsnprintf(buffer, sizeof(buffer), text.content, args);
-        va_end(args);
-        drawText(text.x, text.y, buffer, text.color);
+    void printfText(const UI_Text& text, ...) {
+        SERIALUI_TRACE_CALL("printfText");
+        char buffer[128]; // Be mindful of stack size
+        va_list args;
+        va_start(args, text);
+        vsnprintf(buffer, sizeof(buffer), text.content, args);
+        va_end(args);
+        drawText(text.x, text.y, buffer, text.color);
+    }
+
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, char c, UI_Color color) {
+        SERIALUI_TRACE_CALL("fillRect");
+        SERIALUI_RECORD();
+        setColor(color);
+#if defined(SERIALUI_BINARY) && !defined(SERIALUI_VIEWPORT)
+        if (bin && x >= 0 && y >= 0 && x < 256 && y < 256 && w > 0 && h > 0 && w < 256 && h < 256 && (uint8_t)c >= 0x20) {
+            uint8_t op[6] = { UI_OP_FILL, (uint8_t)x, (uint8_t)y, (uint8_t)w, (uint8_t)h, (uint8_t)c };
+            for (uint8_t i = 0; i < 6; i++) putByte(op[i]);
+            resetAttr();
+            return;
+        }
+#endif
+        for (int i = 0; i < h; i++) {
+            moveCursor(x, y + i);
+            for (int j = 0; j < w; j++) putGlyph(c);
+        }
+        resetAttr();
+    }
+
+    // Repaints the whole interior on every call; see drawProgress() for updates.
+    void drawProgressBar(const UI_Box& b, float percent, UI_Color color) {
+        SERIALUI_TRACE_CALL("drawProgressBar");
+        SERIALUI_RECORD_KEYED(KEY_BAR, b.x + 1, b.y + 1, b.w > 2 ? b.w - 2 : 0); // the interior it repaints
+        if (percent < 0) percent = 0;
+        if (percent > 100) percent = 100;
+        int innerWidth = b.w - 2;
+        int fillWidth = (int)((percent / 100.0) * innerWidth);
+        fillRect(b.x + 1, b.y + 1, fillWidth, b.h - 2, '#', color);
+        fillRect(b.x + 1 + fillWidth, b.y + 1, innerWidth - fillWidth, b.h - 2, ' ', color);
+    }
+
+    // --- OUTPUT ---
+    // Every byte the library produces passes through here.
+    void putByte(uint8_t c) {
+#ifdef SERIALUI_TRACE
+        UI_Trace::get().bytes++;
+#endif
+#if defined(SERIALUI_FRAME_SINK) && defined(SERIALUI_BINARY)
+        if (frameSink && !bin) frameSink->put(c);
+#elif defined(SERIALUI_FRAME_SINK)
+        if (frameSink) frameSink->put(c);
+#endif
+#ifdef SERIALUI_COMPRESS
+        lzRaw++;
+        if (lzOn) { lzPut(c); return; }
+#endif
+        wireByte(c);
+    }
+
+    // Bytes as they go on the wire.
+    void wireByte(uint8_t c) {
+#ifdef SERIALUI_COMPRESS
+        lzWire++;
+#endif
+#ifdef SERIALUI_ASYNC_TX
+        if (tx) {
+#ifdef SERIALUI_PRIORITY_LANES
+            lanePut(c);
+#else
+            txBuf[txFill][txLen++] = c;
+            if (txLen == SERIALUI_TX_CHUNK) sendChunk();
+#endif
+            return;
+        }
+#endif
+        Serial.write(c);
+    }
+
+    void put(const char* s) {
+#ifdef SERIALUI_VIEWPORT
+        if (pendFg || pendBg) flushAttr(); // raw output may depend on the colour set before it
+#endif
+#ifdef SERIALUI_BINARY
+        if (bin) { while (*s) putLit((uint8_t)*s++); return; }
+#endif
+#if defined(SERIALUI_COMPRESS) || defined(SERIALUI_FRAME_SINK) || defined(SERIALUI_TRACE)
+        while (*s) putByte((uint8_t)*s++); // every byte must reach the coder, the capture and the count
+        return;
+#endif
+#ifdef SERIALUI_ASYNC_TX
+        if (tx) { while (*s) putByte((uint8_t)*s++); return; }
+#endif
+        Serial.print(s);
+    }
+
+    // Visible content from the drawing methods. With SERIALUI_VIEWPORT glyphs are
+    // clipped to the window, escape sequences embedded in content pass through,
+    // and the cursor is re-placed only when output re-enters the window.
+    void putGlyph(uint8_t c) {
+#ifdef SERIALUI_VIEWPORT
+        if (gEsc) {
+            putLit(c);
+            if (gEsc == 1) gEsc = c == '[' ? 2 : 0;
+            else if (c >= 0x40 && c <= 0x7E) gEsc = 0;
+            return;
+        }
+        if (c == 0x1b) { if (pendFg || pendBg) flushAttr(); gEsc = 1; putLit(c); return; } // keep SGR order
+        if ((c & 0xC0) == 0x80) { if (curValid) putByte(c); return; } // UTF-8 tail of the previous glyph
+        if (!visible(vcx, vcy)) { curValid = false; vcx++; return; }
+        if (pendFg || pendBg) flushAttr();
+        if (!curValid) { cursorTo(vcx - vpX, vcy - vpY); curValid = true; }
+        vcx++;
+#endif
+        putLit(c);
+    }
+
+    // A content byte; in binary mode control bytes are escaped so they cannot read as opcodes.
+    void putLit(uint8_t c) {
+#ifdef SERIALUI_BINARY
+        if (bin && c < 0x20) putByte(UI_OP_LIT);
+#endif
+        putByte(c);
+    }
+
+    void putText(const char* s) {
+#ifdef SERIALUI_VIEWPORT
+        while (*s) putGlyph((uint8_t)*s++);
+#else
+        put(s);
+#endif
+    }
+
+    void putNum(int n) {
+        char buf[8]; int i = sizeof(buf) - 1;
+        bool neg = n < 0;
+        unsigned int v = neg ? 0u - (unsigned int)n : (unsigned int)n;
+        buf[i] = 0;
+        do { buf[--i] = (char)('0' + v % 10); v /= 10; } while (v && i > 1);
+        if (neg) buf[--i] = '-';
+        put(buf + i);
+    }
+
+private:
+    // Terminal-position cursor move and SGR attribute, in the current protocol.
+    void cursorTo(int x, int y) {
+#ifdef SERIALUI_BINARY
+        if (bin) {
+            if (x >= 0 && y >= 0 && x < 256 && y < 256) { putByte(UI_OP_MOVE); putByte(x); putByte(y); }
+            else { putByte(UI_OP_MOVE16); putByte(x & 0xFF); putByte((x >> 8) & 0xFF); putByte(y & 0xFF); putByte((y >> 8) & 0xFF); }
+            return;
+        }
+#endif
+        put("\x1b["); putNum(y + 1); put(";"); putNum(x + 1); put("H");
+    }
+    void sgr(uint8_t code) {
+#ifdef SERIALUI_BINARY
+        if (bin) { putByte(UI_OP_STYLE); putByte(code); return; }
+#endif
+        if (!code) { put("\x1b[0m"); return; }
+        put("\x1b["); putNum(code); put("m");
+    }
+    // Where a drawing call ends: nothing stays in the compressor and capture
+    // readers get a whole frame.
+    void settle() {
+        lzFlush();
+#ifdef SERIALUI_FRAME_SINK
+        if (frameSink) frameSink->publish();
+#endif
+    }
+#ifdef SERIALUI_FRAME_SINK
+    UI_FrameSink* frameSink = nullptr;
+#endif
+
+#ifdef SERIALUI_COMPRESS
+    // Greedy streaming match: up to three bytes wait for a match to start, and a
+    // match grows while the input keeps following its source. A window match may
+    // overlap its own output (period lzD), which turns runs into one token.
+    // Nothing is held across settle().
+    void lzPut(uint8_t c) {
+        if (lzLen) {
+            if (lzLen < (lzDict ? 130 : 128) && lzNext() == c) {
+                lzLen++;
+                if (!lzDict && ++lzK == lzD) lzK = 0;
+                return;
+            }
+            lzEmitMatch();
+        }
+        lzHold[lzHeld++] = c;
+        if (lzHeld < 3) return;
+        if (lzFind()) { lzLen = 3; lzHeld = 0; lzK = lzD == 3 ? 0 : 3; return; }
+        lzLiteral(lzHold[0]);
+        lzHold[0] = lzHold[1]; lzHold[1] = lzHold[2]; lzHeld = 2;
+    }
+    void lzFlush() {
+        if (!lzOn) return;
+        if (lzLen) lzEmitMatch();
+        for (uint8_t i = 0; i < lzHeld; i++) lzLiteral(lzHold[i]);
+        lzHeld = 0;
+    }
+    int16_t lzNext() const {
+        if (!lzDict) return lzWin[(lzSrc + lzK) & (SERIALUI_LZ_WINDOW - 1)];
+        const UI_LzDict* d = UI_LzDict::active();
+        return lzSrc + lzLen < d->size ? pgm_read_byte(d->data + lzSrc + lzLen) : -1;
+    }
+    bool lzFind() {
+        uint8_t h = uiLzHash(lzHold[0], lzHold[1], lzHold[2]);
+        uint8_t p = lzHead[h & (SERIALUI_LZ_HASH - 1)];
+        uint16_t d = (lzPos - p) & (SERIALUI_LZ_WINDOW - 1);
+        if (!d) d = SERIALUI_LZ_WINDOW;
+        // heads point at complete trigrams, so d >= 3 and the candidate lies in the past
+        if (d >= 3 && d <= lzFill && lzWin[p] == lzHold[0] && lzWin[(p + 1) & (SERIALUI_LZ_WINDOW - 1)] == lzHold[1]
+            && lzWin[(p + 2) & (SERIALUI_LZ_WINDOW - 1)] == lzHold[2]) {
+            lzDict = false; lzSrc = p; lzD = d;
+            return true;
+        }
+        const UI_LzDict* t = UI_LzDict::active();
+        if (!t) return false;
+        uint16_t off = pgm_read_word(t->heads + h);
+        if (off == 0xFFFF || off + 3 > t->size) return false;
+        for (uint8_t i = 0; i < 3; i++)
+            if (pgm_read_byte(t->data + off + i) != lzHold[i]) return false;
+        lzDict = true; lzSrc = off; lzD = 0;
+        return true;
+    }
+    void lzEmitMatch() {
+        uint8_t n = lzLen;
+        lzLen = 0;
+        if (n >= (lzDict ? 5 : 4)) { // shorter ones cost no less than their literals
+            if (lzDict) { wireByte(0xFF); wireByte(n + 125); wireByte(lzSrc & 0xFF); wireByte(lzSrc >> 8); }
+            else { wireByte(0xFF); wireByte(n - 1); wireByte(lzD - 1); }
+            for (uint8_t i = 0; i < n; i++) lzAppend(lzCopy(i));
+        } else {
+            for (uint8_t i = 0; i < n; i++) lzLiteral(lzCopy(i));
+        }
+    }
+    // Byte i of the match, read as the decoder does: appending one byte ahead
+    // of the source lets an overlapping copy see its own output.
+    uint8_t lzCopy(uint8_t i) const {
+        if (lzDict) return pgm_read_byte(UI_LzDict::active()->data + lzSrc + i);
+        return lzWin[(lzSrc + i) & (SERIALUI_LZ_WINDOW - 1)];
+    }
+    void lzLiteral(uint8_t c) {
+        wireByte(c);
+        if (c == 0xFF) wireByte(0x00);
+        lzAppend(c);
+    }
+    void lzAppend(uint8_t c) {
+        lzWin[lzPos] = c;
+        lzPos = (lzPos + 1) & (SERIALUI_LZ_WINDOW - 1);
+        if (lzFill < SERIALUI_LZ_WINDOW) lzFill++;
+        if (lzFill >= 3) {
+            uint8_t p = (lzPos - 3) & (SERIALUI_LZ_WINDOW - 1);
+            lzHead[uiLzHash(lzWin[p], lzWin[(p + 1) & (SERIALUI_LZ_WINDOW - 1)], c) & (SERIALUI_LZ_HASH - 1)] = p;
+        }
+    }
+
+    uint8_t lzWin[SERIALUI_LZ_WINDOW];
+    uint8_t lzHead[SERIALUI_LZ_HASH];
+    uint8_t lzHold[3];
+    uint8_t lzHeld = 0, lzLen = 0;
+    uint16_t lzPos = 0, lzFill = 0, lzSrc = 0, lzD = 0, lzK = 0;
+    bool lzDict = false, lzOn = false;
+    uint32_t lzRaw = 0, lzWire = 0;
+#else
+    void lzFlush() {}
+#endif
+
+#ifdef SERIALUI_BINARY
+    bool blit(const void* e) {
+        const UI_ElementTable* t = UI_ElementTable::active();
+        int16_t id = bin && t ? t->find(e) : -1;
+        if (id < 0) return false;
+        putByte(UI_OP_BLIT); putByte(id & 0xFF); putByte(id >> 8);
+        return true;
+    }
+    bool bin = false;
+#endif
+
+    // Segment bits: a b c d e f g dp = 0..7. Each lights one cell of the 4x3 digit.
+    static uint8_t segMask(char c) {
+        static const char chars[] PROGMEM = "0123456789-_ AbCdEFHLnoPrU";
+        static const uint8_t masks[] PROGMEM = {
+            0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F, 0x40, 0x08, 0x00,
+            0x77, 0x7C, 0x39, 0x5E, 0x79, 0x71, 0x76, 0x38, 0x54, 0x5C, 0x73, 0x50, 0x3E };
+        if (c >= 'a' && c <= 'z' && c != 'b' && c != 'd' && c != 'n' && c != 'o' && c != 'r') c -= 32;
+        for (uint8_t i = 0; i < sizeof(masks); i++) if ((char)pgm_read_byte(chars + i) == c) return pgm_read_byte(masks + i);
+        return 0x40;
+    }
+#ifdef SERIALUI_SERVICE
+    enum : uint8_t { PEND_BOX, PEND_LINE, PEND_FREEHAND, PEND_TEXT, PEND_LTEXT, PEND_BIGNUM, PEND_CANVAS, PEND_FN };
+    struct Pending {
+        union { const void* e; RedrawFn fn; };
+        int16_t x, y;
+        uint8_t kind;
+        uint8_t decimals; long value; // PEND_BIGNUM
+    };
+
+    static Pending item(const void* e, uint8_t kind, int16_t x, int16_t y) {
+        Pending p; p.e = e; p.kind = kind; p.x = x; p.y = y; p.decimals = 0; p.value = 0;
+        return p;
+    }
+    bool pend(const Pending& p) {
+        for (uint8_t i = 0; i < nPending; i++) {
+            Pending& q = pendq[i];
+            if (q.kind == p.kind && (p.kind == PEND_FN ? q.fn == p.fn : q.e == p.e)) {
+                q.value = p.value; q.decimals = p.decimals; // latest value wins
+                return true;
+            }
+        }
+        if (nPending == SERIALUI_PENDING) { pendDraw(p); return false; }
+        pendq[nPending++] = p;
+        return true;
+    }
+    // Paint order: frames under lines/art under text and values, then row-major.
+    static uint8_t pendLayer(uint8_t kind) { return kind == PEND_BOX ? 0 : kind <= PEND_FREEHAND ? 1 : 2; }
+    static bool pendBefore(const Pending& a, const Pending& b) {
+        uint8_t la = pendLayer(a.kind), lb = pendLayer(b.kind);
+        if (la != lb) return la < lb;
+        return a.y != b.y ? a.y < b.y : a.x < b.x;
+    }
+    void pendDraw(const Pending& p) {
+        switch (p.kind) {
+            case PEND_BOX: draw(*(const UI_Box*)p.e); break;
+            case PEND_LINE: draw(*(const UI_Line*)p.e); break;
+            case PEND_FREEHAND: draw(*(const UI_Freehand*)p.e); break;
+            case PEND_TEXT: draw(*(const UI_Text*)p.e); break;
+            case PEND_LTEXT: draw(*(const UI_LText*)p.e); break;
+            case PEND_BIGNUM: drawBigNumber(*(const UI_BigNum*)p.e, p.value, p.decimals); break;
+            case PEND_CANVAS: drawCanvas(*(UI_CanvasBase*)const_cast<void*>(p.e)); break;
+            case PEND_FN: p.fn(*this); break;
+        }
+    }
+#endif
+
+    void fillBar(const UI_Box& b, uint16_t value, uint16_t full, UI_Color color, UI_BarState& st, bool vertical, bool blocks) {
+        int16_t w = b.w - 2, h = b.h - 2, c0, c1;
+        if (w <= 0 || h <= 0 || !full) return;
+        int16_t cells = vertical ? h : w;
+        uint16_t n = barLevel(st, value, full, cells, blocks);
+        if (!barSpan(st, n, color, cells, c0, c1)) return;
+        SERIALUI_RECORD();
+        setColor(color);
+        if (vertical) {
+            for (int16_t c = c0; c <= c1; c++) {
+                moveCursor(b.x + 1, b.y + b.h - 2 - c);
+                for (int16_t i = 0; i < w; i++) putLevel(n, c, true, blocks);
+            }
+        } else {
+            for (int16_t r = 0; r < h; r++) {
+                moveCursor(b.x + 1 + c0, b.y + 1 + r);
+                for (int16_t c = c0; c <= c1; c++) putLevel(n, c, false, blocks);
+            }
+        }
+        resetAttr();
+    }
+    static uint16_t quantize(uint16_t value, uint16_t full, int16_t cells, bool blocks) {
+        uint16_t n = (uint16_t)((uint32_t)value * (uint16_t)cells * 8 / full);
+        return blocks ? n : (uint16_t)(n & ~7u);
+    }
+    // Fill for value, or the shown one while value is within the hysteresis band of it.
+    static uint16_t barLevel(const UI_BarState& st, uint16_t value, uint16_t full, int16_t cells, bool blocks) {
+        if (value > full) value = full;
+        uint16_t n = quantize(value, full, cells, blocks);
+        if (!st.band || st.shown == 0xFFFF || st.shown == n || !value || value == full) return n; // ends are exact
+        uint16_t lo = quantize(value > st.band ? value - st.band : 0, full, cells, blocks);
+        uint16_t hi = quantize(full - value > st.band ? value + st.band : full, full, cells, blocks);
+        return (st.shown >= lo && st.shown <= hi) ? st.shown : n;
+    }
+    // Cells [c0, c1] whose content differs between the shown fill and n; false if none.
+    static bool barSpan(UI_BarState& st, uint16_t n, UI_Color color, int16_t cells, int16_t& c0, int16_t& c1) {
+        uint16_t o = st.shown;
+        bool recolor = st.color != color;
+        if (o == n && !recolor) return false;
+        st.shown = n; st.color = color;
+        if (o == 0xFFFF || recolor) { c0 = 0; c1 = cells - 1; return true; }
+        uint16_t lo = o < n ? o : n, hi = o < n ? n : o;
+        c0 = lo / 8; c1 = (hi - 1) / 8;
+        if (c1 >= cells) c1 = cells - 1;
+        return true;
+    }
+    // Cell `cell` of a fill of n eighths: blank, full, or a partial block.
+    void putLevel(uint16_t n, int16_t cell, bool vertical, bool blocks) {
+        int16_t k = (int16_t)n - cell * 8;
+        if (k <= 0) { putGlyph(' '); return; }
+        if (!blocks) { putGlyph('#'); return; }
+        if (k > 8) k = 8;
+        putGlyph(0xE2); putGlyph(0x96); putGlyph((uint8_t)(vertical ? 0x80 + k : 0x90 - k)); // U+2581.., U+258F..2588
+    }
+
+    void putDots(uint8_t p) {
+        if (capFlags & UI_CAP_UTF8) { putGlyph(0xE2); putGlyph(0xA0 | (p >> 6)); putGlyph(0x80 | (p & 0x3F)); return; } // U+2800 + p
+        bool top = p & 0x1B, bottom = p & 0xE4;
+        putGlyph(top ? (bottom ? ':' : '\'') : (bottom ? '.' : ' '));
+    }
+
+    // Cell (col, row) of a digit: the segment bit it shows (0 = none) and its character.
+    static uint8_t segBit(uint8_t row, uint8_t col) {
+        static const uint8_t bits[12] PROGMEM = { 0, 0x01, 0, 0, 0x20, 0x40, 0x02, 0, 0x10, 0x08, 0x04, 0x80 };
+        return pgm_read_byte(bits + row * 4 + col);
+    }
+    static char segGlyph(uint8_t col) { return col == 1 ? '_' : col == 3 ? '.' : '|'; }
+
+    const UI_StringTable* table(uint8_t l) const { return strTables ? strTables + l : nullptr; }
+    bool plainString(uint8_t l, uint16_t id) const {
+        UI_StrReader r(table(l), id);
+        for (int c; (c = r.next()) >= 0; ) if (c == 0x1b || c == '\n') return false;
+        return true;
+    }
+
+    const UI_StringTable* strTables = nullptr;
+    uint8_t lang = 0;
+    uint8_t capFlags = SERIALUI_CAPS;
+
+#ifdef SERIALUI_VIEWPORT
+    bool visible(int x, int y) const {
+        int sx = x - vpX, sy = y - vpY;
+        return sx >= clipX0 && sx < clipX1 && sy >= clipY0 && sy < clipY1;
+    }
+    void clipAll() { clipX0 = 0; clipY0 = 0; clipX1 = vpW; clipY1 = vpH; }
+    // SU/SD confined to the window's rows; resetting the region homes the cursor.
+    void scrollRows(int16_t n) {
+        put("\x1b[1;"); putNum(vpH); put("r\x1b["); putNum(abs(n)); put(n > 0 ? "S" : "T"); put("\x1b[r");
+    }
+    void flushAttr() {
+        uint8_t fg = pendFg, bg = pendBg;
+        pendFg = pendBg = 0; attrSent = true;
+        if (fg) sgr(fg);
+        if (bg) sgr(bg);
+    }
+
+    int16_t vpX = 0, vpY = 0, vpW = SERIALUI_VIEW_W, vpH = SERIALUI_VIEW_H;
+    int16_t clipX0 = 0, clipY0 = 0, clipX1 = SERIALUI_VIEW_W, clipY1 = SERIALUI_VIEW_H; // window-relative, exclusive
+    int vcx = 0, vcy = 0;   // canvas position of the next glyph
+    bool curValid = false;  // terminal cursor is at (vcx, vcy)
+    uint8_t gEsc = 0;       // inside an escape sequence embedded in content
+    uint8_t pendFg = 0, pendBg = 0; // SGR codes set but not yet sent
+    bool attrSent = false;  // an SGR went out since the last reset
+#endif
+
+#ifdef SERIALUI_ASYNC_TX
+    static void txDone(void* ctx) { ((SerialUI*)ctx)->txInFlight = false; }
+
+    void txWait() {
+#ifdef ARDUINO
+        yield();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    // Waits until the backend has finished the chunk in flight.
+    void txDrain() {
+        if (!txInFlight && !tx->busy()) return;
+#ifdef SERIALUI_TRACE
+        uint32_t at = micros();
+#endif
+        while (txInFlight || tx->busy()) txWait();
+#ifdef SERIALUI_TRACE
+        UI_Trace::get().blocked(at, micros() - at);
+#endif
+    }
+
+    // Waits for the previous chunk, then ships the composed one and flips buffers.
+    void sendChunk() {
+        txDrain();
+        uint8_t* buf = txBuf[txFill];
+        uint16_t len = txLen;
+        txFill ^= 1; txLen = 0;
+        txInFlight = true;
+        if (!tx->startTransfer(buf, len)) {
+            txInFlight = false;
+            Serial.write(buf, len); // backend refused: fall back to blocking output
+        }
+    }
+
+    UI_TxBackend* tx = nullptr;
+    uint8_t txBuf[2][SERIALUI_TX_CHUNK];
+    uint16_t txLen = 0;
+    uint8_t txFill = 0;
+    UI_TxFlag txInFlight{false};
+#endif
+
+#ifdef SERIALUI_PRIORITY_LANES
+    // Lane rings hold records: a 2-byte header (12-bit length, 4 flag bits)
+    // followed by the bytes. Only committed records are visible to fillChunk().
+    enum : uint8_t { REC_CONT = 1, REC_DEAD = 2 };
+
+    struct Lane {
+        uint8_t* data; uint16_t size;
+        uint16_t head, tail, used, ready; // ready = committed bytes at the tail
+        uint16_t hdr, body; bool open;    // record being written
+        void init(uint8_t* mem, uint16_t n) { data = mem; size = n; head = tail = used = ready = hdr = body = 0; open = false; }
+        uint8_t pop() { uint8_t v = data[tail]; tail = (tail + 1) % size; used--; ready--; return v; }
+    };
+
+    struct RecordScope {
+        SerialUI& ui;
+        explicit RecordScope(SerialUI& u) : ui(u) { if (ui.recDepth++ == 0) ui.recKeyed = false; }
+        RecordScope(SerialUI& u, uint8_t kind, int16_t x, int16_t y, size_t w) : ui(u) { if (ui.recDepth++ == 0) ui.recordKey(kind, x, y, w); }
+        ~RecordScope() { if (--ui.recDepth == 0) ui.recordEnd(); }
+    };
+
+    // Latest-value-wins: a committed keyed record marks the previous unsent
+    // record of the same kind and origin dead if it covers at least the same width.
+    enum : uint8_t { KEY_TEXT, KEY_BAR };
+    struct KeySlot { uint16_t key, hdr; uint8_t kind, lane, w; bool used; };
+
+    void recordKey(uint8_t kind, int16_t x, int16_t y, size_t w) {
+        laneCommit(lanes[(uint8_t)prio], 0); // keep earlier loose output out of the keyed record
+        recKeyed = SERIALUI_COALESCE_SLOTS > 0 && x >= 0 && x < 256 && y >= 0 && y < 256;
+        recKey = (uint16_t)((y << 8) | x); recKind = kind;
+        recW = (uint8_t)(w > 255 ? 255 : w);
+    }
+
+    void coalesce(const Lane& L, uint8_t lane) {
+        KeySlot* slot = nullptr;
+        for (uint8_t i = 0; i < SERIALUI_COALESCE_SLOTS; i++) {
+            KeySlot& k = keySlots[i];
+            if (k.used && k.key == recKey && k.kind == recKind) { slot = &k; break; }
+            if (!k.used && !slot) slot = &k;
+        }
+        if (!slot) return; // table full: sent as-is
+        if (slot->used && recW >= slot->w) {
+            Lane& old = lanes[slot->lane];
+            old.data[(slot->hdr + 1) % old.size] |= (uint8_t)(REC_DEAD << 4);
+            coalesced++;
+        }
+        slot->key = recKey; slot->kind = recKind; slot->hdr = L.hdr; slot->lane = lane; slot->w = recW; slot->used = true;
+    }
+
+    // Pops a record header from a lane; its key slot is released once it is on its way.
+    uint16_t popHeader(uint8_t lane) {
+        Lane& L = lanes[lane];
+        for (uint8_t i = 0; i < SERIALUI_COALESCE_SLOTS; i++)
+            if (keySlots[i].used && keySlots[i].lane == lane && keySlots[i].hdr == L.tail) keySlots[i].used = false;
+        uint16_t h = L.pop(); h |= (uint16_t)L.pop() << 8;
+        return h;
+    }
+
+    // Squeezes dead records out of a lane without touching the wire. The record
+    // the transmitter is part-way through stays where it is.
+    bool laneReclaim(uint8_t lane) {
+        Lane& L = lanes[lane];
+        uint16_t skip = 0;
+        if (cur == lane) skip = curRemain;
+        else if (saved && resumeLane == lane) skip = resumeRemain;
+        uint16_t rd = (L.tail + skip) % L.size, wr = rd, left = L.ready - skip, freed = 0;
+        while (left) {
+            uint16_t h = L.data[rd] | ((uint16_t)L.data[(rd + 1) % L.size] << 8);
+            uint16_t n = (h & 0x0FFF) + 2;
+            if ((h >> 12) & REC_DEAD) {
+                freed += n;
+            } else if (freed) {
+                for (uint8_t i = 0; i < SERIALUI_COALESCE_SLOTS; i++)
+                    if (keySlots[i].used && keySlots[i].lane == lane && keySlots[i].hdr == rd) keySlots[i].hdr = wr;
+                for (uint16_t i = 0; i < n; i++) L.data[(wr + i) % L.size] = L.data[(rd + i) % L.size];
+            }
+            if (!((h >> 12) & REC_DEAD)) wr = (wr + n) % L.size;
+            rd = (rd + n) % L.size; left -= n;
+        }
+        if (!freed) return false;
+        if (L.open) { // the record being written moves down too
+            uint16_t n = L.body + 2;
+            for (uint16_t i = 0; i < n; i++) L.data[(wr + i) % L.size] = L.data[(rd + i) % L.size];
+            L.hdr = wr; wr = (wr + n) % L.size;
+        }
+        L.head = wr; L.used -= freed; L.ready -= freed;
+        return true;
+    }
+
+    void recordEnd() {
+        if (!tx) return;
+        laneCommit(lanes[(uint8_t)prio], 0);
+        fillChunk();
+        if (txLen && !txInFlight && !tx->busy()) sendChunk();
+    }
+
+    void laneOpen(Lane& L) {
+        while (L.size - L.used < 3) laneMakeRoom(L); // header plus one byte
+        L.hdr = L.head; L.head = (L.head + 2) % L.size; L.used += 2;
+        L.body = 0; L.open = true;
+    }
+
+    void laneCommit(Lane& L, uint8_t flags) {
+        if (!L.open) return;
+        L.open = false;
+        if (!L.body) { L.head = L.hdr; L.used -= 2; return; }
+        uint16_t h = (uint16_t)(L.body | (flags << 12));
+        L.data[L.hdr] = (uint8_t)h; L.data[(L.hdr + 1) % L.size] = (uint8_t)(h >> 8);
+        L.ready += L.body + 2;
+        if (flags & REC_CONT) recKeyed = false;
+        else if (recKeyed) { coalesce(L, (uint8_t)(&L - lanes)); recKeyed = false; }
+    }
+
+    void lanePut(uint8_t c) {
+        Lane& L = lanes[(uint8_t)prio];
+        if (!L.open) laneOpen(L);
+        if (L.used == L.size && laneReclaim((uint8_t)prio)) {}
+        else if (L.used == L.size || L.body == 0x0FFF) { laneCommit(L, REC_CONT); laneOpen(L); }
+        L.data[L.head] = c; L.head = (L.head + 1) % L.size;
+        L.used++; L.body++;
+    }
+
+    void laneMakeRoom(Lane& L) {
+        if (laneReclaim((uint8_t)(&L - lanes))) return;
+        fillChunk();
+        if (txLen) sendChunk(); else txDrain();
+    }
+
+    void txRaw(uint8_t c) { txBuf[txFill][txLen++] = c; }
+
+    // Tracks whether the byte stream is between escape sequences / UTF-8 characters.
+    void escTrack(uint8_t c) {
+        if (escState == 1) escState = (c == '[') ? 2 : 0;
+        else if (escState == 2) { if (c >= 0x40 && c <= 0x7E) escState = 0; }
+        else if (c == 0x1b) escState = 1;
+        else if (c >= 0xC0) utf8Left = c >= 0xF0 ? 3 : (c >= 0xE0 ? 2 : 1);
+        else if (c >= 0x80) { if (utf8Left) utf8Left--; }
+        else utf8Left = 0;
+    }
+
+    // Moves committed bytes into the compose buffer, highest lane first. Lanes
+    // change at record boundaries; CRITICAL may also cut into a record between
+    // sequences, bracketed by DECSC/DECRC so the interrupted record's cursor
+    // and attributes come back. The critical record starts from reset attributes.
+    void fillChunk() {
+        while (txLen < SERIALUI_TX_CHUNK) {
+            Lane* L = &lanes[cur];
+            bool midRecord = curRemain || curCont;
+            if (midRecord && !saved && cur != 0 && lanes[0].ready && !escState && !utf8Left) {
+                if (SERIALUI_TX_CHUNK - txLen < 6) return;
+                txRaw(0x1b); txRaw('7'); txRaw(0x1b); txRaw('['); txRaw('0'); txRaw('m');
+                saved = true; resumeLane = cur; resumeRemain = curRemain; resumeCont = curCont;
+                cur = 0; curRemain = 0; curCont = false;
+                continue;
+            }
+            if (!curRemain) {
+                uint8_t next;
+                if (curCont) {
+                    if (!L->ready) return; // continuation not committed yet
+                    next = cur;
+                } else if (saved) {
+                    if (!lanes[0].ready) {
+                        if (SERIALUI_TX_CHUNK - txLen < 2) return;
+                        txRaw(0x1b); txRaw('8');
+                        saved = false; cur = resumeLane; curRemain = resumeRemain; curCont = resumeCont;
+                        continue;
+                    }
+                    next = 0;
+                } else {
+                    next = 0;
+                    while (next < 3 && !lanes[next].ready) next++;
+                    if (next == 3) return;
+                }
+                cur = next; L = &lanes[cur];
+                uint16_t h = popHeader(cur);
+                curRemain = h & 0x0FFF; curCont = (h >> 12) & REC_CONT;
+                if ((h >> 12) & REC_DEAD) { while (curRemain) { L->pop(); curRemain--; } }
+                continue;
+            }
+            uint8_t c = L->pop(); curRemain--;
+            txRaw(c); escTrack(c);
+        }
+    }
+
+    uint8_t laneMem[SERIALUI_LANE_CRITICAL + SERIALUI_LANE_NORMAL + SERIALUI_LANE_BACKGROUND];
+    Lane lanes[3];
+    uint8_t recDepth = 0;
+    uint8_t cur = 0, resumeLane = 0;
+    uint16_t curRemain = 0, resumeRemain = 0;
+    bool curCont = false, resumeCont = false, saved = false;
+    uint8_t escState = 0, utf8Left = 0;
+    KeySlot keySlots[SERIALUI_COALESCE_SLOTS > 0 ? SERIALUI_COALESCE_SLOTS : 1] = {};
+    bool recKeyed = false;
+    uint16_t recKey = 0;
+    uint8_t recW = 0, recKind = 0;
+    uint32_t coalesced = 0;
+#endif
+#ifdef SERIALUI_SERVICE
+    Pending pendq[SERIALUI_PENDING];
+    uint8_t nPending = 0;
+#endif
+    UI_Priority prio = UI_Priority::NORMAL;
+};
+
+#if defined(SERIALUI_BINARY) && !defined(ARDUINO)
+// Host side of the binary protocol: replays a device's byte stream on a SerialUI
+// in ANSI mode, which writes standard escape sequences to stdout. BLITs are drawn
+// from this build's UI_ElementTable, so link the same ui_layout.cpp as the device.
+class UI_BinaryDecoder {
+public:
+    explicit UI_BinaryDecoder(SerialUI& out) : ui(out) {}
+    void feed(const uint8_t* buf, size_t n) { while (n--) feed(*buf++); }
+    void feed(uint8_t c) {
+        if (need) {
+            arg[got++] = c;
+            if (got == need) { need = 0; run(); }
+            return;
+        }
+        switch (c) {
+            case UI_OP_MOVE: expect(c, 2); break;
+            case UI_OP_MOVE16: expect(c, 4); break;
+            case UI_OP_STYLE: expect(c, 1); break;
+            case UI_OP_FILL: expect(c, 5); break;
+            case UI_OP_BLIT: expect(c, 2); break;
+            case UI_OP_HELLO: expect(c, 3); break;
+            case UI_OP_LIT: expect(c, 1); break;
+            default: if (c >= 0x20) ui.putByte(c); // unknown control bytes are dropped
+        }
+    }
+    // The last HELLO named another protocol version or element count; BLITs are ignored.
+    bool layoutMismatch() const { return mismatch; }
+
+private:
+    void expect(uint8_t o, uint8_t n) { op = o; need = n; got = 0; }
+    void run() {
+        switch (op) {
+            case UI_OP_MOVE: ui.moveCursor(arg[0], arg[1]); break;
+            case UI_OP_MOVE16: ui.moveCursor((int16_t)(arg[0] | arg[1] << 8), (int16_t)(arg[2] | arg[3] << 8)); break;
+            case UI_OP_STYLE: if (arg[0]) ui.setColor((UI_Color)arg[0]); else ui.resetAttr(); break;
+            case UI_OP_FILL:
+                for (uint8_t r = 0; r < arg[3]; r++) {
+                    ui.moveCursor(arg[0], arg[1] + r);
+                    for (uint8_t i = 0; i < arg[2]; i++) ui.putByte(arg[4]);
+                }
+                break;
+            case UI_OP_BLIT: blit(arg[0] | arg[1] << 8); break;
+            case UI_OP_HELLO: {
+                const UI_ElementTable* t = UI_ElementTable::active();
+                mismatch = arg[0] != UI_PROTOCOL_VERSION || (t ? t->count : 0) != (arg[1] | arg[2] << 8);
+                break;
+            }
+            case UI_OP_LIT: ui.putByte(arg[0]); break;
+        }
+    }
+    void blit(uint16_t id) {
+        const UI_ElementTable* t = UI_ElementTable::active();
+        uint8_t kind = 0;
+        const void* e = t && !mismatch ? t->get(id, kind) : nullptr;
+        if (!e) return;
+        switch (kind) {
+            case UI_ElementTable::BOX: ui.draw(*(const UI_Box*)e); break;
+            case UI_ElementTable::TEXT: ui.draw(*(const UI_Text*)e); break;
+            case UI_ElementTable::LINE: ui.draw(*(const UI_Line*)e); break;
+            case UI_ElementTable::FREEHAND: ui.draw(*(const UI_Freehand*)e); break;
+        }
+    }
+
+    SerialUI& ui;
+    uint8_t op = 0, need = 0, got = 0;
+    uint8_t arg[5];
+    bool mismatch = false;
+};
+#endif
+
+#if defined(SERIALUI_COMPRESS) && !defined(ARDUINO)
+// Host side of stream compression: undoes the coder and hands the original bytes
+// to a sink. Dictionary copies resolve against this build's UI_LzDict, so link
+// the same ui_layout.cpp as the device. Until the first reset token the input
+// passes through unchanged.
+class UI_LzDecoder {
+public:
+    typedef void (*Sink)(uint8_t c, void* ctx);
+    UI_LzDecoder(Sink sink, void* ctx) : sink(sink), ctx(ctx) {}
+    void feed(const uint8_t* buf, size_t n) { while (n--) feed(*buf++); }
+    void feed(uint8_t c) {
+        if (need) {
+            arg[got++] = c;
+            if (got == need) { need = 0; run(); }
+            return;
+        }
+        if (esc) {
+            esc = false;
+            if (c == 0x01) { expect(c, 3); return; }
+            if (!on) { sink(0xFF, ctx); feed(c); return; }
+            if (c == 0x00) emit(0xFF);
+            else expect(c, c < 128 ? 1 : 2);
+            return;
+        }
+        if (c == 0xFF) esc = true;
+        else if (on) emit(c);
+        else sink(c, ctx);
+    }
+    // The last reset named a dictionary of another size; its copies are garbage.
+    bool dictionaryMismatch() const { return mismatch; }
+
+private:
+    void expect(uint8_t t, uint8_t n) { tok = t; need = n; got = 0; }
+    void run() {
+        if (tok == 0x01) {
+            const UI_LzDict* d = UI_LzDict::active();
+            on = arg[0] != 0;
+            mask = (uint8_t)((1u << (arg[0] > 8 ? 8 : arg[0])) - 1);
+            pos = 0;
+            mismatch = on && (d ? d->size : 0) != (arg[1] | arg[2] << 8);
+        } else if (tok < 128) {
+            for (uint8_t i = 0, n = tok + 1; i < n; i++) emit(win[(uint8_t)(pos - arg[0] - 1) & mask]);
+        } else {
+            const UI_LzDict* d = UI_LzDict::active();
+            uint16_t off = arg[0] | arg[1] << 8, n = tok - 125;
+            if (!d || off + n > d->size) { mismatch = true; return; }
+            for (uint16_t i = 0; i < n; i++) emit(pgm_read_byte(d->data + off + i));
+        }
+    }
+    void emit(uint8_t c) { win[pos] = c; pos = (pos + 1) & mask; sink(c, ctx); }
+
+    Sink sink;
+    void* ctx;
+    uint8_t win[256];
+    uint8_t pos = 0, mask = 0xFF, tok = 0, need = 0, got = 0;
+    uint8_t arg[3];
+    bool esc = false, on = false, mismatch = false;
+};
+#endif
+
+#if defined(SERIALUI_TRACE) && !defined(ARDUINO)
+// Writes trace events as Chrome trace-event JSON for chrome://tracing or
+// ui.perfetto.dev. Tracks: traced calls (nested), frames marked with frame(),
+// waits for the TX backend and, with watch(), each buffer's time on the
+// simulated wire. Counters follow the bytes produced and the bytes sent.
+class UI_ChromeTrace : public UI_Trace::Observer {
+public:
+    explicit UI_ChromeTrace(const char* path) : f(fopen(path, "w")) {
+        if (!f) return;
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+        const char* tracks[] = { "calls", "frames", "blocked on TX", "wire" };
+        for (int i = 0; i < 4; i++) event("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", i + 1, tracks[i]);
+        UI_Trace::get().setObserver(this);
+    }
+    ~UI_ChromeTrace() { close(); }
+    UI_ChromeTrace(const UI_ChromeTrace&) = delete;
+    UI_ChromeTrace& operator=(const UI_ChromeTrace&) = delete;
+
+    bool ok() const { return f != nullptr; }
+#ifdef SERIALUI_ASYNC_TX
+    // Adds the backend's wire slots; call close() before the backend goes away.
+    void watch(HostThreadTx& tx) { link = &tx; tx.setWireHook(&UI_ChromeTrace::wire, this); }
+#endif
+    // One frame of the application, e.g. a loop() pass: micros() at its start and its length.
+    void frame(const char* label, uint32_t at, uint32_t us) {
+        char esc[128];
+        size_t k = 0;
+        for (; *label && k < sizeof(esc) - 7; label++) {
+            uint8_t c = (uint8_t)*label;
+            if (c == '"' || c == '\\') { esc[k++] = '\\'; esc[k++] = (char)c; }
+            else if (c < 0x20) k += snprintf(esc + k, 7, "\\u%04x", c);
+            else esc[k++] = (char)c;
+        }
+        esc[k] = 0;
+        label = esc;
+        event("{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":1,\"tid\":2}", label,
+              (unsigned long)at, (unsigned long)us);
+    }
+    // Detaches from the trace (and backend) and completes the JSON file.
+    void close() {
+        UI_Trace::get().setObserver(nullptr);
+#ifdef SERIALUI_ASYNC_TX
+        if (link) link->setWireHook(nullptr, nullptr);
+        link = nullptr;
+#endif
+        std::lock_guard<std::mutex> lk(m);
+        if (f) { fputs("\n]}\n", f); fclose(f); f = nullptr; }
+    }
+
+    void call(const UI_Trace::Event& e) override {
+        event("{\"name\":\"%s\",\"cat\":\"call\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":1,\"tid\":1,\"args\":{\"bytes\":%u}}",
+              e.name, (unsigned long)e.at, (unsigned long)e.us, (unsigned)e.bytes);
+        event("{\"name\":\"bytes produced\",\"ph\":\"C\",\"ts\":%lu,\"pid\":1,\"args\":{\"bytes\":%lu}}",
+              (unsigned long)(e.at + e.us), (unsigned long)UI_Trace::get().bytes);
     }
-
-    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, char c, UI_Color color) {
-        setColor(color);
-        for (int i = 0; i < h; i++) {
-            moveCursor(x, y + i);
-            for (int j = 0; j < w; j++) Serial.write(c);
-        }
-        resetAttr();
+    void blocked(uint32_t at, uint32_t us) override {
+        event("{\"name\":\"blocked on TX\",\"cat\":\"tx\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":1,\"tid\":3}",
+              (unsigned long)at, (unsigned long)us);
     }
 
-    void drawProgressBar(const UI_Box& b, float percent, UI_Color color) {
-        if (percent < 0) percent = 0;
-        if (percent > 100) percent = 100;
-        int innerWidth = b.w - 2;
-        int fillWidth = (int)((percent / 100.0) * innerWidth);
-        fillRect(b.x + 1, b.y + 1, fillWidth, b.h - 2, '#', color);
-        fillRect(b.x + 1 + fillWidth, b.y + 1, innerWidth - fillWidth, b.h - 2, ' ', color);
+private:
+    static void wire(uint32_t at, uint32_t us, uint16_t n, void* ctx) {
+        UI_ChromeTrace* t = (UI_ChromeTrace*)ctx;
+        t->event("{\"name\":\"wire\",\"cat\":\"tx\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":1,\"tid\":4,\"args\":{\"bytes\":%u}}",
+                 (unsigned long)at, (unsigned long)us, (unsigned)n);
+        t->event("{\"name\":\"bytes sent\",\"ph\":\"C\",\"ts\":%lu,\"pid\":1,\"args\":{\"bytes\":%lu}}",
+                 (unsigned long)(at + us), (unsigned long)(t->sent += n));
+    }
+    // Events come from the drawing thread and the backend's worker.
+    void event(const char* fmt, ...) {
+        std::lock_guard<std::mutex> lk(m);
+        if (!f) return;
+        if (n++) fputs(",\n", f);
+        va_list ap;
+        va_start(ap, fmt);
+        vfprintf(f, fmt, ap);
+        va_end(ap);
     }
+
+    FILE* f;
+    std::mutex m;
+    unsigned long n = 0, sent = 0;
+#ifdef SERIALUI_ASYNC_TX
+    HostThreadTx* link = nullptr;
+#endif
 };
 #endif
+
+// Routes drawing calls in this scope to a lane, e.g. for an alarm value:
+//   { UI_PriorityScope p(ui, UI_Priority::CRITICAL); ui.printfText(Layout_Main::alarm, v); }
+class UI_PriorityScope {
+public:
+    UI_PriorityScope(SerialUI& ui, UI_Priority p) : ui(ui), prev(ui.setPriority(p)) {}
+    ~UI_PriorityScope() { ui.setPriority(prev); }
+private:
+    SerialUI& ui;
+    UI_Priority prev;
+};
+#endif
+"""
+
+# Host-side viewer for the binary protocol, written by --viewer.
+UI_VIEWER_SOURCE = r"""// ui_viewer.cpp - host viewer for the SerialUI binary display protocol.
+// Decodes a device's byte stream into ANSI on stdout, or on a new
+// pseudo-terminal with --pty (attach any terminal program to the printed path).
+// --lz undoes stream compression first; --ansi passes the (decompressed)
+// stream through as ANSI instead of decoding the binary protocol. With
+// -DSERIALUI_FRAME_SINK, --capture FILE [--size WxH] also keeps the screen
+// in FILE for other programs (see UI_FrameSink).
+//
+//   g++ -std=c++11 -O2 -DSERIALUI_BINARY -DSERIALUI_COMPRESS ui_viewer.cpp ui_layout.cpp -o ui_viewer
+//   stty -F /dev/ttyUSB0 1000000 raw && ./ui_viewer /dev/ttyUSB0
+//   ./ui_viewer --pty /dev/ttyUSB0          # then e.g. screen /dev/pts/N
+//   ./ui_viewer --lz --ansi --pty /dev/ttyUSB0
+#include "ui_layout.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef SERIALUI_FRAME_SINK
+static UI_FrameSink* capture = nullptr;
+static void toStdout(uint8_t c, void*) { putchar(c); if (capture) capture->put(c); }
+#else
+static void toStdout(uint8_t c, void*) { putchar(c); }
+#endif
+static void toDecoder(uint8_t c, void* dec) { ((UI_BinaryDecoder*)dec)->feed(c); }
+
+int main(int argc, char** argv) {
+    bool pty = false, lz = false, ansi = false;
+    const char* path = nullptr;
+    const char* capPath = nullptr;
+    int capW = 80, capH = 24;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--pty")) pty = true;
+        else if (!strcmp(argv[i], "--lz")) lz = true;
+        else if (!strcmp(argv[i], "--ansi")) ansi = true;
+        else if (!strcmp(argv[i], "--capture") && i + 1 < argc) capPath = argv[++i];
+        else if (!strcmp(argv[i], "--size") && i + 1 < argc) sscanf(argv[++i], "%dx%d", &capW, &capH);
+        else path = argv[i];
+    }
+#ifndef SERIALUI_COMPRESS
+    if (lz) { fprintf(stderr, "--lz needs a build with -DSERIALUI_COMPRESS\n"); return 1; }
+#endif
+    int in = path ? open(path, O_RDONLY) : 0;
+    if (in < 0) { perror(path); return 1; }
+    if (pty) {
+        int m = posix_openpt(O_RDWR | O_NOCTTY);
+        if (m < 0 || grantpt(m) || unlockpt(m)) { perror("pty"); return 1; }
+        fprintf(stderr, "viewer on %s\n", ptsname(m));
+        fflush(stdout);
+        dup2(m, 1);
+    }
+    SerialUI ui;
+    UI_BinaryDecoder dec(ui);
+#ifdef SERIALUI_FRAME_SINK
+    if (capPath) {
+        capture = new UI_FrameSink(capPath, (uint16_t)capW, (uint16_t)capH);
+        if (!capture->ok()) { perror(capPath); return 1; }
+        ui.setFrameSink(capture);
+    }
+#else
+    if (capPath) { fprintf(stderr, "--capture needs a build with -DSERIALUI_FRAME_SINK\n"); return 1; }
+#endif
+#ifdef SERIALUI_COMPRESS
+    UI_LzDecoder unz(ansi ? toStdout : toDecoder, &dec);
+#endif
+    uint8_t buf[512];
+    ssize_t n;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+#ifdef SERIALUI_COMPRESS
+        if (lz) unz.feed(buf, (size_t)n); else
+#endif
+        if (ansi) for (ssize_t i = 0; i < n; i++) toStdout(buf[i], nullptr);
+        else dec.feed(buf, (size_t)n);
+#ifdef SERIALUI_FRAME_SINK
+        if (capture) capture->publish();
+#endif
+        fflush(stdout);
+    }
+    if (dec.layoutMismatch()) fprintf(stderr, "warning: the device layout differs from this build; BLITs were skipped\n");
+#ifdef SERIALUI_COMPRESS
+    if (lz && unz.dictionaryMismatch()) fprintf(stderr, "warning: the device dictionary differs from this build; output is corrupt\n");
+#endif
+    return 0;
+}
 """
 
 # ------------------------------
@@ -230,6 +2352,7 @@ class UIElement:
                 x=int(d.get('x', 0)),
                 y=int(d.get('y', 0)),
                 content=str(d.get('content', '')),
+                sid=str(d.get('sid', '')),
                 layer=layer
             )
         if t == "LINE":
@@ -242,6 +2365,16 @@ class UIElement:
                 y2=int(d.get('y2', 0)),
                 layer=layer
             )
+        if t == "BIGNUM":
+            return BigNum(
+                name=str(d.get('name', 'num')),
+                color=color,
+                x=int(d.get('x', 0)),
+                y=int(d.get('y', 0)),
+                digits=max(1, min(16, int(d.get('digits', 4)))),
+                sample=str(d.get('sample', '')),
+                layer=layer
+            )
         if t == "FREEHAND":
             return Freehand(
                 name=str(d.get('name', 'fh')),
@@ -290,6 +2423,14 @@ class Box(UIElement):
     def cpp_struct_init(self) -> str:
         return f'{{ {self.x}, {self.y}, {self.w}, {self.h}, UI_Color::{self.color.name} }}'
 
+ANSI_SGR_RE = re.compile(r'\x1b\[[0-9;]*m')
+
+def _rect_union(a: tuple, b: tuple) -> tuple:
+    return (min(a[0], b[0]), min(a[1], b[1]), max(a[2], b[2]), max(a[3], b[3]))
+
+def _rect_overlap(a: tuple, b: tuple) -> bool:
+    return a[0] <= b[2] and b[0] <= a[2] and a[1] <= b[3] and b[1] <= a[3]
+
 def c_escape(s: str) -> str:
     return s.replace('\\', '\\\\').replace('"', '\\"').replace('\n', '\\n').replace('\x1b', '\\x1b')
 
@@ -297,8 +2438,15 @@ def c_escape(s: str) -> str:
 class Text(UIElement):
     x: int = 0; y: int = 0; content: str = ""
     type: str = "TEXT"
+    sid: str = ""  # string id: content comes from the per-language string tables
     def cpp_struct_init(self) -> str:
+        if self.sid:
+            return f'{{ {self.x}, {self.y}, UI_Str::{self.sid}, UI_Color::{self.color.name} }}'
         return f'{{ {self.x}, {self.y}, "{c_escape(self.content)}", UI_Color::{self.color.name} }}'
+    def to_dict(self) -> Dict[str, Any]:
+        d = super().to_dict()
+        if not self.sid: del d['sid']
+        return d
 
 @dataclass
 class Line(UIElement):
@@ -314,6 +2462,32 @@ class Freehand(UIElement):
     def cpp_struct_init(self) -> str:
         return f'{{ {self.x}, {self.y}, RES_{self.name}_ARR, {len(self.lines)}, UI_Color::{self.color.name} }}'
 
+# seven-segment glyphs, as in SerialUI::segMask: bits a b c d e f g dp
+SEG_MASKS = dict(zip("0123456789-_ AbCdEFHLnoPrU", [
+    0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F, 0x40, 0x08, 0x00,
+    0x77, 0x7C, 0x39, 0x5E, 0x79, 0x71, 0x76, 0x38, 0x54, 0x5C, 0x73, 0x50, 0x3E]))
+SEG_CELLS = [(0x01, 1, 0, '_'), (0x02, 2, 1, '|'), (0x04, 2, 2, '|'), (0x08, 1, 2, '_'),
+             (0x10, 0, 2, '|'), (0x20, 0, 1, '|'), (0x40, 1, 1, '_'), (0x80, 3, 2, '.')]
+
+@dataclass
+class BigNum(UIElement):
+    """Seven-segment number, 4x3 cells per digit; sample is only shown in the designer."""
+    x: int = 0; y: int = 0; digits: int = 4; sample: str = "0"
+    type: str = "BIGNUM"
+    def cpp_struct_init(self) -> str:
+        return f'{{ {self.x}, {self.y}, {self.digits}, UI_Color::{self.color.name}, BIGNUM_{self.name} }}'
+    def cells(self) -> List[tuple]:
+        """(dx, dy, ch) of the lit segments for sample, right-aligned like drawBigNumber."""
+        m: List[int] = []
+        for c in self.sample:
+            if c in '.,':
+                if not m: m.append(0)
+                m[-1] |= 0x80; continue
+            up = c if c in SEG_MASKS else c.upper()
+            m.append(SEG_MASKS.get(up, 0x40))
+        m = [0x40] * self.digits if len(m) > self.digits else [0] * (self.digits - len(m)) + m
+        return [(d * 4 + cx, cy, ch) for d, mask in enumerate(m) for bit, cx, cy, ch in SEG_CELLS if mask & bit]
+
 @dataclass
 class UserFunction:
     name: str
@@ -328,63 +2502,311 @@ class FunctionTemplate:
     signature_pattern: str = ""
     body_pattern: str = ""
 
+# CSI with params/final, two-char escapes, printable runs, single control chars
+ANSI_TOKEN_RE = re.compile(r'\x1b\[([0-?]*)[ -/]*([@-~])|\x1b([()*+].|[^\[()*+])|([^\x00-\x1f\x1b\x7f]+)|([\x00-\x1f\x7f])', re.S)
+ANSI_COMPLETE_RE = re.compile(r'\x1b(?:\[[0-?]*[ -/]*[@-~]|[()*+].|[^\[()*+])', re.S)
+
 class AnsiRenderer:
+    """Terminal model for test output: a w x h grid of chars plus (fg, bg, bold) per cell.
+
+    feed() tokenizes with one regex and writes printable runs as row slices, so
+    long streams cost per token rather than per character. Sequences split
+    across feed() calls are carried over to the next call.
+    """
+    DEFAULT_ATTR = (15, None, False)
+
     def __init__(self, w=80, h=24):
         self.w, self.h = w, h
-        self.grid = [[' ' for _ in range(w)] for _ in range(h)]
-        self.colors = [[(15, None, False) for _ in range(w)] for _ in range(h)] # (fg, bg, bold)
+        self.grid = [[' '] * w for _ in range(h)]
+        self.colors = [[self.DEFAULT_ATTR] * w for _ in range(h)] # (fg, bg, bold)
         self.cx, self.cy = 0, 0
         self.fg, self.bg, self.bold = 15, None, False
+        self.top, self.bottom = 0, h - 1 # scroll region
+        self._saved = (0, 0, 15, None, False)
+        self._last = ' '
+        self._carry = ''
+
+    def _blank(self, y: int, x0: int = 0, x1: Optional[int] = None):
+        x1 = self.w if x1 is None else max(x0, min(self.w, x1))
+        n = x1 - x0
+        if n > 0:
+            self.grid[y][x0:x1] = ' ' * n
+            self.colors[y][x0:x1] = [self.DEFAULT_ATTR] * n
+
+    def _scroll(self, n: int, top: Optional[int] = None):
+        """Scroll rows top..bottom up by n (down when n < 0), blanking the rows exposed."""
+        top = self.top if top is None else top; bot = self.bottom
+        n = max(-(bot - top + 1), min(bot - top + 1, n))
+        for _ in range(abs(n)):
+            at, to = (top, bot) if n > 0 else (bot, top)
+            del self.grid[at]; del self.colors[at]
+            self.grid.insert(to, [' '] * self.w); self.colors.insert(to, [self.DEFAULT_ATTR] * self.w)
+
+    def _text(self, s: str):
+        y, x = self.cy, self.cx
+        if not (0 <= y < self.h) or x >= self.w: return
+        s = s[:self.w - x]; n = len(s)
+        self.grid[y][x:x + n] = s
+        self.colors[y][x:x + n] = [(self.fg, self.bg, self.bold)] * n
+        self.cx = x + n; self._last = s[-1]
+
+    def _sgr(self, seq: str):
+        codes = seq.split(';'); i = 0
+        while i < len(codes):
+            c = codes[i]
+            if not c or c == '0': self.fg, self.bg, self.bold = 15, None, False
+            elif c == '1': self.bold = True
+            elif c == '22': self.bold = False
+            elif c == '39': self.fg = 15
+            elif c == '49': self.bg = None
+            elif c in ('38', '48'):
+                # 256-colour / truecolour forms are skipped, not interpreted
+                i += 2 if codes[i+1:i+2] == ['5'] else 4
+            elif "30" <= c <= "37" and len(c) == 2: self.fg = int(c) - 30
+            elif "90" <= c <= "97" and len(c) == 2: self.fg = int(c) - 90 + 8
+            elif "40" <= c <= "47" and len(c) == 2: self.bg = int(c) - 40
+            elif "100" <= c <= "107" and len(c) == 3: self.bg = int(c) - 100 + 8
+            i += 1
+
+    def _csi(self, seq: str, code: str):
+        if code == 'm': self._sgr(seq); return
+        if seq.startswith('?'): return # private modes (cursor visibility etc.)
+        parts = seq.split(';')
+        p0 = int(parts[0]) if parts[0].isdigit() else 0
+        n = max(1, p0)
+        w, h = self.w, self.h
+        if code in 'Hf': # Position
+            self.cy = max(0, min(h-1, p0-1 if parts[0] else 0))
+            self.cx = max(0, min(w-1, int(parts[1])-1 if len(parts) > 1 and parts[1].isdigit() else 0))
+        elif code == 'A': self.cy = max(self.top if self.cy >= self.top else 0, self.cy - n)
+        elif code == 'B': self.cy = min(self.bottom if self.cy <= self.bottom else h-1, self.cy + n)
+        elif code == 'C': self.cx = min(w-1, self.cx + n)
+        elif code == 'D': self.cx = max(0, min(w-1, self.cx) - n)
+        elif code == 'E': self.cy = min(h-1, self.cy + n); self.cx = 0
+        elif code == 'F': self.cy = max(0, self.cy - n); self.cx = 0
+        elif code == 'G': self.cx = max(0, min(w-1, n-1))
+        elif code == 'd': self.cy = max(0, min(h-1, n-1))
+        elif code == 'J': # Clear: 0 below, 1 above, 2/3 all (rows are reused, not rebuilt)
+            if p0 == 0:
+                self._blank(self.cy, min(self.cx, w))
+                for y in range(self.cy + 1, h): self._blank(y)
+            elif p0 == 1:
+                for y in range(self.cy): self._blank(y)
+                self._blank(self.cy, 0, self.cx + 1)
+            else:
+                for y in range(h): self._blank(y)
+        elif code == 'K': # Erase line: 0 right, 1 left, 2 whole
+            if p0 == 0: self._blank(self.cy, min(self.cx, w))
+            elif p0 == 1: self._blank(self.cy, 0, self.cx + 1)
+            else: self._blank(self.cy)
+        elif code == 'X': self._blank(self.cy, min(self.cx, w), self.cx + n)
+        elif code in 'P@' and self.cx < w: # delete / insert characters, shifting the rest of the line
+            x = self.cx; n = min(n, w - x); row, col = self.grid[self.cy], self.colors[self.cy]
+            if code == 'P':
+                del row[x:x + n]; del col[x:x + n]; row.extend(' ' * n); col.extend([self.DEFAULT_ATTR] * n)
+            else:
+                row[x:x] = ' ' * n; col[x:x] = [self.DEFAULT_ATTR] * n; del row[w:]; del col[w:]
+        elif code == 'b': self._text(self._last * n)
+        elif code == 'r': # scroll region, cursor homes
+            t = n - 1; b = int(parts[1]) - 1 if len(parts) > 1 and parts[1].isdigit() else h - 1
+            if 0 <= t < b < h: self.top, self.bottom = t, b
+            else: self.top, self.bottom = 0, h - 1
+            self.cx = self.cy = 0
+        elif code == 'S': self._scroll(n)
+        elif code == 'T': self._scroll(-n)
+        elif code in 'LM' and self.top <= self.cy <= self.bottom:
+            self._scroll(-n if code == 'L' else n, self.cy); self.cx = 0
+        elif code == 's': self._saved = (self.cx, self.cy, self.fg, self.bg, self.bold)
+        elif code == 'u': self.cx, self.cy, self.fg, self.bg, self.bold = self._saved
 
     def feed(self, data: str):
-        i = 0
-        while i < len(data):
-            if data[i] == '\x1b' and i + 1 < len(data) and data[i+1] == '[':
-                j = i + 2
-                while j < len(data) and not ('a' <= data[j] <= 'z' or 'A' <= data[j] <= 'Z'):
-                    j += 1
-                if j < len(data):
-                    seq = data[i+2:j]
-                    code = data[j]
-                    if code == 'H': # Position
-                        parts = seq.split(';')
-                        self.cy = max(0, min(self.h-1, int(parts[0])-1 if parts[0] else 0))
-                        self.cx = max(0, min(self.w-1, int(parts[1])-1 if len(parts) > 1 and parts[1] else 0))
-                    elif code == 'J' and seq == '2': # Clear
-                        self.grid = [[' ' for _ in range(self.w)] for _ in range(self.h)]
-                        self.colors = [[(15, None, False) for _ in range(self.w)] for _ in range(self.h)]
-                        self.cx = self.cy = 0
-                    elif code == 'm': # Color
-                        for c in seq.split(';'):
-                            if not c or c == '0': self.fg, self.bg, self.bold = 15, None, False
-                            elif c == '1': self.bold = True
-                            elif "30" <= c <= "37": self.fg = int(c) - 30
-                            elif "90" <= c <= "97": self.fg = int(c) - 90 + 8
-                            elif "40" <= c <= "47": self.bg = int(c) - 40
-                            elif "100" <= c <= "107": self.bg = int(c) - 100 + 8
-                    i = j + 1
-                    continue
-            if data[i] == '\n':
-                self.cy = min(self.h-1, self.cy + 1)
-                self.cx = 0
-            elif data[i] == '\r':
-                self.cx = 0
+        if self._carry:
+            data = self._carry + data; self._carry = ''
+        esc = data.rfind('\x1b')
+        if esc >= 0 and not ANSI_COMPLETE_RE.match(data, esc):
+            data, self._carry = data[:esc], data[esc:]
+        for m in ANSI_TOKEN_RE.finditer(data):
+            run, code = m.group(4, 2)
+            if run is not None:
+                self._text(run)
+            elif code == 'H':
+                # cursor positioning dominates SerialUI output; keep it off the generic path
+                seq = m.group(1); row, _, col = seq.partition(';')
+                self.cy = max(0, min(self.h-1, int(row)-1)) if row.isdigit() else 0
+                self.cx = max(0, min(self.w-1, int(col)-1)) if col.isdigit() else 0
+            elif code is not None:
+                self._csi(m.group(1), code)
+            elif m.group(5) is not None:
+                c = m.group(5)
+                if c == '\n':
+                    # newline implies carriage return, as the host runner does not translate
+                    if self.cy == self.bottom: self._scroll(1)
+                    else: self.cy = min(self.h-1, self.cy + 1)
+                    self.cx = 0
+                elif c == '\r': self.cx = 0
+                elif c == '\b': self.cx = max(0, min(self.w-1, self.cx) - 1)
+                elif c == '\t': self.cx = min(self.w-1, (self.cx // 8 + 1) * 8)
             else:
-                if 0 <= self.cy < self.h and 0 <= self.cx < self.w:
-                    self.grid[self.cy][self.cx] = data[i]
-                    self.colors[self.cy][self.cx] = (self.fg, self.bg, self.bold)
-                    self.cx += 1
-            i += 1
+                c = m.group(3)
+                if c == '7': self._saved = (self.cx, self.cy, self.fg, self.bg, self.bold)
+                elif c == '8': self.cx, self.cy, self.fg, self.bg, self.bold = self._saved
+                elif c == 'c': self.__init__(self.w, self.h)
 
 @dataclass
 class Screen:
     name: str
     objects: List[UIElement] = field(default_factory=list)
+    width: int = 80   # canvas size; may exceed the terminal, which then shows a viewport
+    height: int = 24
 
 @dataclass
 class Project:
     screens: List[Screen] = field(default_factory=list)
     functions: List[UserFunction] = field(default_factory=list)
+    # localization: the first language is Text.content; strings[sid][lang] holds the others
+    languages: List[str] = field(default_factory=lambda: ["en"])
+    strings: Dict[str, Dict[str, str]] = field(default_factory=dict)
+
+# ------------------------------
+# AssetLibrary (indexed, content-addressed)
+# ------------------------------
+class AssetLibrary:
+    """Shared component library: a small index plus content-addressed bodies.
+
+    library/index.json maps name -> {type, size, hash} and is all that is read to list
+    assets. library/objects/ab/<hash>.json holds an element dict without its name, so
+    identical assets saved under different names share one body. Bodies and previews
+    are loaded on first use and kept in small LRU caches. A legacy library.json is
+    imported once when no index exists yet.
+    """
+    CACHE = 64
+
+    def __init__(self, root: str = "library", legacy: str = "library.json"):
+        self.root, self.legacy = Path(root), Path(legacy)
+        self.index_file = self.root / "index.json"
+        self.index: Dict[str, Dict[str, Any]] = {}
+        self._mtime: Optional[float] = None
+        self._bodies: "OrderedDict[str, Dict[str, Any]]" = OrderedDict()
+        self._previews: "OrderedDict[str, str]" = OrderedDict()
+        self._lock = threading.Lock()
+
+    @staticmethod
+    def _canon(d: Dict[str, Any]) -> bytes:
+        body = {k: v for k, v in d.items() if k != 'name'}
+        return json.dumps(body, sort_keys=True, separators=(',', ':')).encode('utf-8')
+
+    def _body_path(self, h: str) -> Path:
+        return self.root / "objects" / h[:2] / f"{h}.json"
+
+    def _write(self, p: Path, data: bytes):
+        p.parent.mkdir(parents=True, exist_ok=True)
+        tmp = p.with_suffix(p.suffix + ".tmp")
+        tmp.write_bytes(data); os.replace(tmp, p)
+
+    def _save_index(self):
+        self._write(self.index_file, json.dumps(self.index, indent=0, sort_keys=True).encode('utf-8'))
+        self._mtime = self.index_file.stat().st_mtime
+
+    def _store(self, name: str, d: Dict[str, Any]):
+        data = self._canon(d); h = hashlib.sha1(data).hexdigest()
+        p = self._body_path(h)
+        if not p.exists(): self._write(p, data)
+        self.index[name] = {'type': str(d.get('type', 'BASE')), 'size': len(data), 'hash': h}
+
+    def refresh(self) -> bool:
+        """Reload the index if it changed on disk; True when the name list may differ."""
+        with self._lock:
+            try:
+                if not self.index_file.exists():
+                    if not self.legacy.exists(): return False
+                    txt = self.legacy.read_text(encoding="utf-8")
+                    for k, d in (json.loads(txt) if txt else {}).items():
+                        if isinstance(d, dict): self._store(k, d)
+                    self._save_index(); return True
+                mt = self.index_file.stat().st_mtime
+                if mt == self._mtime: return False
+                self.index = json.loads(self.index_file.read_text(encoding="utf-8")); self._mtime = mt
+                return True
+            except Exception:
+                return False
+
+    def names(self) -> List[str]:
+        self.refresh()
+        return sorted(self.index)
+
+    def get(self, name: str) -> Optional[Dict[str, Any]]:
+        self.refresh()
+        with self._lock:
+            e = self.index.get(name)
+            if not e: return None
+            h = e['hash']; d = self._bodies.get(h)
+            if d is None:
+                try: d = json.loads(self._body_path(h).read_bytes())
+                except Exception: return None
+                self._bodies[h] = d
+                if len(self._bodies) > self.CACHE: self._bodies.popitem(last=False)
+            else:
+                self._bodies.move_to_end(h)
+            return dict(json.loads(json.dumps(d)), name=name)
+
+    def put(self, name: str, d: Dict[str, Any]):
+        self.refresh()
+        with self._lock:
+            self._store(name, d); self._save_index()
+
+    def delete(self, name: str):
+        self.refresh()
+        with self._lock:
+            e = self.index.pop(name, None)
+            if not e: return
+            self._save_index()
+            if not any(v['hash'] == e['hash'] for v in self.index.values()):
+                try: self._body_path(e['hash']).unlink()
+                except Exception: pass
+
+    def preview(self, name: str, w: int = 60, h: int = 16) -> str:
+        """Plain-text rendering of an asset, built on first request and cached per body."""
+        e = self.index.get(name)
+        if not e: return ""
+        key = f"{e['hash']}:{w}x{h}"
+        txt = self._previews.get(key)
+        if txt is None:
+            d = self.get(name); o = UIElement.from_dict(d) if d else None
+            cells: Dict[tuple, str] = {}
+            if o: self._raster(o, 0, 0, cells)
+            if cells:
+                x0 = min(x for x, _ in cells); y0 = min(y for _, y in cells)
+                rows = [[' '] * w for _ in range(h)]
+                for (x, y), ch in cells.items():
+                    if x - x0 < w and y - y0 < h: rows[y - y0][x - x0] = ch
+                txt = "\n".join(''.join(r).rstrip() for r in rows).rstrip()
+            else:
+                txt = ""
+            self._previews[key] = txt
+            if len(self._previews) > self.CACHE: self._previews.popitem(last=False)
+        return txt
+
+    def _raster(self, o: UIElement, bx: int, by: int, cells: Dict[tuple, str]):
+        if isinstance(o, Box):
+            x, y = bx + o.x, by + o.y
+            for k in range(o.w):
+                cells[(x + k, y)] = cells[(x + k, y + o.h - 1)] = '-'
+            for k in range(o.h):
+                cells[(x, y + k)] = cells[(x + o.w - 1, y + k)] = '|'
+            for c in ((x, y), (x + o.w - 1, y), (x, y + o.h - 1), (x + o.w - 1, y + o.h - 1)): cells[c] = '+'
+        elif isinstance(o, (Text, Freehand)):
+            lines = o.content.splitlines() if isinstance(o, Text) else o.lines
+            for r, ln in enumerate(lines):
+                for c, ch in enumerate(ANSI_SGR_RE.sub('', ln)):
+                    if ch != ' ': cells[(bx + o.x + c, by + o.y + r)] = ch
+        elif isinstance(o, Line):
+            n = max(abs(o.x2 - o.x1), abs(o.y2 - o.y1), 1)
+            for i in range(n + 1):
+                cells[(bx + o.x1 + round((o.x2 - o.x1) * i / n), by + o.y1 + round((o.y2 - o.y1) * i / n))] = '#'
+        elif isinstance(o, BigNum):
+            for dx, dy, ch in o.cells(): cells[(bx + o.x + dx, by + o.y + dy)] = ch
+        elif isinstance(o, MetaObject):
+            for c in o.children: self._raster(c, bx + o.x, by + o.y, cells)
 
 # ------------------------------
 # GuiManager (Tk in background thread)
@@ -393,7 +2815,7 @@ class GuiManager:
     """
     Threaded Tk GUI. Provides:
       - queue: GUI -> Designer commands (button presses)
-      - update_state(help_text, screen_names, active_screen): Designer calls to update lists & help text.
+      - update_state(help_text=..., screens=..., ...): Designer sends only the collections that changed.
       - edit_text_blocking(initial, title) -> str | None
       - edit_props_blocking(obj) -> dict | None
     """
@@ -403,6 +2825,8 @@ class GuiManager:
         self._root: Optional[tk.Tk] = None
         self._lst_screens: Optional[tk.Listbox] = None
         self._lst_assets: Optional[tk.Listbox] = None
+        self._asset_info: Optional[tk.Label] = None
+        self._asset_preview: Optional[tk.Text] = None
         self._lst_functions: Optional[tk.Listbox] = None
         self._lst_templates: Optional[tk.Listbox] = None
         self._help_text_widget: Optional[scrolledtext.ScrolledText] = None
@@ -416,6 +2840,11 @@ class GuiManager:
         self._last_functions: List[str] = []
         self._last_templates: List[str] = []
         self._last_test_cases: List[str] = []
+        # per-collection versions: bumped by update_state, caught up by _apply_update
+        self._versions: Dict[str, int] = {}
+        self._applied: Dict[str, int] = {}
+        self._scheduled = False
+        self.lib = AssetLibrary()
         self._update_interval = update_interval
         # start thread
         self._thr = threading.Thread(target=self._run_tk, daemon=True)
@@ -456,6 +2885,11 @@ class GuiManager:
             nb.add(f_assets, text="Asset Library")
             self._lst_assets = tk.Listbox(f_assets, exportselection=False)
             self._lst_assets.pack(fill="both", expand=True, padx=6, pady=6)
+            self._lst_assets.bind("<<ListboxSelect>>", lambda e: self._show_preview())
+            self._asset_info = tk.Label(f_assets, anchor="w")
+            self._asset_info.pack(fill="x", padx=6)
+            self._asset_preview = tk.Text(f_assets, height=10, font=("Consolas", 9), wrap="none", state="disabled", bg="#f0f0f0")
+            self._asset_preview.pack(fill="x", padx=6)
             af = tk.Frame(f_assets); af.pack(fill="x", pady=4)
             tk.Button(af, text="Insert Selected", bg="#ddffdd", command=lambda: self._emit("INSERT_ASSET")).pack(side="left", padx=6)
             tk.Button(af, text="Delete Asset", command=self._delete_asset).pack(side="right", padx=6)
@@ -585,32 +3019,11 @@ class GuiManager:
                 pass
 
     # Asset helpers
-    def _lib_path(self) -> Path:
-        return Path("library.json")
-
-    def _load_lib(self) -> Dict[str, Any]:
-        try:
-            p = self._lib_path()
-            if not p.exists(): return {}
-            txt = p.read_text(encoding="utf-8")
-            return json.loads(txt) if txt else {}
-        except Exception:
-            return {}
-
-    def _write_lib(self, lib: Dict[str, Any]):
-        try:
-            self._lib_path().write_text(json.dumps(lib, indent=2), encoding="utf-8")
-        except Exception:
-            pass
-
     def _delete_asset(self):
         try:
             sel = self._lst_assets.curselection()
             if not sel: return
-            key = self._lst_assets.get(sel[0])
-            lib = self._load_lib()
-            if key in lib:
-                del lib[key]; self._write_lib(lib)
+            self.lib.delete(self._lst_assets.get(sel[0]))
             self._refresh_assets()
         except Exception:
             pass
@@ -620,64 +3033,53 @@ class GuiManager:
         if not self._root or not self._lst_assets:
             return
         try:
-            lib = self._load_lib()
-            keys = sorted(lib.keys())
-            cur = self._listbox_items(self._lst_assets)
-            if cur != keys:
-                prev = None
-                sel = self._lst_assets.curselection()
-                if sel:
-                    try: prev = self._lst_assets.get(sel[0])
-                    except Exception: prev = None
-                self._lst_assets.delete(0, tk.END)
-                for k in keys: self._lst_assets.insert(tk.END, k)
-                if prev and prev in keys:
-                    idx = keys.index(prev)
-                    try:
-                        self._lst_assets.selection_clear(0, tk.END)
-                        self._lst_assets.selection_set(idx)
-                        self._lst_assets.see(idx)
-                    except Exception:
-                        pass
+            self._patch_listbox(self._lst_assets, self.lib.names())
+            self._show_preview()
+        except Exception:
+            pass
+
+    def _show_preview(self):
+        """Render the selected asset only; nothing is loaded for unselected entries."""
+        try:
+            sel = self._lst_assets.curselection()
+            name = self._lst_assets.get(sel[0]) if sel else None
+            e = self.lib.index.get(name) if name else None
+            self._asset_info.configure(text=f"{e['type']}, {e['size']} bytes" if e else "")
+            self._asset_preview.configure(state="normal")
+            self._asset_preview.delete("1.0", tk.END)
+            if e: self._asset_preview.insert("1.0", self.lib.preview(name))
+            self._asset_preview.configure(state="disabled")
         except Exception:
             pass
 
     # Public API: update_state called by Designer
-    def update_state(self, help_text: str, screens: List[str], active_screen: str, functions: List[str] = [], templates: List[str] = [], test_cases: List[str] = []):
+    def update_state(self, help_text: Optional[str] = None, screens: Optional[List[str]] = None, active_screen: Optional[str] = None,
+                     functions: Optional[List[str]] = None, templates: Optional[List[str]] = None, test_cases: Optional[List[str]] = None):
         """
-        Non-blocking: schedules a safe GUI update on Tk thread, rate-limited.
-        Designer can call frequently; updates will be applied at most once per self._update_interval.
+        Non-blocking: records the collections passed (None = unchanged) and schedules one
+        rate-limited GUI update on the Tk thread that touches only those collections.
         """
+        changes = {'help': help_text, 'screens': screens, 'active': active_screen,
+                   'functions': functions, 'templates': templates, 'test_cases': test_cases}
         with self._lock:
+            for k, v in changes.items():
+                if v is None: continue
+                setattr(self, f"_last_{k}", list(v) if isinstance(v, list) else v)
+                self._versions[k] = self._versions.get(k, 0) + 1
+            if self._scheduled or not self._root:
+                return
             now = time.time()
-            # quickly store requested values; apply on Tk thread
-            self._last_help = help_text
-            self._last_screens = list(screens)
-            self._last_active = active_screen
-            self._last_functions = list(functions)
-            self._last_templates = list(templates)
-            self._last_test_cases = list(test_cases)
-            # if enough time passed, schedule an immediate update
-            if now - self._last_update >= self._update_interval:
-                self._last_update = now
-                if self._root:
-                    try:
-                        self._root.after(0, self._apply_update)
-                    except Exception:
-                        pass
-            else:
-                # otherwise schedule a deferred update after the remaining time (only schedule one)
-                delay = int((self._update_interval - (now - self._last_update)) * 1000)
-                if self._root:
-                    try:
-                        self._root.after(delay, self._apply_update)
-                        self._last_update = now + (delay / 1000.0)
-                    except Exception:
-                        pass
+            delay = max(0, int((self._update_interval - (now - self._last_update)) * 1000))
+            try:
+                self._root.after(delay, self._apply_update)
+                self._scheduled = True
+                self._last_update = now + delay / 1000.0
+            except Exception:
+                pass
 
-    def display_test_output(self, text: str):
+    def display_test_output(self, text: str, w: int = 80, h: int = 24):
         if self._root and self._visual_out:
-            renderer = AnsiRenderer(80, 24)
+            renderer = AnsiRenderer(w, h)
             renderer.feed(text)
 
             def update():
@@ -705,117 +3107,71 @@ class GuiManager:
                 self._visual_out.configure(state="disabled")
             self._root.after(0, update)
 
+    def _patch_listbox(self, lb: tk.Listbox, items: List[str]) -> bool:
+        """Bring lb to items by replacing only the differing middle run; untouched rows keep their selection."""
+        cur = self._listbox_items(lb)
+        if cur == items: return False
+        p = 0; n = min(len(cur), len(items))
+        while p < n and cur[p] == items[p]: p += 1
+        q = 0
+        while q < n - p and cur[-1 - q] == items[-1 - q]: q += 1
+        if len(cur) - q > p: lb.delete(p, len(cur) - q - 1)
+        if len(items) - q > p: lb.insert(p, *items[p:len(items) - q])
+        return True
+
     def _apply_update(self):
-        """Runs on Tk thread; apply the last requested state in a non-destructive, focus-aware way."""
+        """Runs on Tk thread; apply collections whose version moved since the last pass, focus-aware."""
         try:
             if not self._root:
                 return
+            with self._lock:
+                self._scheduled = False
+                todo = {k for k, v in self._versions.items() if self._applied.get(k) != v}
+                self._applied.update(self._versions)
+                help_text, screens, active = self._last_help, list(self._last_screens), self._last_active
+                lists = {'functions': list(self._last_functions), 'templates': list(self._last_templates), 'test_cases': list(self._last_test_cases)}
             # help text
             try:
-                if self._help_text_widget:
+                if 'help' in todo and self._help_text_widget:
                     self._help_text_widget.configure(state="normal")
                     self._help_text_widget.delete("1.0", tk.END)
-                    self._help_text_widget.insert("1.0", self._last_help)
+                    self._help_text_widget.insert("1.0", help_text)
                     self._help_text_widget.configure(state="disabled")
             except Exception:
                 pass
 
-            # screens list: update only if different and if user is not actively focused on the list
+            # screens list: leave it alone while the user is interacting with it
             try:
-                if self._lst_screens:
-                    cur = self._listbox_items(self._lst_screens)
-                    focused = (self._root.focus_get() is self._lst_screens)
-                    if cur != self._last_screens and not focused:
-                        # preserve selected name if possible
-                        prev_sel = None
-                        sel = self._lst_screens.curselection()
-                        if sel:
-                            try: prev_sel = self._lst_screens.get(sel[0])
-                            except Exception: prev_sel = None
-                        self._lst_screens.delete(0, tk.END)
-                        for n in self._last_screens:
-                            self._lst_screens.insert(tk.END, n)
-                        # try to select active_screen if present
-                        try:
-                            if self._last_active in self._last_screens:
-                                idx = self._last_screens.index(self._last_active)
-                            else:
-                                idx = 0 if self._last_screens else None
-                            if idx is not None:
-                                self._lst_screens.selection_clear(0, tk.END)
-                                self._lst_screens.selection_set(idx)
-                                self._lst_screens.see(idx)
-                        except Exception:
-                            pass
+                if ('screens' in todo or 'active' in todo) and self._lst_screens:
+                    if self._root.focus_get() is self._lst_screens:
+                        # try again next interval; no further change has to come along
+                        with self._lock:
+                            self._applied.pop('screens', None)
+                            if not self._scheduled:
+                                self._root.after(max(1, int(self._update_interval * 1000)), self._apply_update)
+                                self._scheduled = True
                     else:
-                        # if same items but active changed, update selection if not focused
-                        if cur == self._last_screens and not focused and self._last_screens:
-                            try:
-                                if self._last_active in self._last_screens:
-                                    idx = self._last_screens.index(self._last_active)
-                                else:
-                                    idx = 0
-                                self._lst_screens.selection_clear(0, tk.END)
-                                self._lst_screens.selection_set(idx)
-                                self._lst_screens.see(idx)
-                            except Exception:
-                                pass
-            except Exception:
-                pass
-
-            # assets list refresh (it preserves selection internally)
-            try:
-                self._refresh_assets()
-            except Exception:
-                pass
-
-            # functions list
-            try:
-                if self._lst_functions:
-                    cur = self._listbox_items(self._lst_functions)
-                    if cur != self._last_functions:
-                        prev = None
-                        sel = self._lst_functions.curselection()
-                        if sel: prev = self._lst_functions.get(sel[0])
-                        self._lst_functions.delete(0, tk.END)
-                        for f in self._last_functions: self._lst_functions.insert(tk.END, f)
-                        if prev and prev in self._last_functions:
-                            idx = self._last_functions.index(prev)
-                            self._lst_functions.selection_set(idx)
+                        self._patch_listbox(self._lst_screens, screens)
+                        if screens:
+                            idx = screens.index(active) if active in screens else 0
+                            self._lst_screens.selection_clear(0, tk.END)
+                            self._lst_screens.selection_set(idx)
+                            self._lst_screens.see(idx)
             except Exception:
                 pass
 
-            # test cases list
+            # assets list: only when the library index changed on disk
             try:
-                if self._lst_test_cases:
-                    cur = self._listbox_items(self._lst_test_cases)
-                    if cur != self._last_test_cases:
-                        prev = None
-                        sel = self._lst_test_cases.curselection()
-                        if sel: prev = self._lst_test_cases.get(sel[0])
-                        self._lst_test_cases.delete(0, tk.END)
-                        for tc in self._last_test_cases: self._lst_test_cases.insert(tk.END, tc)
-                        if prev and prev in self._last_test_cases:
-                            idx = self._last_test_cases.index(prev)
-                            self._lst_test_cases.selection_set(idx)
+                if self.lib.refresh(): self._refresh_assets()
             except Exception:
                 pass
 
-            # templates list
-            try:
-                if self._lst_templates:
-                    cur = self._listbox_items(self._lst_templates)
-                    if cur != self._last_templates:
-                        prev = None
-                        sel = self._lst_templates.curselection()
-                        if sel: prev = self._lst_templates.get(sel[0])
-                        self._lst_templates.delete(0, tk.END)
-                        for t in self._last_templates: self._lst_templates.insert(tk.END, t)
-                        if prev and prev in self._last_templates:
-                            idx = self._last_templates.index(prev)
-                            self._lst_templates.selection_set(idx)
-            except Exception:
-                pass
+            # functions / templates / test cases
+            for key, lb in (('functions', self._lst_functions), ('templates', self._lst_templates), ('test_cases', self._lst_test_cases)):
+                try:
+                    if key in todo and lb: self._patch_listbox(lb, lists[key])
+                except Exception:
+                    pass
 
         except Exception:
             pass
@@ -1187,8 +3543,9 @@ class GuiManager:
         ev.wait()
         return result["value"]
 
-    def edit_props_blocking(self, obj: UIElement) -> Optional[Dict[str, Any]]:
-        """Open properties editor on Tk thread; return props dict or None."""
+    def edit_props_blocking(self, obj: UIElement, translations: Optional[Dict[str, str]] = None) -> Optional[Dict[str, Any]]:
+        """Open properties editor on Tk thread; return props dict or None.
+        translations ({lang: text}) adds a tab per extra language for Text; edits come back in props['tr']."""
         if not self.ready.is_set() or not self._root:
             return None
         result: Dict[str, Optional[Dict[str, Any]]] = {"props": None}
@@ -1227,7 +3584,11 @@ class GuiManager:
             elif isinstance(obj, Line):
                 add_entry("X1", "x1", obj.x1); add_entry("Y1", "y1", obj.y1)
                 add_entry("X2", "x2", obj.x2); add_entry("Y2", "y2", obj.y2)
+            elif isinstance(obj, BigNum):
+                add_entry("X", "x", obj.x); add_entry("Y", "y", obj.y)
+                add_entry("Digits", "digits", obj.digits); add_entry("Sample", "sample", obj.sample)
             elif isinstance(obj, (Text, Freehand)):
+                if isinstance(obj, Text): add_entry("String id", "sid", obj.sid)
                 tk.Label(frm, text="Content" if isinstance(obj, Text) else "Lines").grid(row=row, column=0, sticky="nw")
                 nb_inner = ttk.Notebook(frm); nb_inner.grid(row=row, column=1, sticky="ew", padx=4, pady=2)
                 # Visual
@@ -1242,6 +3603,12 @@ class GuiManager:
                 f_r = tk.Frame(nb_inner); nb_inner.add(f_r, text="Raw")
                 txt_r = scrolledtext.ScrolledText(f_r, height=10, width=40, font=("Courier", 10))
                 txt_r.pack(fill="both", expand=True)
+                # one raw tab per extra language (used when the element has a string id)
+                tr_boxes: Dict[str, scrolledtext.ScrolledText] = {}
+                for lang, val in (translations or {}).items():
+                    f_t = tk.Frame(nb_inner); nb_inner.add(f_t, text=lang)
+                    tr_boxes[lang] = scrolledtext.ScrolledText(f_t, height=10, width=40, font=("Courier", 10))
+                    tr_boxes[lang].pack(fill="both", expand=True); tr_boxes[lang].insert("1.0", val)
 
                 init_content = obj.content if isinstance(obj, Text) else "\n".join(obj.lines)
                 txt_v.insert("1.0", init_content); self._apply_ansi_highlight(txt_v)
@@ -1254,7 +3621,13 @@ class GuiManager:
                         c = txt_v.get("1.0", "end-1c")
                         txt_r.delete("1.0", tk.END); txt_r.insert("1.0", c)
 
-                nb_inner.bind("<<NotebookTabChanged>>", lambda e: sync_inner(nb_inner.index(nb_inner.select())==0))
+                shown = [0]  # Visual is authoritative; Raw is synced on the way in and out
+                def on_tab(e):
+                    i = nb_inner.index(nb_inner.select())
+                    if i == 1: sync_inner(False)
+                    elif shown[0] == 1: sync_inner(True)
+                    shown[0] = i
+                nb_inner.bind("<<NotebookTabChanged>>", on_tab)
                 row += 1
 
             frm.grid_columnconfigure(1, weight=1)
@@ -1273,10 +3646,15 @@ class GuiManager:
                     elif isinstance(obj, Line):
                         props['x1'] = int(entries['x1'].get()); props['y1'] = int(entries['y1'].get())
                         props['x2'] = int(entries['x2'].get()); props['y2'] = int(entries['y2'].get())
+                    elif isinstance(obj, BigNum):
+                        props['x'] = int(entries['x'].get()); props['y'] = int(entries['y'].get())
+                        props['digits'] = int(entries['digits'].get()); props['sample'] = entries['sample'].get()
                     elif isinstance(obj, (Text, Freehand)):
                         sync_inner(False)
                         raw = txt_r.get("1.0", "end-1c")
-                        if isinstance(obj, Text): props['content'] = raw
+                        if isinstance(obj, Text):
+                            props['content'] = raw; props['sid'] = entries['sid'].get().strip()
+                            props['tr'] = {l: b.get("1.0", "end-1c") for l, b in tr_boxes.items()}
                         else: props['lines'] = [ln.rstrip("\n") for ln in raw.splitlines()]
                 except Exception: pass
                 result['props'] = props
@@ -1316,12 +3694,21 @@ class ProjectManager:
     CPP_FILE = "ui_layout.cpp"
     LIB_FILE = "SerialUI.h"
 
-    def __init__(self, project_file: str = "project.uiproj"):
+    JOURNAL_COMPACT = 500  # records before the journal is folded back into the project file
+
+    def __init__(self, project_file: str = "project.uiproj", out_dir: Optional[str] = None):
         self.project_file = project_file
+        self.out_dir = Path(out_dir) if out_dir else Path(".")
+        self.journal_file = project_file + ".journal"
+        self.journal_count = 0
+        self.recovered = 0
+        self.base_hash = ""         # of the project file the journal continues
+        self._journal_live = False  # the journal file starts with a matching base record
 
     def ensure_lib(self):
         try:
-            Path(self.LIB_FILE).write_text(SERIAL_UI_HEADER, encoding="utf-8")
+            self.out_dir.mkdir(parents=True, exist_ok=True)
+            (self.out_dir / self.LIB_FILE).write_text(SERIAL_UI_HEADER, encoding="utf-8")
         except Exception:
             pass
 
@@ -1338,23 +3725,110 @@ class ProjectManager:
                 res.append(no)
         return res
 
-    def save_project(self, project: Project):
+    @staticmethod
+    def _cells(o: UIElement) -> int:
+        """Character cells one draw() of a flattened element paints."""
+        if isinstance(o, Box): return max(1, o.w) * 2 + max(0, o.h - 2) * 2 if o.h > 1 else max(1, o.w)
+        if isinstance(o, Line): return max(abs(o.x2 - o.x1), abs(o.y2 - o.y1)) + 1
+        if isinstance(o, Text): return len(ANSI_SGR_RE.sub('', o.content.replace('\n', '')))
+        if isinstance(o, Freehand): return sum(len(ANSI_SGR_RE.sub('', ln)) for ln in o.lines)
+        if isinstance(o, BigNum): return o.digits * 12
+        return 0
+
+    STR_DEPTH = 7  # pair nesting limit; the decoder's stack (SERIALUI_STR_STACK) holds depth + 1
+
+    @classmethod
+    def _pack_strings(cls, strs: List[bytes]) -> tuple:
+        """Byte-pair compress one language: bytes unused by its strings become codes for
+        frequent pairs. Returns (data, offsets, pairs) for a UI_StringTable."""
+        seqs = [list(x) for x in strs]
+        used = {c for x in seqs for c in x}
+        free = [c for c in range(255, 0, -1) if c not in used]
+        depth = [0] * 256; pairs = []
+        while free:
+            cnt: Dict[tuple, int] = {}
+            for q in seqs:
+                for a, b in zip(q, q[1:]): cnt[(a, b)] = cnt.get((a, b), 0) + 1
+            best = max((k for k, n in cnt.items() if n > 3 and max(depth[k[0]], depth[k[1]]) < cls.STR_DEPTH),
+                       key=lambda k: cnt[k], default=None)
+            if best is None: break
+            c = free.pop(); pairs.append((c,) + best); depth[c] = 1 + max(depth[best[0]], depth[best[1]])
+            for n, q in enumerate(seqs):
+                out, i = [], 0
+                while i < len(q):
+                    if i + 1 < len(q) and (q[i], q[i + 1]) == best: out.append(c); i += 2
+                    else: out.append(q[i]); i += 1
+                seqs[n] = out
+        data, offsets = [], []
+        for q in seqs: offsets.append(len(data)); data.extend(q + [0])
+        return data, offsets, pairs
+
+    def _string_tables(self, project: Project, flat: List[UIElement]) -> tuple:
+        """(ids, languages, {lang: (data, offsets, pairs, raw_len)}) for the Text elements with a sid."""
+        ids: Dict[str, str] = {}
+        for o in flat:
+            if isinstance(o, Text) and o.sid and o.sid not in ids: ids[o.sid] = o.content
+        if not ids: return [], [], {}
+        langs = [re.sub(r'[^a-zA-Z0-9_]', '', l).upper() or f"L{i}" for i, l in enumerate(project.languages)]
+        tables = {}
+        for i, (lang, key) in enumerate(zip(langs, project.languages)):
+            strs = [(base if i == 0 else project.strings.get(sid, {}).get(key) or base).encode('utf-8') for sid, base in ids.items()]
+            tables[lang] = self._pack_strings(strs) + (sum(len(x) + 1 for x in strs),)
+        return list(ids), langs, tables
+
+    LZ_DICT_MAX = 2048  # flash spent on the stream compression dictionary
+
+    @classmethod
+    def _lz_dictionary(cls, flat: List[UIElement]) -> tuple:
+        """Primer for SERIALUI_COMPRESS: the escape sequences drawing code sends, then the
+        project's fixed strings as they appear on the wire. Returns (data, heads)."""
+        parts = [b'\x1b[0m\x1b[', b'\x1b[?25l\x1b[2J\x1b[H']
+        parts += [f'\x1b[{c}m\x1b['.encode() for c in sorted({o.color.value for o in flat})]
+        for o in flat:
+            if isinstance(o, Text) and not o.sid: parts.append(o.content.encode('utf-8') + b'\x1b[0m')
+            elif isinstance(o, Freehand): parts += [ln.encode('utf-8') for ln in o.lines]
+        data = b''
+        for p in parts:
+            if len(p) >= 3 and p not in data and len(data) + len(p) <= cls.LZ_DICT_MAX: data += p
+        heads = [0xFFFF] * 256
+        for i in range(len(data) - 2):
+            a, b, c = data[i:i + 3]
+            h = ((a << 4) ^ (b << 2) ^ c ^ (a >> 4)) & 0xFF
+            if heads[h] == 0xFFFF: heads[h] = i
+        return data, heads
+
+    def save_project(self, project: Project) -> Dict[str, Any]:
+        """Write ui_layout.h/.cpp (and SerialUI.h) to out_dir; returns size and cost metrics."""
+        t0 = time.perf_counter()
         self.ensure_lib()
         try:
             h = ['#ifndef UI_LAYOUT_H', '#define UI_LAYOUT_H', '#include "SerialUI.h"', '']
             all_flat = {s.name: self._flatten(s.objects) for s in project.screens}
+            dims = {s.name: (s.width, s.height) for s in project.screens}
+            ctype = lambda o: 'LText' if isinstance(o, Text) and o.sid else 'BigNum' if isinstance(o, BigNum) else o.type.capitalize()
+            sids, langs, tables = self._string_tables(project, [o for objs in all_flat.values() for o in objs])
+            localized = {n: [o for o in objs if isinstance(o, Text) and o.sid] for n, objs in all_flat.items()}
+            if sids:
+                h.append('// STRING TABLES')
+                h.append(f'namespace UI_Str {{ enum : uint16_t {{ {", ".join(sids)}, COUNT }}; }}')
+                h.append(f'namespace UI_Lang {{ enum : uint8_t {{ {", ".join(langs)}, COUNT }}; }}')
+                h.append('extern const UI_StringTable UI_STRINGS[UI_Lang::COUNT];'); h.append('')
             for s_name, objs in all_flat.items():
                 h.append(f'struct Layout_{s_name} {{')
+                h.append(f'    enum : int16_t {{ WIDTH = {dims[s_name][0]}, HEIGHT = {dims[s_name][1]} }};')
                 for o in objs:
-                    h.append(f'    static const UI_{o.type.capitalize()} {o.name};')
-                h.append('};'); h.append(f'void drawScreen_{s_name}(SerialUI& ui);'); h.append('')
+                    h.append(f'    static const UI_{ctype(o)} {o.name};')
+                h.append('};'); h.append(f'void drawScreen_{s_name}(SerialUI& ui);')
+                if localized[s_name]: h.append(f'void relabelScreen_{s_name}(SerialUI& ui, uint8_t lang);')
+                h.append('')
 
             h.append('// USER FUNCTIONS')
             for f in project.functions:
                 h.append(f'void {f.name}(SerialUI& ui{", " + f.signature if f.signature else ""});')
 
             h.append('\n#endif')
-            Path(self.H_FILE).write_text("\n".join(h), encoding="utf-8")
+            h_txt = "\n".join(h)
+            (self.out_dir / self.H_FILE).write_text(h_txt, encoding="utf-8")
 
             cpp = ['#include "ui_layout.h"', '', '// RESOURCES']
             processed_fh = set()
@@ -1366,68 +3840,247 @@ class ProjectManager:
                             cpp.append(f'const char RES_{o.name}_L{i}[] PROGMEM = "{c_escape(line)}";')
                         arr = ", ".join([f"RES_{o.name}_L{i}" for i in range(len(o.lines))])
                         cpp.append(f'const char* const RES_{o.name}_ARR[] PROGMEM = {{ {arr} }};\n')
+            if sids:
+                cpp.append('// STRING TABLES (byte-pair compressed)')
+                for lang, (data, offs, pairs, raw) in tables.items():
+                    codes = [0] * 32
+                    for c, _, _ in pairs: codes[c >> 3] |= 1 << (c & 7)
+                    cpp.append(f'// {lang}: {raw} bytes of text -> {len(data)} + {3 * len(pairs)} dictionary')
+                    cpp.append(f'const uint8_t STR_{lang}_DATA[] PROGMEM = {{ {", ".join(map(str, data))} }};')
+                    cpp.append(f'const uint16_t STR_{lang}_OFS[] PROGMEM = {{ {", ".join(map(str, offs))} }};')
+                    cpp.append(f'const uint8_t STR_{lang}_PAIRS[] PROGMEM = {{ {", ".join(str(b) for t in pairs for b in t) or "0"} }};')
+                    cpp.append(f'const uint8_t STR_{lang}_CODES[] PROGMEM = {{ {", ".join(map(str, codes))} }};')
+                rows = ", ".join(f'{{ STR_{l}_DATA, STR_{l}_OFS, STR_{l}_PAIRS, STR_{l}_CODES, {len(t[2])} }}' for l, t in tables.items())
+                cpp.append(f'const UI_StringTable UI_STRINGS[UI_Lang::COUNT] PROGMEM = {{ {rows} }};\n')
+            nums = [o for objs in all_flat.values() for o in objs if isinstance(o, BigNum)]
+            if nums:
+                cpp.append('// BIG NUMBER STATE (segments on screen)')
+                sizes: Dict[str, int] = {}
+                for o in nums: sizes[o.name] = max(sizes.get(o.name, 0), o.digits)
+                for nm, n in sizes.items(): cpp.append(f'static uint8_t BIGNUM_{nm}[{n}];')
+                cpp.append('')
             cpp.append('// IMPLEMENTATION')
             for s_name, objs in all_flat.items():
                 for o in objs:
-                    cpp.append(f'const UI_{o.type.capitalize()} Layout_{s_name}::{o.name} = {o.cpp_struct_init()};')
+                    cpp.append(f'const UI_{ctype(o)} Layout_{s_name}::{o.name} = {o.cpp_struct_init()};')
                 cpp.append(f'\nvoid drawScreen_{s_name}(SerialUI& ui) {{')
+                cpp.append(f'    SERIALUI_TRACE_CALL("drawScreen_{s_name}");')
+                if localized[s_name]: cpp.append('    ui.setStrings(UI_STRINGS);')
                 for o in objs:
                     cpp.append(f'    ui.draw(Layout_{s_name}::{o.name});')
                 cpp.append('}\n')
+                if localized[s_name]:
+                    cpp.append(f'// Switches language, repainting only text cells that change.')
+                    cpp.append(f'void relabelScreen_{s_name}(SerialUI& ui, uint8_t lang) {{')
+                    cpp.append(f'    SERIALUI_TRACE_CALL("relabelScreen_{s_name}");')
+                    cpp.append('    uint8_t prev = ui.language();')
+                    cpp.append('    ui.setStrings(UI_STRINGS); ui.setLanguage(lang);')
+                    for o in localized[s_name]:
+                        cpp.append(f'    ui.relabel(Layout_{s_name}::{o.name}, prev);')
+                    cpp.append('}\n')
+
+            blits = [(s_name, o) for s_name, objs in all_flat.items() for o in objs if ctype(o) in ('Box', 'Text', 'Line', 'Freehand')]
+            if blits:
+                cpp.append('#ifdef SERIALUI_BINARY')
+                cpp.append('// Element ids for the binary protocol: a BLIT names the index in this table.')
+                cpp.append('static const UI_ElementRef UI_ELEMENTS[] PROGMEM = {')
+                for s_name, o in blits:
+                    cpp.append(f'    {{ &Layout_{s_name}::{o.name}, UI_ElementTable::{ctype(o).upper()} }},')
+                cpp.append('};')
+                cpp.append(f'static const UI_ElementTable UI_ELEMENT_TABLE(UI_ELEMENTS, {len(blits)});')
+                cpp.append('#endif\n')
+
+            lz, heads = self._lz_dictionary([o for objs in all_flat.values() for o in objs])
+            cpp.append('#ifdef SERIALUI_COMPRESS')
+            cpp.append('// Stream compression dictionary: common escape sequences, then the project\'s strings.')
+            cpp.append(f'static const uint8_t LZ_DICT[] PROGMEM = {{ {", ".join(map(str, lz))} }};')
+            cpp.append(f'static const uint16_t LZ_HEADS[256] PROGMEM = {{ {", ".join(map(str, heads))} }};')
+            cpp.append(f'static const UI_LzDict UI_LZ_DICT(LZ_DICT, {len(lz)}, LZ_HEADS);')
+            cpp.append('#endif\n')
 
             cpp.append('// USER FUNCTIONS IMPLEMENTATION')
             for f in project.functions:
                 cpp.append(f'void {f.name}(SerialUI& ui{", " + f.signature if f.signature else ""}) {{')
+                cpp.append(f'    SERIALUI_TRACE_CALL("{f.name}");')
                 cpp.append(f'    {f.body}')
                 cpp.append('}\n')
 
-            Path(self.CPP_FILE).write_text("\n".join(cpp), encoding="utf-8")
+            cpp_txt = "\n".join(cpp)
+            (self.out_dir / self.CPP_FILE).write_text(cpp_txt, encoding="utf-8")
         except Exception as e: raise
+        flat = [o for objs in all_flat.values() for o in objs]
+        return {
+            'project': self.project_file, 'out': str(self.out_dir),
+            'screens': len(project.screens), 'elements': len(flat), 'functions': len(project.functions),
+            'h_bytes': len(h_txt.encode('utf-8')), 'cpp_bytes': len(cpp_txt.encode('utf-8')),
+            'string_bytes': sum(len(o.content) + 1 for o in flat if isinstance(o, Text) and not o.sid)
+                            + sum(len(ln) + 1 for o in flat if isinstance(o, Freehand) for ln in o.lines)
+                            + sum(len(d) + 2 * len(of) + 3 * len(pr) + 32 for d, of, pr, _ in tables.values()),
+            'paint_cells': max((sum(self._cells(o) for o in objs) for objs in all_flat.values()), default=0),
+            'ms': round((time.perf_counter() - t0) * 1000, 1),
+        }
+
+    def _project_from_data(self, data) -> Project:
+        if isinstance(data, list):
+            screens_data = data
+            functions_data = []
+        else:
+            screens_data = data.get('screens', [])
+            functions_data = data.get('functions', [])
+
+        screens: List[Screen] = [self._screen_from_data(s) for s in screens_data]
+        functions = self._functions_from_data(functions_data)
+        if not screens: screens = [Screen("Main")]
+        proj = Project(screens, functions)
+        if isinstance(data, dict): self._strings_from_data(proj, data)
+        return proj
+
+    def _strings_from_data(self, proj: Project, data: Dict[str, Any]):
+        proj.languages = [str(l) for l in data.get('languages', [])] or ["en"]
+        proj.strings = {str(k): {str(l): str(t) for l, t in v.items()} for k, v in data.get('strings', {}).items()}
+
+    def _screen_from_data(self, s: Dict[str, Any]) -> Screen:
+        scr = Screen(s.get('name', 'Main'), width=int(s.get('width', 80)), height=int(s.get('height', 24)))
+        for o in s.get('objects', []):
+            elem = UIElement.from_dict(o)
+            if elem:
+                scr.objects.append(elem)
+        return scr
+
+    def _functions_from_data(self, functions_data: List[Dict[str, Any]]) -> List[UserFunction]:
+        functions: List[UserFunction] = []
+        for f in functions_data:
+            functions.append(UserFunction(
+                name=f.get('name', ''),
+                signature=f.get('signature', ''),
+                body=f.get('body', ''),
+                test_cases=list(f.get('test_cases', []))
+            ))
+        return functions
+
+    def _state_data(self, project: Project) -> Dict[str, Any]:
+        d = {
+            'screens': [self._screen_data(s) for s in project.screens],
+            'functions': [asdict(f) for f in project.functions]
+        }
+        if project.strings or project.languages != ["en"]: d.update(self._strings_data(project))
+        return d
+
+    def _strings_data(self, project: Project) -> Dict[str, Any]:
+        return {'languages': list(project.languages), 'strings': {k: dict(v) for k, v in project.strings.items()}}
+
+    def _screen_data(self, s: Screen) -> Dict[str, Any]:
+        return {'name': s.name, 'width': s.width, 'height': s.height, 'objects': [o.to_dict() for o in s.objects]}
 
     def load_project(self) -> Project:
         try:
             p = Path(self.project_file)
-            if not p.exists(): return Project([Screen("Main")], [])
-            txt = p.read_text(encoding="utf-8")
-            data = json.loads(txt) if txt else []
-
-            if isinstance(data, list):
-                screens_data = data
-                functions_data = []
+            if p.exists():
+                txt = p.read_text(encoding="utf-8")
+                self.base_hash = hashlib.sha1(txt.encode("utf-8")).hexdigest()
+                proj = self._project_from_data(json.loads(txt) if txt else [])
             else:
-                screens_data = data.get('screens', [])
-                functions_data = data.get('functions', [])
-
-            screens: List[Screen] = []
-            for s in screens_data:
-                scr = Screen(s.get('name', 'Main'))
-                for o in s.get('objects', []):
-                    elem = UIElement.from_dict(o)
-                    if elem:
-                        scr.objects.append(elem)
-                screens.append(scr)
-
-            functions: List[UserFunction] = []
-            for f in functions_data:
-                functions.append(UserFunction(
-                    name=f.get('name', ''),
-                    signature=f.get('signature', ''),
-                    body=f.get('body', ''),
-                    test_cases=list(f.get('test_cases', []))
-                ))
-
-            if not screens: screens = [Screen("Main")]
-            return Project(screens, functions)
+                proj = Project([Screen("Main")], [])
+        except Exception:
+            proj = Project([Screen("Main")], [])
+        self.recovered = self.journal_count = self._replay_journal(proj)
+        return proj
+
+    # Journal: one JSON record per line, applied in order
+    #   {"k": "base", "h": sha1 of the project file the journal continues}   first line
+    #   {"k": "obj", "s": screen, "i": index, "o": element}   replace a top-level element
+    #   {"k": "ins", "s": screen, "i": index, "o": element}   {"k": "del", "s": screen, "i": index}
+    #   {"k": "swap"|"mv", "s": screen, "i": index, "j": index}   reorder (mv: pop i, insert at j)
+    #   {"k": "scr", "s": screen, "width": ..., "height": ...}   screen fields (canvas size)
+    #   {"k": "names", "v": [screen names]}   {"k": "fns", "v": [functions]}
+    #   {"k": "all", "v": full state}
+    # A journal whose base is not the current project file was already folded into it
+    # (a crash between compaction and removing the journal) and is dropped.
+    def journal(self, project: Project, rec: Dict[str, Any]):
+        try:
+            with open(self.journal_file, "a", encoding="utf-8") as f:
+                if not self._journal_live:
+                    f.write(json.dumps({'k': 'base', 'h': self.base_hash}) + "\n")
+                    self._journal_live = True
+                f.write(json.dumps(rec, separators=(',', ':')) + "\n")
+            self.journal_count += 1
+        except Exception:
+            return
+        if self.journal_count >= self.JOURNAL_COMPACT:
+            self.save_json_state(project)
+
+    def _replay_journal(self, project: Project) -> int:
+        """Apply the journal's records; returns how many. A torn tail from a crash
+        mid-write is cut off, so records appended later are not lost behind it."""
+        self._journal_live = False
+        try:
+            raw = Path(self.journal_file).read_bytes()
         except Exception:
-            return Project([Screen("Main")], [])
+            return 0
+        n = good = 0
+        for ln in raw.splitlines(keepends=True):
+            try:
+                if not ln.endswith(b"\n"): break
+                rec = json.loads(ln)
+                if rec['k'] == 'base':
+                    if good or rec['h'] != self.base_hash: break
+                else: self._apply_record(project, rec); n += 1
+            except Exception:
+                break
+            good += len(ln)
+        if good < len(raw):
+            try:
+                with open(self.journal_file, "r+b") as f: f.truncate(good)
+            except Exception: pass
+        self._journal_live = good > 0
+        return n
+
+    def _apply_record(self, project: Project, rec: Dict[str, Any]):
+        k = rec['k']; scr = project.screens
+        if k == 'obj':
+            objs = scr[rec['s']].objects; elem = UIElement.from_dict(rec['o'])
+            if elem is None: return
+            if rec['i'] < len(objs): objs[rec['i']] = elem
+            else: objs.append(elem)
+        elif k == 'ins':
+            elem = UIElement.from_dict(rec['o'])
+            if elem is not None: scr[rec['s']].objects.insert(rec['i'], elem)
+        elif k == 'del':
+            del scr[rec['s']].objects[rec['i']]
+        elif k == 'swap':
+            objs = scr[rec['s']].objects; i, j = rec['i'], rec['j']
+            objs[i], objs[j] = objs[j], objs[i]
+        elif k == 'mv':
+            objs = scr[rec['s']].objects; objs.insert(rec['j'], objs.pop(rec['i']))
+        elif k == 'scr':
+            for key in ('width', 'height'):
+                if key in rec: setattr(scr[rec['s']], key, rec[key])
+        elif k == 'names':
+            for i, nm in enumerate(rec['v']):
+                if i < len(scr): scr[i].name = nm
+                else: scr.append(Screen(nm))
+        elif k == 'fns':
+            project.functions = self._functions_from_data(rec['v'])
+        elif k == 'strs':
+            self._strings_from_data(project, rec)
+        elif k == 'all':
+            fresh = self._project_from_data(rec['v'])
+            project.screens, project.functions = fresh.screens, fresh.functions
+            project.languages, project.strings = fresh.languages, fresh.strings
 
     def save_json_state(self, project: Project):
+        """Write the whole project (atomically) and drop the journal it now contains."""
         try:
-            data = {
-                'screens': [{'name': s.name, 'objects': [o.to_dict() for o in s.objects]} for s in project.screens],
-                'functions': [asdict(f) for f in project.functions]
-            }
-            Path(self.project_file).write_text(json.dumps(data, indent=2), encoding="utf-8")
+            p = Path(self.project_file); tmp = p.with_name(p.name + ".tmp")
+            txt = json.dumps(self._state_data(project), indent=2)
+            with open(tmp, "w", encoding="utf-8") as f:
+                f.write(txt)
+                f.flush(); os.fsync(f.fileno())
+            os.replace(tmp, p)
+            self.base_hash = hashlib.sha1(txt.encode("utf-8")).hexdigest(); self._journal_live = False
+            try: os.remove(self.journal_file)
+            except FileNotFoundError: pass
+            self.journal_count = 0
         except Exception:
             pass
 
@@ -1446,7 +4099,11 @@ class TemplateManager:
         return [
             FunctionTemplate("Basic Update", "ALL", "const char* msg", "ui.drawText(Layout_{{screen_name}}::{{obj_name}}.x, Layout_{{screen_name}}::{{obj_name}}.y, msg, Layout_{{screen_name}}::{{obj_name}}.color);"),
             FunctionTemplate("Progress Update", "BOX", "float val", "ui.drawProgressBar(Layout_{{screen_name}}::{{obj_name}}, val, UI_Color::GREEN);"),
+            FunctionTemplate("Steady Progress", "BOX", "uint8_t percent", "static UI_BarState st(1); // 1% hysteresis\n    ui.drawProgress(Layout_{{screen_name}}::{{obj_name}}, percent, 100, UI_Color::GREEN, st);"),
+            FunctionTemplate("Smooth Bar", "BOX", "uint16_t val", "static UI_BarState st;\n    ui.drawBar(Layout_{{screen_name}}::{{obj_name}}, val, 1000, UI_Color::GREEN, st);"),
+            FunctionTemplate("Braille Plot", "BOX", "int16_t val", "static UI_Canvas<{{cols}}, {{rows}}> cv(Layout_{{screen_name}}::{{obj_name}}, UI_Color::GREEN);\n    static int16_t x = 0, last = 0;\n    if (x >= cv.width()) { x = 0; cv.clear(); }\n    int16_t y = cv.height() - 1 - (int32_t)val * (cv.height() - 1) / 100;\n    if (x) cv.line(x - 1, last, x, y); else cv.setPixel(x, y);\n    last = y; x++;\n    ui.drawCanvas(cv);"),
             FunctionTemplate("Sensor Display", "TEXT", "float val", "ui.printfText(Layout_{{screen_name}}::{{obj_name}}, \"%0.2f\", val);"),
+            FunctionTemplate("Big Number", "BIGNUM", "long val", "ui.drawBigNumber(Layout_{{screen_name}}::{{obj_name}}, val, 1);"),
             FunctionTemplate("Toggle Color", "ALL", "UI_Color c", "UI_{{type}} obj = Layout_{{screen_name}}::{{obj_name}};\n    obj.color = c;\n    ui.draw(obj);")
         ]
 
@@ -1464,11 +4121,220 @@ class TemplateManager:
             Path(self.FILE).write_text(json.dumps(data, indent=2), encoding="utf-8")
         except: pass
 
+# ------------------------------
+# SpatialIndex (designer hit-testing)
+# ------------------------------
+class SpatialIndex:
+    """Uniform grid of element bounds (x0, y0, x1, y1, inclusive) keyed by object identity.
+
+    Each element is listed in every CW x CH bucket its bounds touch, so point,
+    rectangle and nearest-neighbour queries only look at nearby buckets.
+    """
+    CW, CH = 8, 4
+
+    def __init__(self):
+        self._objs: Dict[int, UIElement] = {}
+        self._rects: Dict[int, tuple] = {}
+        self._cells: Dict[tuple, set] = {}
+
+    def __len__(self) -> int:
+        return len(self._objs)
+
+    def _span(self, r: tuple):
+        for cy in range(r[1] // self.CH, r[3] // self.CH + 1):
+            for cx in range(r[0] // self.CW, r[2] // self.CW + 1):
+                yield (cx, cy)
+
+    def clear(self):
+        self._objs.clear(); self._rects.clear(); self._cells.clear()
+
+    def insert(self, o: UIElement, r: tuple):
+        k = id(o)
+        if k in self._rects: self.remove(o)
+        self._objs[k] = o; self._rects[k] = r
+        for c in self._span(r):
+            self._cells.setdefault(c, set()).add(k)
+
+    def remove(self, o: UIElement):
+        k = id(o); r = self._rects.pop(k, None)
+        if r is None: return
+        del self._objs[k]
+        for c in self._span(r):
+            b = self._cells.get(c)
+            if b is not None:
+                b.discard(k)
+                if not b: del self._cells[c]
+
+    def update(self, o: UIElement, r: tuple):
+        if self._rects.get(id(o)) != r: self.insert(o, r)
+
+    def bounds(self, o: UIElement) -> Optional[tuple]:
+        return self._rects.get(id(o))
+
+    def at(self, x: int, y: int) -> List[UIElement]:
+        """Elements whose bounds contain (x, y)."""
+        b = self._cells.get((x // self.CW, y // self.CH), ())
+        out = []
+        for k in b:
+            r = self._rects[k]
+            if r[0] <= x <= r[2] and r[1] <= y <= r[3]: out.append(self._objs[k])
+        return out
+
+    def in_rect(self, rect: tuple, contained: bool = False) -> List[UIElement]:
+        """Elements overlapping rect, or only those fully inside it when contained is set."""
+        seen = set(); out = []
+        for c in self._span(rect):
+            for k in self._cells.get(c, ()):
+                if k in seen: continue
+                seen.add(k); r = self._rects[k]
+                if contained:
+                    ok = rect[0] <= r[0] and rect[1] <= r[1] and r[2] <= rect[2] and r[3] <= rect[3]
+                else:
+                    ok = _rect_overlap(rect, r)
+                if ok: out.append(self._objs[k])
+        return out
+
+    def nearest(self, x: int, y: int, skip=()) -> Optional[UIElement]:
+        """Element whose centre is closest to (x, y), ignoring ids in skip. Rows count double (cells are ~1:2)."""
+        if not self._cells: return None
+        def dist(r):
+            # doubled centre offsets keep this integral; area breaks ties
+            cx2 = (r[0] + r[2]) - 2 * x; cy2 = (r[1] + r[3]) - 2 * y
+            return (cx2 * cx2 + 4 * cy2 * cy2, (r[2] - r[0]) * (r[3] - r[1]))
+        gx, gy = x // self.CW, y // self.CH
+        xs = [c[0] for c in self._cells]; ys = [c[1] for c in self._cells]
+        max_ring = max(abs(gx - min(xs)), abs(gx - max(xs)), abs(gy - min(ys)), abs(gy - max(ys)))
+        best = best_d = None
+        for ring in range(max_ring + 1):
+            # anything first met at this ring lies at least (ring - 1) buckets away,
+            # and its centre can be no closer than its edge
+            if best is not None:
+                lo = max(0, ring - 1); lim = 2 * min(lo * self.CW, 2 * lo * self.CH)
+                if lim * lim > best_d[0]: break
+            for cy in range(gy - ring, gy + ring + 1):
+                step = 1 if cy in (gy - ring, gy + ring) else 2 * ring
+                for cx in range(gx - ring, gx + ring + 1, max(1, step)):
+                    for k in self._cells.get((cx, cy), ()):
+                        if k in skip: continue
+                        d = dist(self._rects[k])
+                        if best_d is None or d < best_d: best, best_d = self._objs[k], d
+        return best
+
+# ------------------------------
+# OpLog (designer undo/redo)
+# ------------------------------
+class OpLog:
+    """Bounded undo/redo history of small invertible operations.
+
+    Entries are tuples referencing the live objects and the list they sit in:
+      ('move', obj, dx, dy)            ('set', obj, old_fields, new_fields)
+      ('insert', lst, idx, obj)        ('remove', lst, idx, obj)
+      ('swap', lst, i, j)              ('moveto', lst, i, j)
+      ('group', lst, idxs, meta, x, y) ('ungroup', lst, idx, meta)
+      ('batch', [ops])
+    Undo and redo replay one entry in time proportional to its own size.
+    Consecutive coalescable pushes of the same kind on the same object
+    (arrow-key moves and resizes) merge into one entry until seal().
+    version/last/forward tell observers (the autosave journal) what changed most
+    recently and whether it was applied or undone.
+    """
+    def __init__(self, limit: int = 256):
+        self.undo_ops: "deque[tuple]" = deque(maxlen=limit)
+        self.redo_ops: List[tuple] = []
+        self._open = False
+        self.version = 0
+        self.last: Optional[tuple] = None
+        self.forward = True
+
+    def push(self, op: tuple, coalesce: bool = False):
+        self.redo_ops.clear(); self.version += 1; self.last = op; self.forward = True
+        last = self.undo_ops[-1] if self.undo_ops else None
+        if coalesce and self._open and last and last[0] == op[0] and last[1] is op[1]:
+            if op[0] == 'move':
+                self.undo_ops[-1] = ('move', op[1], last[2] + op[2], last[3] + op[3]); return
+            if op[0] == 'set' and last[2].keys() == op[2].keys():
+                self.undo_ops[-1] = ('set', op[1], last[2], op[3]); return
+        self.undo_ops.append(op)
+        self._open = coalesce
+
+    def seal(self):
+        self._open = False
+
+    def undo(self) -> Optional[tuple]:
+        self._open = False
+        if not self.undo_ops: return None
+        op = self.undo_ops.pop(); self.apply(op, False); self.redo_ops.append(op)
+        self.version += 1; self.last = op; self.forward = False
+        return op
+
+    def redo(self) -> Optional[tuple]:
+        self._open = False
+        if not self.redo_ops: return None
+        op = self.redo_ops.pop(); self.apply(op, True); self.undo_ops.append(op)
+        self.version += 1; self.last = op; self.forward = True
+        return op
+
+    @staticmethod
+    def snapshot(o: UIElement, keys=None) -> Dict[str, Any]:
+        keys = keys or [k for k in vars(o) if k != 'children']
+        return {k: (list(v) if isinstance(v, list) else v) for k, v in ((k, getattr(o, k)) for k in keys)}
+
+    @staticmethod
+    def _shift(o: UIElement, dx: int, dy: int):
+        if hasattr(o, 'x'): o.x += dx; o.y += dy
+        if hasattr(o, 'x1'): o.x1 += dx; o.y1 += dy; o.x2 += dx; o.y2 += dy
+
+    @staticmethod
+    def _pop_obj(lst: list, o: UIElement) -> int:
+        i = next(i for i in range(len(lst) - 1, -1, -1) if lst[i] is o)
+        lst.pop(i); return i
+
+    @classmethod
+    def apply(cls, op: tuple, forward: bool = True):
+        kind = op[0]
+        if kind == 'move':
+            s = 1 if forward else -1; cls._shift(op[1], s * op[2], s * op[3])
+        elif kind == 'set':
+            for k, v in (op[3] if forward else op[2]).items():
+                setattr(op[1], k, list(v) if isinstance(v, list) else v)
+        elif kind in ('insert', 'remove'):
+            _, lst, idx, o = op
+            if (kind == 'insert') == forward: lst.insert(idx, o)
+            else: cls._pop_obj(lst, o)
+        elif kind == 'swap':
+            _, lst, i, j = op; lst[i], lst[j] = lst[j], lst[i]
+        elif kind == 'moveto':
+            _, lst, i, j = op
+            if not forward: i, j = j, i
+            lst.insert(j, lst.pop(i))
+        elif kind == 'group':
+            _, lst, idxs, meta, x, y = op
+            if forward:
+                for c in meta.children: cls._shift(c, -x, -y)
+                for i in reversed(idxs): lst.pop(i)
+                lst.append(meta)
+            else:
+                cls._pop_obj(lst, meta)
+                for i, c in zip(idxs, meta.children):
+                    cls._shift(c, x, y); lst.insert(i, c)
+        elif kind == 'ungroup':
+            _, lst, idx, meta = op
+            if forward:
+                lst.pop(idx)
+                for k, c in enumerate(meta.children):
+                    cls._shift(c, meta.x, meta.y); lst.insert(idx + k, c)
+            else:
+                del lst[idx:idx + len(meta.children)]
+                for c in meta.children: cls._shift(c, -meta.x, -meta.y)
+                lst.insert(idx, meta)
+        elif kind == 'batch':
+            for sub in (op[1] if forward else reversed(op[1])): cls.apply(sub, forward)
+
 # ------------------------------
 # Designer (curses)
 # ------------------------------
 class Mode(Enum):
-    NAV = auto(); BOX_1 = auto(); BOX_2 = auto(); LINE_1 = auto(); LINE_2 = auto(); RESIZE = auto(); GROUP = auto()
+    NAV = auto(); BOX_1 = auto(); BOX_2 = auto(); LINE_1 = auto(); LINE_2 = auto(); RESIZE = auto(); GROUP = auto(); RECT = auto()
 
 class Designer:
     def __init__(self, stdscr, project_file: str):
@@ -1487,8 +4353,25 @@ class Designer:
         self.gui = GuiManager(update_interval=0.20)
         self.gui.ready.wait(3)
         self.msg = "Welcome."
+        # redraw bookkeeping: full repaint, element regions, or just the status line
+        self._dirty_full = True
+        self._dirty_rects: List[tuple] = []
+        self._status_dirty = True
+        self._clip: Optional[tuple] = None
+        # viewport: canvas coordinates of the terminal's top-left cell, and its drawable size
+        self.vx = self.vy = 0
+        self._vw, self._vh = 80, 23
+        # hit-testing: bounds of cur_objs, rebuilt only when the context list changes
+        self.sindex = SpatialIndex()
+        self._sindex_ctx: Optional[list] = None
+        self._tab_seen: set = set()
+        self.ops = OpLog()
+        self._ops_seen = 0
+        self._gui_sent: Dict[str, Any] = {}
         if not self.project.screens:
             self.project.screens = [Screen("Main")]
+        if self.pm.recovered:
+            self.msg = f"Recovered {self.pm.recovered} unsaved edits from {self.pm.journal_file}"
 
     @property
     def cur_screen(self) -> Screen:
@@ -1511,8 +4394,15 @@ class Designer:
         if self.mode == Mode.NAV:
             h.append("--- NAVIGATION MODE ---")
             h.append("Arrows: Move cursor")
-            h.append("Tab: Cycle selection")
+            h.append("Tab: Select nearest (spatial order)")
+            h.append("Enter: Pick object under cursor (repeat to go deeper)")
+            h.append("v: Rectangle select")
+            h.append("z / y: Undo / Redo")
+            h.append("PgUp / PgDn: Scroll view by half a page")
+            h.append("C: Set canvas size (WxH) of this screen")
+            h.append("L: Set languages for string tables")
             h.append("b / l / t: Create Box / Line / Text")
+            h.append("N: Create Big Number (7-segment)")
             if self._valid_sel():
                 o = self.cur_objs[self.sel_idx]
                 h.append(f"\nSELECTED: {o.name} ({o.type})")
@@ -1531,10 +4421,15 @@ class Designer:
             h.append("q: Quit")
         elif self.mode == Mode.GROUP:
             h.append("--- GROUPING MODE ---")
-            h.append("Tab: Cycle selection")
+            h.append("Tab: Select nearest")
             h.append("Space: Toggle item in group")
             h.append("Enter: Confirm Group")
             h.append("Esc: Cancel")
+        elif self.mode == Mode.RECT:
+            h.append("--- RECTANGLE SELECT ---")
+            h.append("Arrows: Move opposite corner")
+            h.append("Enter: Select enclosed items (then Enter groups them)")
+            h.append("Esc: Cancel")
         elif self.mode == Mode.RESIZE:
             h.append("--- RESIZE MODE ---")
             h.append("Arrows: Resize selected object")
@@ -1556,9 +4451,8 @@ class Designer:
         self.msg = "Compiling and Running test..."
         self._update_gui()
         try:
-            # 1. Save state
+            # 1. Generate the layout (the journal already holds the edits)
             self.pm.save_project(self.project)
-            self.pm.save_json_state(self.project)
 
             # 2. Generate test runner
             test_cpp = [
@@ -1572,9 +4466,9 @@ class Designer:
             ]
             Path("test_runner.cpp").write_text("\n".join(test_cpp), encoding="utf-8")
 
-            # 3. Compile
+            # 3. Compile (the output pane renders UTF-8, so block-element gauges are on)
             import subprocess
-            cmd = ["g++", "test_runner.cpp", "ui_layout.cpp", "-o", "test_runner"]
+            cmd = ["g++", "-DSERIALUI_CAPS=UI_CAP_UTF8", "test_runner.cpp", "ui_layout.cpp", "-o", "test_runner"]
             res = subprocess.run(cmd, capture_output=True, text=True)
             if res.returncode != 0:
                 self.gui.display_test_output(f"COMPILATION ERROR:\n{res.stderr}")
@@ -1583,7 +4477,7 @@ class Designer:
 
             # 4. Run
             res = subprocess.run(["./test_runner"], capture_output=True, text=True)
-            self.gui.display_test_output(res.stdout + "\n" + res.stderr)
+            self.gui.display_test_output(res.stdout + "\n" + res.stderr, self.cur_screen.width, self.cur_screen.height)
             self.msg = "Test completed"
 
             # Cleanup
@@ -1596,17 +4490,22 @@ class Designer:
             self.msg = f"Test system error: {e}"
 
     def _update_gui(self):
+        """Send the GUI only the collections that differ from what it was last sent."""
         try:
             f_objs = [f for f in self.project.functions if f.name == self.sel_func_name]
             tc = f_objs[0].test_cases if f_objs else []
-            self.gui.update_state(
-                self._get_detailed_help(),
-                [s.name for s in self.project.screens],
-                self.cur_screen.name,
-                [f.name for f in self.project.functions],
-                [t.name for t in self.tm.templates],
-                tc
-            )
+            state = {
+                'help_text': self._get_detailed_help(),
+                'screens': [s.name for s in self.project.screens],
+                'active_screen': self.cur_screen.name,
+                'functions': [f.name for f in self.project.functions],
+                'templates': [t.name for t in self.tm.templates],
+                'test_cases': list(tc)
+            }
+            changed = {k: v for k, v in state.items() if self._gui_sent.get(k) != v}
+            if changed:
+                self.gui.update_state(**changed)
+                self._gui_sent.update(changed)
         except Exception:
             pass
 
@@ -1638,8 +4537,9 @@ class Designer:
 
         while True:
             self._clamp_sel()
-            self._draw()
             self._process_gui_queue()
+            if self._dirty_full or self._dirty_rects or self._status_dirty:
+                self._draw()
             try: key = self.stdscr.getch()
             except Exception:
                 key = -1
@@ -1647,7 +4547,9 @@ class Designer:
                 curses.napms(20)
                 continue
             if not self._handle_key(key):
+                self.pm.save_json_state(self.project)
                 break
+            self._journal_ops()
             self._update_gui()
 
     def _process_gui_queue(self):
@@ -1671,8 +4573,8 @@ class Designer:
                                 s.name = safe; self.msg = f"Renamed {old}->{safe}"
                 elif cmd == "SAVE_ASSET":
                     if self._valid_sel() and data:
-                        o = self.cur_objs[self.sel_idx]; lib = self.gui._load_lib()
-                        d = o.to_dict(); d['name'] = data; lib[data] = d; self.gui._write_lib(lib)
+                        o = self.cur_objs[self.sel_idx]
+                        d = o.to_dict(); d['name'] = data; self.gui.lib.put(data, d)
                         if self.gui._root:
                             try: self.gui._root.after(0, self.gui._refresh_assets)
                             except Exception: pass
@@ -1688,6 +4590,7 @@ class Designer:
                         snippets = {
                             "Blink": "if ((millis() / 500) % 2) {\n    ui.draw(...);\n} else {\n    ui.fillRect(..., ' ', UI_Color::BLACK);\n}",
                             "Progress": "ui.drawProgressBar(Layout_...::..., val, UI_Color::GREEN);",
+                            "Smooth Bar": "static UI_BarState st;\nui.drawBar(Layout_...::..., val, 1000, UI_Color::GREEN, st);",
                             "Printf": "ui.printfText(Layout_...::..., \"Value: %f\", val);",
                             "Color Swap": "UI_Box b = Layout_...::...;\nb.color = UI_Color::RED;\nui.draw(b);"
                         }
@@ -1758,9 +4661,9 @@ class Designer:
                     except Exception as e:
                         self.msg = f"Compile error: {e}"
                 elif cmd == "INSERT_ASSET":
-                    lib = self.gui._load_lib()
-                    if data in lib:
-                        new_obj = UIElement.from_dict(lib[data])
+                    d = self.gui.lib.get(data)
+                    if d:
+                        new_obj = UIElement.from_dict(d)
                         if new_obj:
                             if hasattr(new_obj, 'x') and hasattr(new_obj, 'y'):
                                 new_obj.x = self.cx; new_obj.y = self.cy
@@ -1773,14 +4676,26 @@ class Designer:
                             base = new_obj.name or "asset"; used = {o.name for o in self.cur_objs}; cnt = 1
                             while new_obj.name in used or not new_obj.name:
                                 new_obj.name = f"{base}_{cnt}"; cnt += 1
-                            self.cur_objs.append(new_obj); self.sel_idx = len(self.cur_objs)-1; self.msg = f"Inserted {new_obj.name}"
+                            self.cur_objs.append(new_obj); self._index().insert(new_obj, self._obj_bounds(new_obj))
+                            self.ops.push(('insert', self.cur_objs, len(self.cur_objs) - 1, new_obj))
+                            self.sel_idx = len(self.cur_objs)-1; self.msg = f"Inserted {new_obj.name}"
+                self._journal_ops()
+                if cmd in ("ADD_SCREEN", "RENAME_SCREEN"):
+                    self.pm.journal(self.project, {'k': 'names', 'v': [sc.name for sc in self.project.screens]})
+                elif cmd in ("ADD_FUNCTION", "EDIT_FUNCTION", "DELETE_FUNCTION", "ADD_TEST_CASE", "EDIT_TEST_CASE", "CLONE_TEST_CASE", "DELETE_TEST_CASE"):
+                    self.pm.journal(self.project, {'k': 'fns', 'v': [asdict(f) for f in self.project.functions]})
+                self._invalidate()
                 self._update_gui()
         except queue.Empty:
             pass
 
     def _handle_key(self, k: int) -> bool:
+        if k not in (curses.KEY_UP, curses.KEY_DOWN, curses.KEY_LEFT, curses.KEY_RIGHT):
+            self._invalidate(); self.ops.seal()
         if k == 27:
-            if self.edit_stack:
+            if self.mode == Mode.RECT:
+                self.mode = Mode.NAV; self.msg = "Cancelled"
+            elif self.edit_stack:
                 self.edit_stack.pop(); self.sel_idx = -1; self.msg = "Returned"
             else:
                 self.mode = Mode.NAV; self.sel_idx = -1; self.msg = "Cancelled"
@@ -1795,22 +4710,42 @@ class Designer:
         if dx or dy:
             if self.mode == Mode.NAV and self._valid_sel():
                 o = self.cur_objs[self.sel_idx]
+                before = self._obj_bounds(o)
                 if hasattr(o, 'x'):
                     o.x += dx; o.y += dy
                 if hasattr(o, 'x1'):
                     o.x1 += dx; o.y1 += dy; o.x2 += dx; o.y2 += dy
+                self.ops.push(('move', o, dx, dy), coalesce=True)
+                after = self._obj_bounds(o); self._index().update(o, after)
+                self._invalidate(_rect_union(before, after))
+                self._reveal(after)
             elif self.mode == Mode.RESIZE and self._valid_sel():
                 o = self.cur_objs[self.sel_idx]
+                before = self._obj_bounds(o)
+                keys = ('w', 'h') if isinstance(o, Box) else ('digits',) if isinstance(o, BigNum) else ('x2', 'y2')
+                old = OpLog.snapshot(o, keys) if isinstance(o, (Box, Line, BigNum)) else None
                 if isinstance(o, Box):
                     o.w = max(1, o.w + dx)
                     o.h = max(1, o.h + dy)
+                elif isinstance(o, BigNum):
+                    o.digits = max(1, min(16, o.digits + dx))
                 elif isinstance(o, Line):
                     o.x2 += dx
                     o.y2 += dy
+                if old is not None: self.ops.push(('set', o, old, OpLog.snapshot(o, keys)), coalesce=True)
+                after = self._obj_bounds(o); self._index().update(o, after)
+                self._invalidate(_rect_union(before, after))
+                self._reveal(after)
             else:
                 self.cx += dx; self.cy += dy
-                h, w = self.stdscr.getmaxyx()
-                self.cx = max(0, min(w-1, self.cx)); self.cy = max(0, min(h-2, self.cy))
+                self._clamp_cursor()
+                if self.mode == Mode.RECT: self._invalidate()
+                self._status_dirty = True
+            return True
+
+        if k in (curses.KEY_NPAGE, curses.KEY_PPAGE):
+            self.cy += (self._vh // 2) * (1 if k == curses.KEY_NPAGE else -1)
+            self._clamp_cursor()
             return True
 
         if self.mode == Mode.NAV:
@@ -1822,25 +4757,44 @@ class Designer:
                     self.msg = f"Save failed: {e}"
                 return True
             if k == 9:  # Tab
-                if self.cur_objs:
-                    self.sel_idx = 0 if self.sel_idx < 0 else (self.sel_idx + 1) % len(self.cur_objs)
+                self._tab_next()
+            if k in (10, 13):
+                self._pick()
+            if k in (ord('z'), ord('y')):
+                self._undo_redo(k == ord('y'))
+            if k == ord('C'):
+                self._set_canvas_size()
+            if k == ord('L'):
+                self._set_languages()
+            if k == ord('v'):
+                self.temp = {'x': self.cx, 'y': self.cy}; self.mode = Mode.RECT
+                self.msg = "SELECT: move to opposite corner -> Enter"
             if k == ord('b'):
                 self.mode = Mode.BOX_1; self.msg = "Box: set start -> Enter"
             if k == ord('l'):
                 self.mode = Mode.LINE_1; self.msg = "Line: set start -> Enter"
             if k == ord('t'):
                 self._create_text()
+            if k == ord('N'):
+                name = f"num_{len(self.cur_objs)}"
+                new = BigNum(name=name, color=Color.WHITE, x=self.cx, y=self.cy, digits=4, sample="1234", layer=len(self.cur_objs))
+                self.cur_objs.append(new); self._index().insert(new, self._obj_bounds(new))
+                self.ops.push(('insert', self.cur_objs, len(self.cur_objs) - 1, new))
+                self.sel_idx = len(self.cur_objs) - 1; self.msg = f"Added {name} (r: digits, e: sample)"
             if k == ord('r') and self._valid_sel():
                 self.mode = Mode.RESIZE
                 self.msg = "RESIZE mode: Arrows to resize, ESC to exit"
             if k == ord('d') and self._valid_sel():
-                try: self.cur_objs.pop(self.sel_idx)
+                try:
+                    o = self.cur_objs.pop(self.sel_idx); self._index().remove(o)
+                    self.ops.push(('remove', self.cur_objs, self.sel_idx, o))
                 except Exception: pass
                 self.sel_idx = -1; self.msg = "Deleted object"
             if k == ord('c') and self._valid_sel():
                 o = self.cur_objs[self.sel_idx]; cl = list(Color)
                 try: idx = cl.index(o.color)
                 except Exception: idx = 0
+                self.ops.push(('set', o, {'color': o.color}, {'color': cl[(idx + 1) % len(cl)]}))
                 o.color = cl[(idx + 1) % len(cl)]; self.msg = "Color changed"
             if k == ord('n') and self._valid_sel():
                 self._rename_obj()
@@ -1849,8 +4803,12 @@ class Designer:
             if k == ord('e') and self._valid_sel():
                 target = self.cur_objs[self.sel_idx]
                 try:
+                    before, old_idx = OpLog.snapshot(target), self.sel_idx
                     target.layer = self.sel_idx
-                    props = self.gui.edit_props_blocking(target)
+                    tr = None
+                    if isinstance(target, Text) and len(self.project.languages) > 1:
+                        tr = {l: self.project.strings.get(target.sid, {}).get(l, "") for l in self.project.languages[1:]}
+                    props = self.gui.edit_props_blocking(target, tr)
                 except Exception:
                     props = None
                 if props is not None:
@@ -1870,12 +4828,24 @@ class Designer:
                         if isinstance(target, Line):
                             target.x1 = int(props.get('x1', target.x1)); target.y1 = int(props.get('y1', target.y1))
                             target.x2 = int(props.get('x2', target.x2)); target.y2 = int(props.get('y2', target.y2))
+                        if isinstance(target, BigNum):
+                            target.x = int(props.get('x', target.x)); target.y = int(props.get('y', target.y))
+                            target.digits = max(1, min(16, int(props.get('digits', target.digits))))
+                            target.sample = str(props.get('sample', target.sample))
                         if isinstance(target, Text):
                             target.content = str(props.get('content', target.content))
+                            target.sid = re.sub(r'[^a-zA-Z0-9_]', '', str(props.get('sid', target.sid)))
+                            if target.sid and props.get('tr') is not None:
+                                self.project.strings[target.sid] = {l: t for l, t in props['tr'].items() if t}
+                                self.pm.journal(self.project, dict(self.pm._strings_data(self.project), k='strs'))
                         if isinstance(target, Freehand):
                             lines = props.get('lines', target.lines)
                             if isinstance(lines, list): target.lines = lines
                             else: target.lines = str(lines).splitlines()
+                        self._sindex_ctx = None
+                        edit = [('set', target, before, OpLog.snapshot(target))]
+                        if self.sel_idx != old_idx: edit.append(('moveto', self.cur_objs, old_idx, self.sel_idx))
+                        self.ops.push(('batch', edit))
                         self.msg = f"Updated {target.name}"
                     except Exception as e:
                         self.msg = f"Edit failed: {e}"
@@ -1889,10 +4859,12 @@ class Designer:
             if (k == ord('+') or k == ord('=')) and self._valid_sel() and self.sel_idx < len(self.cur_objs) - 1:
                 idx = self.sel_idx
                 self.cur_objs[idx], self.cur_objs[idx+1] = self.cur_objs[idx+1], self.cur_objs[idx]
+                self.ops.push(('swap', self.cur_objs, idx, idx + 1))
                 self.sel_idx += 1; self.msg = "Layer UP"
             if (k == ord('-') or k == ord('_')) and self._valid_sel() and self.sel_idx > 0:
                 idx = self.sel_idx
                 self.cur_objs[idx], self.cur_objs[idx-1] = self.cur_objs[idx-1], self.cur_objs[idx]
+                self.ops.push(('swap', self.cur_objs, idx, idx - 1))
                 self.sel_idx -= 1; self.msg = "Layer DOWN"
             if k == ord('o') and self._valid_sel():
                 o = self.cur_objs[self.sel_idx]
@@ -1901,9 +4873,11 @@ class Designer:
             # layer controls
             if k == ord('[') and self._valid_sel() and self.sel_idx > 0:
                 self.cur_objs[self.sel_idx - 1], self.cur_objs[self.sel_idx] = self.cur_objs[self.sel_idx], self.cur_objs[self.sel_idx - 1]
+                self.ops.push(('swap', self.cur_objs, self.sel_idx, self.sel_idx - 1))
                 self.sel_idx -= 1; self.msg = "Moved back"
             if k == ord(']') and self._valid_sel() and self.sel_idx < len(self.cur_objs) - 1:
                 self.cur_objs[self.sel_idx + 1], self.cur_objs[self.sel_idx] = self.cur_objs[self.sel_idx], self.cur_objs[self.sel_idx + 1]
+                self.ops.push(('swap', self.cur_objs, self.sel_idx, self.sel_idx + 1))
                 self.sel_idx += 1; self.msg = "Moved forward"
 
             return True
@@ -1915,7 +4889,16 @@ class Designer:
             elif k in (10, 13):
                 self._do_group()
             elif k == 9: # Tab
-                if self.cur_objs: self.sel_idx = (self.sel_idx + 1) % len(self.cur_objs)
+                self._tab_next()
+            return True
+
+        if self.mode == Mode.RECT:
+            if k in (10, 13):
+                x0, x1 = sorted((self.temp['x'], self.cx)); y0, y1 = sorted((self.temp['y'], self.cy))
+                inside = {id(o) for o in self._index().in_rect((x0, y0, x1, y1), contained=True)}
+                self.group_selection = {i for i, o in enumerate(self.cur_objs) if id(o) in inside}
+                self.mode = Mode.GROUP
+                self.msg = f"{len(self.group_selection)} selected: SPACE to toggle, ENTER to group, ESC to cancel"
             return True
 
         # creation flows
@@ -1926,13 +4909,17 @@ class Designer:
             w = abs(self.temp['x'] - self.cx) + 1; h = abs(self.temp['y'] - self.cy) + 1
             name = f"box_{len(self.cur_objs)}"
             new = Box(name=name, color=Color.WHITE, x=x, y=y, w=w, h=h, layer=len(self.cur_objs))
-            self.cur_objs.append(new); self.sel_idx = len(self.cur_objs) - 1; self.mode = Mode.NAV; self.msg = f"Created {name}"
+            self.cur_objs.append(new); self._index().insert(new, self._obj_bounds(new))
+            self.ops.push(('insert', self.cur_objs, len(self.cur_objs) - 1, new))
+            self.sel_idx = len(self.cur_objs) - 1; self.mode = Mode.NAV; self.msg = f"Created {name}"
         elif self.mode == Mode.LINE_1 and k in (10, 13):
             self.temp = {'x': self.cx, 'y': self.cy}; self.mode = Mode.LINE_2; self.msg = "Line: set end -> Enter"
         elif self.mode == Mode.LINE_2 and k in (10, 13):
             name = f"line_{len(self.cur_objs)}"
             new = Line(name=name, color=Color.WHITE, x1=self.temp['x'], y1=self.temp['y'], x2=self.cx, y2=self.cy, layer=len(self.cur_objs))
-            self.cur_objs.append(new); self.sel_idx = len(self.cur_objs) - 1; self.mode = Mode.NAV; self.msg = f"Created {name}"
+            self.cur_objs.append(new); self._index().insert(new, self._obj_bounds(new))
+            self.ops.push(('insert', self.cur_objs, len(self.cur_objs) - 1, new))
+            self.sel_idx = len(self.cur_objs) - 1; self.mode = Mode.NAV; self.msg = f"Created {name}"
 
         return True
 
@@ -1946,7 +4933,9 @@ class Designer:
             return
         name = f"txt_{len(self.cur_objs)}"
         new = Text(name=name, color=Color.WHITE, x=self.cx, y=self.cy, content=str(txt), layer=len(self.cur_objs))
-        self.cur_objs.append(new); self.sel_idx = len(self.cur_objs) - 1; self.msg = f"Added {name}"
+        self.cur_objs.append(new); self._index().insert(new, self._obj_bounds(new))
+        self.ops.push(('insert', self.cur_objs, len(self.cur_objs) - 1, new))
+        self.sel_idx = len(self.cur_objs) - 1; self.msg = f"Added {name}"
 
     def _generate_function_for_sel(self):
         o = self.cur_objs[self.sel_idx]
@@ -1960,7 +4949,9 @@ class Designer:
         tpl = next(t for t in compatible if t.name == t_name)
 
         def sub(s: str):
-            return s.replace("{{obj_name}}", o.name).replace("{{screen_name}}", self.cur_screen.name).replace("{{type}}", o.type.capitalize())
+            s = s.replace("{{obj_name}}", o.name).replace("{{screen_name}}", self.cur_screen.name).replace("{{type}}", o.type.capitalize())
+            # box interior in cells, for templates that size buffers at compile time
+            return s.replace("{{cols}}", str(max(1, getattr(o, "w", 3) - 2))).replace("{{rows}}", str(max(1, getattr(o, "h", 3) - 2)))
 
         fname = f"update_{o.name}"
         fsig = sub(tpl.signature_pattern)
@@ -1981,20 +4972,58 @@ class Designer:
             new_func.test_cases.append(f"{fname}(ui);")
 
         self.project.functions.append(new_func)
+        self.pm.journal(self.project, {'k': 'fns', 'v': [asdict(f) for f in self.project.functions]})
         self.msg = f"Applied template {t_name} -> {fname}"
 
-    def _rename_obj(self):
+    def _prompt(self, label: str) -> str:
         curses.echo()
         try:
-            self.stdscr.addstr(0, 0, "New Name: "); t = self.stdscr.getstr().decode('utf-8')
+            self.stdscr.addstr(0, 0, label); t = self.stdscr.getstr().decode('utf-8')
         except Exception:
             t = ""
         finally:
             curses.noecho()
+        return t
+
+    def _set_canvas_size(self):
+        scr = self.cur_screen
+        m = re.match(r'\s*(\d+)\s*[x, ]\s*(\d+)\s*$', self._prompt(f"Canvas WxH [{scr.width}x{scr.height}]: "))
+        if not m:
+            self.msg = "Canvas unchanged"; return
+        w, h = max(1, min(1000, int(m.group(1)))), max(1, min(1000, int(m.group(2))))
+        self.ops.push(('set', scr, {'width': scr.width, 'height': scr.height}, {'width': w, 'height': h}))
+        scr.width, scr.height = w, h
+        self._clamp_cursor(); self.msg = f"Canvas {w}x{h}"
+
+    def _set_languages(self):
+        langs = self._prompt(f"Languages, base first [{','.join(self.project.languages)}]: ")
+        langs = [l for l in (re.sub(r'[^a-zA-Z0-9_]', '', x) for x in langs.split(',')) if l]
+        if not langs:
+            self.msg = "Languages unchanged"; return
+        self.project.languages = list(dict.fromkeys(langs))
+        self.pm.journal(self.project, dict(self.pm._strings_data(self.project), k='strs'))
+        self.msg = f"Languages: {', '.join(self.project.languages)}"
+
+    def _clamp_cursor(self):
+        """Keep the cursor on the canvas (or the terminal, if larger) and scroll the view to it."""
+        lw, lh = max(self.cur_screen.width, self._vw), max(self.cur_screen.height, self._vh)
+        self.cx = max(0, min(lw - 1, self.cx)); self.cy = max(0, min(lh - 1, self.cy))
+        self._reveal((self.cx, self.cy, self.cx, self.cy))
+
+    def _reveal(self, r: tuple):
+        """Scroll the view by the least amount that shows rect r (its top-left corner if it does not fit)."""
+        vx = max(0, min(max(self.vx, r[2] - self._vw + 1), r[0]))
+        vy = max(0, min(max(self.vy, r[3] - self._vh + 1), r[1]))
+        if (vx, vy) != (self.vx, self.vy):
+            self.vx, self.vy = vx, vy; self._invalidate()
+
+    def _rename_obj(self):
+        t = self._prompt("New Name: ")
         if t and self._valid_sel():
             safe = re.sub(r'[^a-zA-Z0-9_]', '', t)
             if safe:
-                self.cur_objs[self.sel_idx].name = safe; self.msg = f"Renamed to {safe}"
+                o = self.cur_objs[self.sel_idx]; self.ops.push(('set', o, {'name': o.name}, {'name': safe}))
+                o.name = safe; self.msg = f"Renamed to {safe}"
 
     def _add_ansi_str(self, y: int, x: int, s: str, default_attr: int):
         parts = re.split(r'(\x1b\[[0-9;]*m)', s)
@@ -2026,8 +5055,15 @@ class Designer:
                         except: pass
             else:
                 try:
-                    self.stdscr.addstr(y, cur_x, part, cur_attr)
-                    cur_x += len(part)
+                    if self._clip:
+                        for ch in part:
+                            self._addch(y, cur_x, ch, cur_attr); cur_x += 1
+                    else:
+                        sx, sy = cur_x - self.vx, y - self.vy
+                        seg = part[max(0, -sx):max(0, self._vw - sx)]
+                        if seg and 0 <= sy < self._vh:
+                            self.stdscr.addstr(sy, max(0, sx), seg, cur_attr)
+                        cur_x += len(part)
                 except curses.error: break
 
     def _do_group(self):
@@ -2039,25 +5075,202 @@ class Designer:
             if hasattr(o, 'x'): min_x = min(min_x, o.x); min_y = min(min_y, o.y)
             if hasattr(o, 'x1'): min_x = min(min_x, o.x1, o.x2); min_y = min(min_y, o.y1, o.y2)
         if min_x == 999: min_x = min_y = 0
-        for o in objs:
-            if hasattr(o, 'x'): o.x -= min_x; o.y -= min_y
-            if hasattr(o, 'x1'): o.x1 -= min_x; o.y1 -= min_y; o.x2 -= min_x; o.y2 -= min_y
         name = f"group_{len(self.cur_objs)}"
         new_meta = MetaObject(name=name, color=Color.WHITE, x=min_x, y=min_y, children=objs)
-        for i in sorted(self.group_selection, reverse=True): self.cur_objs.pop(i)
-        self.cur_objs.append(new_meta); self.sel_idx = len(self.cur_objs)-1
+        op = ('group', self.cur_objs, sorted(self.group_selection), new_meta, min_x, min_y)
+        OpLog.apply(op); self.ops.push(op)
+        self.sel_idx = len(self.cur_objs)-1
+        idx = self._index()
+        for o in objs: idx.remove(o)
+        idx.insert(new_meta, self._obj_bounds(new_meta))
         self.group_selection = set(); self.mode = Mode.NAV; self.msg = f"Created {name}"
 
     def _do_ungroup(self):
         o = self.cur_objs[self.sel_idx]
         if not isinstance(o, MetaObject): self.msg = "Not a group"; return
-        for c in o.children:
-            if hasattr(c, 'x'): c.x += o.x; c.y += o.y
-            if hasattr(c, 'x1'): c.x1 += o.x; c.y1 += o.y; c.x2 += o.x; c.y2 += o.y
-        idx = self.sel_idx; self.cur_objs.pop(idx)
-        for c in reversed(o.children): self.cur_objs.insert(idx, c)
+        op = ('ungroup', self.cur_objs, self.sel_idx, o)
+        OpLog.apply(op); self.ops.push(op)
+        si = self._index(); si.remove(o)
+        for c in o.children: si.insert(c, self._obj_bounds(c))
         self.sel_idx = -1; self.msg = f"Ungrouped {o.name}"
 
+    def _invalidate(self, rect: Optional[tuple] = None):
+        """Schedule a repaint of rect (x0, y0, x1, y1, inclusive) or, with no rect, of everything."""
+        if rect is None: self._dirty_full = True
+        else: self._dirty_rects.append(rect)
+
+    def _journal_ops(self):
+        """Append the state touched by the latest edit to the autosave journal."""
+        if self.ops.version == self._ops_seen: return
+        self._ops_seen = self.ops.version
+        for rec in self._journal_records(self.ops.last, self.ops.forward):
+            self.pm.journal(self.project, rec)
+
+    def _journal_records(self, op: tuple, forward: bool = True) -> List[Dict[str, Any]]:
+        """Records that replay op (already applied, or undone when not forward) on the saved state."""
+        if op[0] == 'batch':
+            return [r for sub in (op[1] if forward else reversed(op[1])) for r in self._journal_records(sub, forward)]
+        target = op[1]  # the edited object, or the list an element was added to/removed from/reordered in
+        for si, scr in enumerate(self.project.screens):
+            if scr.objects is target:  # a screen's own list: record just the index-level change
+                return self._list_records(op, forward, si)
+            if scr is target:  # a 'set' on the screen itself: its fields as they are now
+                return [{'k': 'scr', 's': si, **{key: getattr(scr, key) for key in op[2]}}]
+        # otherwise re-record the top-level element that contains the change
+        def contains(o, t) -> bool:
+            if o is t: return True
+            return isinstance(o, MetaObject) and (o.children is t or any(contains(c, t) for c in o.children))
+        top = self.edit_stack[0] if self.edit_stack else target  # usual case: the edit happened here
+        for i, o in enumerate(self.cur_screen.objects):
+            if o is top:
+                if contains(top, target): return [{'k': 'obj', 's': self.act_idx, 'i': i, 'o': top.to_dict()}]
+                break
+        for si, scr in enumerate(self.project.screens):
+            for i, top in enumerate(scr.objects):
+                if contains(top, target):
+                    return [{'k': 'obj', 's': si, 'i': i, 'o': top.to_dict()}]
+        return [{'k': 'all', 'v': self.pm._state_data(self.project)}]  # op on a detached list
+
+    @staticmethod
+    def _list_records(op: tuple, forward: bool, si: int) -> List[Dict[str, Any]]:
+        kind, lst = op[0], op[1]
+        ins = lambda i, o: {'k': 'ins', 's': si, 'i': i, 'o': o.to_dict()}
+        dl = lambda i: {'k': 'del', 's': si, 'i': i}
+        if kind in ('insert', 'remove'):
+            return [ins(op[2], op[3])] if (kind == 'insert') == forward else [dl(op[2])]
+        if kind == 'swap': return [{'k': 'swap', 's': si, 'i': op[2], 'j': op[3]}]
+        if kind == 'moveto':
+            i, j = (op[2], op[3]) if forward else (op[3], op[2])
+            return [{'k': 'mv', 's': si, 'i': i, 'j': j}]
+        if kind == 'group':
+            idxs, meta = op[2], op[3]
+            if forward: return [dl(i) for i in reversed(idxs)] + [ins(len(lst) - 1, meta)]
+            return [dl(len(lst) - len(idxs))] + [ins(i, c) for i, c in zip(idxs, meta.children)]
+        if kind == 'ungroup':
+            idx, meta = op[2], op[3]
+            if forward: return [dl(idx)] + [ins(idx + k, c) for k, c in enumerate(meta.children)]
+            return [dl(idx) for _ in meta.children] + [ins(idx, meta)]
+        return []
+
+    def _undo_redo(self, redo: bool = False):
+        op = self.ops.redo() if redo else self.ops.undo()
+        if op is None:
+            self.msg = "Nothing to redo" if redo else "Nothing to undo"; return
+        self.group_selection = set()
+        left = self._leave_detached_groups() if self.edit_stack and op[0] in ('group', 'ungroup', 'remove', 'insert', 'batch') else None
+        self._reindex(op, redo)
+        if left:
+            self.msg = f"{'Redo' if redo else 'Undo'}: {op[0]}; left {left}, which is no longer in the screen"; return
+        while op[0] == 'batch': op = op[1][0]
+        target = op[3] if op[0] in ('insert', 'remove', 'group', 'ungroup') else (op[1] if op[0] in ('move', 'set') else None)
+        if op[0] in ('move', 'set'): pos = self._pos_of(target, self.sel_idx)
+        elif target is None or op[1] is not self.cur_objs: pos = -1
+        else:  # where the entry put its element, if it is in the list now
+            at = op[2] if op[0] != 'group' else (len(op[1]) - 1 if redo else op[2][0])
+            pos = at if 0 <= at < len(op[1]) and op[1][at] is target else -1
+        self.sel_idx = pos if pos >= 0 else self.sel_idx
+        self.msg = f"{'Redo' if redo else 'Undo'}: {op[0]}" + (f" {target.name}" if target is not None else "")
+
+    def _index(self) -> SpatialIndex:
+        """Spatial index of cur_objs; edits keep it current, a context switch rebuilds it once."""
+        objs = self.cur_objs
+        if self._sindex_ctx is not objs:
+            self.sindex.clear()
+            for o in objs: self.sindex.insert(o, self._obj_bounds(o))
+            self._sindex_ctx = objs; self._tab_seen = set()
+        return self.sindex
+
+    def _leave_detached_groups(self) -> Optional[str]:
+        """Pop edit_stack down to the deepest group still in the screen; returns the name
+        of the outermost group left, or None if every level is still there."""
+        lst, keep = self.cur_screen.objects, 0
+        for meta in self.edit_stack:
+            if not any(o is meta for o in lst): break
+            keep += 1; lst = meta.children
+        if keep == len(self.edit_stack): return None
+        name = self.edit_stack[keep].name
+        del self.edit_stack[keep:]
+        self.sel_idx = -1; self._sindex_ctx = None
+        return name
+
+    def _reindex(self, op: tuple, forward: bool):
+        """Bring the spatial index up to date after op was redone (forward) or undone."""
+        if self._sindex_ctx is not self.cur_objs: return  # rebuilt on next use anyway
+        kind, si = op[0], self.sindex
+        if kind == 'batch':
+            for sub in (op[1] if forward else reversed(op[1])): self._reindex(sub, forward)
+            return
+        if kind in ('move', 'set'):
+            if si.bounds(op[1]) is not None:
+                si.update(op[1], self._obj_bounds(op[1])); return
+        elif op[1] is self.cur_objs:
+            add: List[UIElement] = []; gone: List[UIElement] = []
+            if kind in ('insert', 'remove'): (add if (kind == 'insert') == forward else gone).append(op[3])
+            elif kind in ('group', 'ungroup'):
+                meta = op[3]
+                add, gone = ([meta], list(meta.children)) if (kind == 'group') == forward else (list(meta.children), [meta])
+            for o in gone: si.remove(o)
+            for o in add: si.insert(o, self._obj_bounds(o))
+            return
+        self._sindex_ctx = None  # another context's list, or an element nested in a group
+
+    def _pos_of(self, o: UIElement, hint: int = -1) -> int:
+        if 0 <= hint < len(self.cur_objs) and self.cur_objs[hint] is o: return hint
+        for i, c in enumerate(self.cur_objs):
+            if c is o: return i
+        return -1
+
+    def _pick(self):
+        """Select the topmost element under the cursor; repeated picks walk down the stack."""
+        hits = {id(o) for o in self._index().at(self.cx, self.cy)}
+        stack = [i for i in range(len(self.cur_objs) - 1, -1, -1) if id(self.cur_objs[i]) in hits]
+        if not stack:
+            self.msg = "Nothing under cursor"; return
+        nxt = stack[(stack.index(self.sel_idx) + 1) % len(stack)] if self.sel_idx in stack else stack[0]
+        self.sel_idx = nxt; self.msg = f"Picked {self.cur_objs[nxt].name}"
+
+    def _tab_next(self):
+        """Move the selection to the nearest element not yet visited in this Tab round."""
+        if not self.cur_objs: return
+        idx = self._index()
+        if self._valid_sel():
+            cur = self.cur_objs[self.sel_idx]; r = idx.bounds(cur) or self._obj_bounds(cur)
+            x, y = (r[0] + r[2]) // 2, (r[1] + r[3]) // 2
+            if id(cur) not in self._tab_seen or len(self._tab_seen) >= len(self.cur_objs):
+                self._tab_seen = {id(cur)}
+        else:
+            x, y = self.cx, self.cy; self._tab_seen = set()
+        o = idx.nearest(x, y, self._tab_seen)
+        if o is None: return
+        self._tab_seen.add(id(o)); self.sel_idx = self._pos_of(o)
+        self._reveal(idx.bounds(o))
+
+    def _obj_bounds(self, o: UIElement, bx: int = 0, by: int = 0) -> tuple:
+        if isinstance(o, Box):
+            return (bx + o.x, by + o.y, bx + o.x + max(1, o.w) - 1, by + o.y + max(1, o.h) - 1)
+        if isinstance(o, Line):
+            return (bx + min(o.x1, o.x2), by + min(o.y1, o.y2), bx + max(o.x1, o.x2), by + max(o.y1, o.y2))
+        if isinstance(o, (Text, Freehand)):
+            lines = (o.content.splitlines() or [""]) if isinstance(o, Text) else (o.lines or [""])
+            w = max(len(ANSI_SGR_RE.sub('', ln)) for ln in lines)
+            return (bx + o.x, by + o.y, bx + o.x + max(1, w) - 1, by + o.y + len(lines) - 1)
+        if isinstance(o, BigNum):
+            return (bx + o.x, by + o.y, bx + o.x + 4 * o.digits - 1, by + o.y + 2)
+        if isinstance(o, MetaObject) and o.children:
+            r = self._obj_bounds(o.children[0], bx + o.x, by + o.y)
+            for c in o.children[1:]: r = _rect_union(r, self._obj_bounds(c, bx + o.x, by + o.y))
+            return r
+        x, y = bx + getattr(o, 'x', 0), by + getattr(o, 'y', 0)
+        return (x, y, x, y)
+
+    def _addch(self, y: int, x: int, ch, attr: int):
+        """Draw at canvas (x, y): clipped to the repaint rect, then mapped through the viewport."""
+        c = self._clip
+        if c and not (c[0] <= x <= c[2] and c[1] <= y <= c[3]): return
+        x -= self.vx; y -= self.vy
+        if 0 <= x < self._vw and 0 <= y < self._vh:
+            self.stdscr.addch(y, x, ch, attr)
+
     def _draw_obj(self, o: UIElement, bx: int, by: int, is_sel: bool, is_in_group: bool = False):
         try:
             attr = curses.color_pair(list(Color).index(o.color) + 1)
@@ -2069,14 +5282,14 @@ class Designer:
         try:
             if isinstance(o, Box):
                 x, y = bx+o.x, by+o.y
-                self.stdscr.addch(y, x, '+', attr)
-                self.stdscr.addch(y + o.h - 1, x + o.w - 1, '+', attr)
+                self._addch(y, x, '+', attr)
+                self._addch(y + o.h - 1, x + o.w - 1, '+', attr)
                 for k in range(1, max(1, o.w - 1)):
-                    self.stdscr.addch(y, x + k, '-', attr)
-                    self.stdscr.addch(y + o.h - 1, x + k, '-', attr)
+                    self._addch(y, x + k, '-', attr)
+                    self._addch(y + o.h - 1, x + k, '-', attr)
                 for k in range(1, max(1, o.h - 1)):
-                    self.stdscr.addch(y + k, x, '|', attr)
-                    self.stdscr.addch(y + k, x + o.w - 1, '|', attr)
+                    self._addch(y + k, x, '|', attr)
+                    self._addch(y + k, x + o.w - 1, '|', attr)
             elif isinstance(o, Text):
                 for r, ln in enumerate(o.content.splitlines() or [""]):
                     self._add_ansi_str(by + o.y + r, bx + o.x, ln, attr)
@@ -2086,7 +5299,7 @@ class Designer:
                 dy, sy = -abs(y2-y1), (1 if y1<y2 else -1)
                 err, cx, cy = dx+dy, x1, y1
                 while True:
-                    self.stdscr.addch(cy, cx, '#', attr)
+                    self._addch(cy, cx, '#', attr)
                     if cx == x2 and cy == y2: break
                     e2 = 2*err
                     if e2 >= dy: err += dy; cx += sx
@@ -2094,55 +5307,743 @@ class Designer:
             elif isinstance(o, Freehand):
                 for r, ln in enumerate(o.lines):
                     self._add_ansi_str(by + o.y + r, bx + o.x, ln, attr)
+            elif isinstance(o, BigNum):
+                for dx, dy, ch in o.cells(): self._addch(by + o.y + dy, bx + o.x + dx, ch, attr)
+                if is_sel:  # show the extent of unlit digits too
+                    for d in range(o.digits): self._addch(by + o.y + 2, bx + o.x + 4 * d + 3, ',', attr | curses.A_DIM)
             elif isinstance(o, MetaObject):
                 for c in o.children:
                     self._draw_obj(c, bx + o.x, by + o.y, False, is_sel)
         except curses.error: pass
 
-    def _draw(self):
-        self.stdscr.clear()
-        if not self.edit_stack:
-            for i, o in enumerate(self.cur_objs):
-                is_sel = (i == self.sel_idx)
-                is_in_group = (i in self.group_selection)
-                self._draw_obj(o, 0, 0, is_sel, is_in_group)
-        else:
-            path = " > ".join([m.name for m in self.edit_stack])
-            self.stdscr.addstr(0, 0, f"EDIT: {path}", curses.A_BOLD | curses.A_UNDERLINE)
+    def _paint(self, clip: Optional[tuple] = None):
+        """Draw the canvas; with a clip rect only elements touching it are visited."""
+        self._clip = clip
+        try:
+            if self.edit_stack:
+                path = " > ".join([m.name for m in self.edit_stack])
+                if clip is None or clip[1] <= 0:
+                    try: self.stdscr.addstr(0, 0, f"EDIT: {path}", curses.A_BOLD | curses.A_UNDERLINE)
+                    except curses.error: pass
+            hits = None if clip is None else {id(o) for o in self._index().in_rect(clip)}
             for i, o in enumerate(self.cur_objs):
-                self._draw_obj(o, 0, 0, i == self.sel_idx, False)
+                if hits is not None and id(o) not in hits:
+                    continue
+                is_in_group = (i in self.group_selection) and not self.edit_stack
+                self._draw_obj(o, 0, 0, i == self.sel_idx, is_in_group)
+            if self.mode == Mode.RECT and clip is None:
+                x0, x1 = sorted((self.temp['x'], self.cx)); y0, y1 = sorted((self.temp['y'], self.cy))
+                for x in range(x0, x1 + 1):
+                    for y in (y0, y1):
+                        try: self._addch(y, x, ':', curses.A_DIM)
+                        except curses.error: pass
+                for y in range(y0 + 1, y1):
+                    for x in (x0, x1):
+                        try: self._addch(y, x, ':', curses.A_DIM)
+                        except curses.error: pass
+        finally:
+            self._clip = None
+
+    def _guides(self, x0: int = 0, y0: int = 0, x1: int = 1 << 30, y1: int = 1 << 30):
+        """Dotted right/bottom edge of the screen's canvas, drawn in terminal cells x0..x1, y0..y1."""
+        sx, sy = self.cur_screen.width - self.vx, self.cur_screen.height - self.vy
+        x1, y1 = min(x1, self._vw - 1), min(y1, self._vh - 1)
+        if x0 <= sx <= x1:
+            for y in range(max(y0, -self.vy), min(y1, sy - 1) + 1):
+                try: self.stdscr.addch(y, sx, ':', curses.A_DIM)
+                except curses.error: pass
+        if y0 <= sy <= y1:
+            a, b = max(x0, -self.vx), min(x1, sx)
+            if a <= b:
+                try: self.stdscr.addstr(sy, a, '.' * (b - a + 1), curses.A_DIM)
+                except curses.error: pass
 
+    def _draw(self):
         h, w = self.stdscr.getmaxyx()
+        if (w, h - 1) != (self._vw, self._vh):
+            self._vw, self._vh = w, max(1, h - 1)
+            self._clamp_cursor(); self._dirty_full = True
+        vx, vy = self.vx, self.vy
+        if self._dirty_full:
+            self.stdscr.erase()
+            self._guides()
+            self._paint()
+        else:
+            for r in self._dirty_rects:
+                x0, y0 = max(0, r[0] - vx), max(0, r[1] - vy)
+                x1, y1 = min(w - 1, r[2] - vx), min(h - 2, r[3] - vy)
+                if x0 > x1 or y0 > y1: continue
+                for y in range(y0, y1 + 1):
+                    try: self.stdscr.addstr(y, x0, " " * (x1 - x0 + 1))
+                    except curses.error: pass
+                self._guides(x0, y0, x1, y1)
+                self._paint((x0 + vx, y0 + vy, x1 + vx, y1 + vy))
+        self._dirty_full = False; self._dirty_rects = []; self._status_dirty = False
+
         sel_name = ""
         if self._valid_sel():
             try: sel_name = f" | Sel: {self.cur_objs[self.sel_idx].name}"
             except Exception: sel_name = ""
         ctx_name = self.cur_screen.name if not self.edit_stack else self.edit_stack[-1].name
-        stat = f"[{ctx_name}] {self.msg}{sel_name} | Pos:{self.cx},{self.cy} (e:edit t:text b:box l:line r:resize o:open)"
+        view = f" View:{vx},{vy}" if vx or vy else ""
+        stat = (f"[{ctx_name}] {self.msg}{sel_name} | Pos:{self.cx},{self.cy}{view} "
+                f"Canvas:{self.cur_screen.width}x{self.cur_screen.height} (e:edit t:text b:box l:line r:resize o:open)")
         try:
+            self.stdscr.move(h - 1, 0); self.stdscr.clrtoeol()
             self.stdscr.addstr(h - 1, 0, stat[:w - 1], curses.A_REVERSE)
-            self.stdscr.move(max(0, min(h - 2, self.cy)), max(0, min(w - 1, self.cx)))
+            self.stdscr.move(max(0, min(h - 2, self.cy - vy)), max(0, min(w - 1, self.cx - vx)))
         except Exception:
             pass
-        self.stdscr.refresh()
+        self.stdscr.noutrefresh()
+        curses.doupdate()
 
 # ------------------------------
 # Entrypoint
 # ------------------------------
+def _compile_one(job: tuple) -> Dict[str, Any]:
+    """Worker for batch --compile: (project_file, out_dir) -> metrics, or an 'error' entry."""
+    project_file, out_dir = job
+    try:
+        pm = ProjectManager(project_file, out_dir)
+        if not Path(project_file).exists(): raise FileNotFoundError(f"no such file: {project_file}")
+        return pm.save_project(pm.load_project())
+    except Exception as e:
+        return {'project': project_file, 'out': str(out_dir or "."), 'error': str(e)}
+
+def compile_batch(projects: List[str], out_root: Optional[str] = None, jobs: int = 0,
+                  outs: Optional[Dict[str, str]] = None) -> List[Dict[str, Any]]:
+    """Generate many projects concurrently, each into its own directory.
+
+    A single project without out_root keeps writing to the current directory; otherwise
+    each goes to out_root/<project stem> unless outs names a directory for it.
+    """
+    outs = outs or {}; taken: Dict[str, int] = {}; work = []
+    for p in projects:
+        if p in outs: out = outs[p]
+        elif len(projects) == 1 and not out_root: out = None
+        else:
+            stem = Path(p).stem; n = taken[stem] = taken.get(stem, 0) + 1
+            out = str(Path(out_root or ".") / (stem if n == 1 else f"{stem}_{n}"))
+        work.append((p, out))
+    if len(work) == 1 or jobs == 1:
+        return [_compile_one(w) for w in work]
+    from concurrent.futures import ProcessPoolExecutor
+    with ProcessPoolExecutor(max_workers=jobs or None) as ex:
+        return list(ex.map(_compile_one, work))
+
+def _read_manifest(path: str) -> List[tuple]:
+    """Manifest lines: 'project.uiproj [out_dir]'; blank lines and '#' comments are skipped."""
+    base = Path(path).parent; res = []
+    for ln in Path(path).read_text(encoding="utf-8").splitlines():
+        parts = ln.split('#', 1)[0].split()
+        if parts:
+            res.append((str(base / parts[0]), str(base / parts[1]) if len(parts) > 1 else None))
+    return res
+
+def _print_summary(results: List[Dict[str, Any]]):
+    cols = ('screens', 'elements', 'functions', 'h_bytes', 'cpp_bytes', 'string_bytes', 'paint_cells', 'ms')
+    w = max([len(r['project']) for r in results] + [7])
+    print(f"{'project':<{w}} " + " ".join(f"{c:>12}" for c in cols))
+    for r in results:
+        if 'error' in r: print(f"{r['project']:<{w}} FAILED: {r['error']}"); continue
+        print(f"{r['project']:<{w}} " + " ".join(f"{r[c]:>12}" for c in cols))
+    ok = [r for r in results if 'error' not in r]
+    if len(ok) > 1:
+        print(f"{'total':<{w}} " + " ".join(f"{round(sum(r[c] for r in ok), 1):>12}" for c in cols))
+
+# ------------------------------
+# Frame capture (--snapshot)
+# ------------------------------
+def read_frame(path: str, retries: int = 1000) -> Dict[str, Any]:
+    """Consistent snapshot of a UI_FrameSink file: frame number, cursor and rows of
+    (char, fg, bg, attr) cells. Retries while the writer is inside a frame."""
+    import mmap, struct
+    with open(path, "rb") as f, mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as m:
+        magic, ver, hsize, w, h = struct.unpack_from("<IHHHH", m, 0)
+        if magic != 0x46495553 or ver != 1: raise ValueError(f"{path} is not a SerialUI frame file")
+        for _ in range(retries):
+            s1 = struct.unpack_from("<I", m, 12)[0]
+            if s1 & 1: time.sleep(0); continue
+            cx, cy = struct.unpack_from("<hh", m, 16)
+            body = m[hsize:hsize + 8 * w * h]
+            if struct.unpack_from("<I", m, 12)[0] != s1: continue
+            cells = list(struct.iter_unpack("<IBBBx", body))
+            rows = [[(chr(c), fg, bg, a) for c, fg, bg, a in cells[y * w:(y + 1) * w]] for y in range(h)]
+            return {'frame': s1 // 2, 'width': w, 'height': h, 'cursor': (cx, cy), 'rows': rows}
+    raise TimeoutError(f"{path}: the writer never left its frame")
+
+# ------------------------------
+# Benchmarks (--bench)
+# ------------------------------
+BENCH_FLAGS = ["-std=c++11", "-O2", "-DSERIALUI_BINARY", "-DSERIALUI_COMPRESS", "-DSERIALUI_CAPS=UI_CAP_UTF8"]
+BENCH_MODES = ("a", "b", "az", "bz")  # ANSI, binary, each with stream compression
+
+def _bench_items(project: Project) -> List[tuple]:
+    """(label, C++ statements) measured one by one: every screen, then every function test case."""
+    items = [(f"paint {s.name}", f"ui.clearScreen(); drawScreen_{s.name}(ui);") for s in project.screens]
+    for f in project.functions:
+        for tc in f.test_cases:
+            items.append((tc.strip(), tc))
+    return items
+
+def _bench_source(items: List[tuple]) -> str:
+    # Output goes to stdout (a file); per item the harness reports offset, bytes and CPU ns on stderr.
+    # Built with SERIALUI_TRACE it also dumps the trace, and with SERIALUI_ASYNC_TX its 't' mode
+    # writes a Chrome trace with one frame per item and the output on a simulated link.
+    labels = ", ".join(f'"{c_escape(label)}"' for label, _ in items) or '""'
+    lines = ['#include "ui_layout.h"', '#include <chrono>', '',
+             '#ifdef SERIALUI_TRACE', f'static const char* const labels[] = {{ {labels} }};',
+             'static UI_ChromeTrace* chrome = nullptr;', 'static uint32_t t0us;', '#endif',
+             'static long at;', 'static std::chrono::steady_clock::time_point t0;',
+             'static void start() {',
+             '    fflush(stdout); at = ftell(stdout); t0 = std::chrono::steady_clock::now();',
+             '#ifdef SERIALUI_TRACE', '    t0us = micros();', '#endif', '}',
+             'static void stop(int n) {',
+             '    fflush(stdout);',
+             '    long ns = (long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();',
+             '    fprintf(stderr, "%d\\t%ld\\t%ld\\t%ld\\n", n, at, ftell(stdout) - at, ns);',
+             '#ifdef SERIALUI_TRACE', '    if (chrome) chrome->frame(labels[n], t0us, micros() - t0us);', '#endif', '}', '',
+             '// Compressor cost: the same bytes through putByte() with compression off, then on.',
+             'static int cost(SerialUI& ui, const char* path, int reps) {',
+             '    static uint8_t buf[1 << 16];',
+             '    FILE* f = fopen(path, "rb");',
+             '    size_t n = f ? fread(buf, 1, sizeof(buf), f) : 0;',
+             '    if (f) fclose(f);',
+             '    for (int on = 0; on < 2; on++) {',
+             '        ui.setCompression(on); start();',
+             '        for (int r = 0; r < reps; r++) for (size_t i = 0; i < n; i++) ui.putByte(buf[i]);',
+             '        ui.flush(); stop(on);', '    }', '    return 0;', '}', '',
+             'int main(int argc, char** argv) {', '    SerialUI ui;',
+             '#if defined(SERIALUI_TRACE) && defined(SERIALUI_ASYNC_TX)',
+             '    HostThreadTx link(argc > 3 ? atol(argv[3]) : 115200, stdout);',
+             '    if (argc > 3 && argv[1][0] == \'t\') { chrome = new UI_ChromeTrace(argv[2]); chrome->watch(link); ui.setTxBackend(&link); }',
+             '#endif',
+             '    if (argc > 3 && argv[1][0] == \'c\') return cost(ui, argv[2], atoi(argv[3]));',
+             '    if (argc > 1 && argv[1][0] == \'b\') ui.setProtocol(UI_Protocol::BINARY);',
+             '    if (argc > 1 && argv[1][1] == \'z\') ui.setCompression(true);']
+    for i, (_, code) in enumerate(items):
+        lines.append(f'    start(); {{ {code.strip().rstrip(";")}; }} ui.flush(); stop({i});')
+    lines += ['#ifdef SERIALUI_TRACE', '    UI_Trace::get().dump(16, 16);',
+              '#ifdef SERIALUI_ASYNC_TX', '    ui.flush(); ui.setTxBackend(nullptr);', '#endif',
+              '    if (chrome) chrome->close();', '#endif', '    return 0;', '}', '']
+    return "\n".join(lines)
+
+# Differential check for priority lanes: the same random drawing calls, built with and
+# without SERIALUI_PRIORITY_LANES, must leave the same screen. Each lane draws in its own
+# rows, so overtaking changes the order on the wire but not the final cells.
+LANES_CHECK_SOURCE = r"""#include "SerialUI.h"
+static uint32_t rs;
+static uint32_t rnd(uint32_t n) { rs = rs * 1103515245u + 12345u; return (rs >> 8) % n; }
+static const UI_Color colors[] = { UI_Color::RED, UI_Color::GREEN, UI_Color::B_YELLOW, UI_Color::CYAN,
+    UI_Color::BG_RED, UI_Color::BG_BLUE, UI_Color::BG_B_GREEN, UI_Color::WHITE };
+static const int16_t rows[3][2] = { { 17, 7 }, { 8, 8 }, { 0, 7 } }; // first row, row count per lane
+
+int main(int argc, char** argv) {
+    rs = argc > 1 ? (uint32_t)atol(argv[1]) : 1;
+    SerialUI ui;
+#ifdef SERIALUI_PRIORITY_LANES
+    HostThreadTx link(argc > 2 ? atol(argv[2]) : 2000000, stdout);
+    ui.setTxBackend(&link);
+#endif
+    ui.clearScreen();
+    char text[24];
+    for (int op = 0; op < 300; op++) {
+        uint8_t lane = (uint8_t)rnd(3);
+        int16_t y0 = rows[lane][0], h = rows[lane][1];
+        UI_Color color = colors[rnd(8)];
+        ui.setPriority((UI_Priority)lane);
+        uint32_t kind = lane == 0 ? 0 : rnd(3);
+        if (kind == 0) {
+            int n = 1 + (int)rnd(lane == 0 ? 12 : 20);
+            for (int i = 0; i < n; i++) text[i] = (char)('a' + rnd(26));
+            text[n] = 0;
+            ui.drawText((int16_t)rnd(80 - n), (int16_t)(y0 + rnd(h)), text, color);
+        } else if (kind == 1) {
+            UI_Box b = { (int16_t)rnd(60), y0, (int16_t)(3 + rnd(18)), (int16_t)(2 + rnd(h - 1)), color };
+            ui.draw(b);
+        } else {
+            UI_Box b = { (int16_t)(20 * rnd(4)), y0, 20, h, color };
+            ui.drawProgressBar(b, (float)rnd(101), color);
+        }
+    }
+    ui.setPriority(UI_Priority::NORMAL);
+    ui.flush();
+#ifdef SERIALUI_PRIORITY_LANES
+    ui.setTxBackend(nullptr);
+#endif
+    return 0;
+}
+"""
+
+def lanes_check(seeds=range(1, 9), work: Optional[str] = None) -> Dict[str, Any]:
+    """Runs LANES_CHECK_SOURCE per seed without lanes, with lanes and with lanes but no
+    coalescing; returns the number of cells (character or attributes) that differ."""
+    import subprocess, tempfile
+    d = Path(work or tempfile.mkdtemp(prefix="uilanes_")); d.mkdir(parents=True, exist_ok=True)
+    (d / ProjectManager.LIB_FILE).write_text(SERIAL_UI_HEADER, encoding="utf-8")
+    (d / "lanes_check.cpp").write_text(LANES_CHECK_SOURCE, encoding="utf-8")
+    builds = {'plain': [], 'lanes': ["-DSERIALUI_ASYNC_TX", "-DSERIALUI_PRIORITY_LANES", "-pthread"]}
+    builds['lanes_nocoalesce'] = builds['lanes'] + ["-DSERIALUI_COALESCE_SLOTS=0"]
+    for exe, flags in builds.items():
+        res = subprocess.run(["g++", "-std=c++11", "-O2", *flags, "lanes_check.cpp", "-o", exe], cwd=d, capture_output=True, text=True)
+        if res.returncode != 0: raise RuntimeError(f"lanes_check.cpp failed to compile:\n{res.stderr}")
+    def screen(exe: str, seed: int) -> AnsiRenderer:
+        res = subprocess.run([f"./{exe}", str(seed)], cwd=d, capture_output=True)
+        if res.returncode != 0: raise RuntimeError(f"{exe} {seed} exited with {res.returncode}")
+        r = AnsiRenderer(80, 24); r.feed(res.stdout.decode("utf-8", "replace")); return r
+    diffs = {}
+    for seed in seeds:
+        ref = screen("plain", seed)
+        for exe in ('lanes', 'lanes_nocoalesce'):
+            r = screen(exe, seed)
+            diffs[f"{exe} {seed}"] = sum(a != b or ca != cb for ga, gb, cra, crb in zip(ref.grid, r.grid, ref.colors, r.colors)
+                                         for a, b, ca, cb in zip(ga, gb, cra, crb))
+    return {'cells_differing': diffs, 'match': not any(diffs.values())}
+
+def _bench_setup(project_file: str, work: Optional[str], prefix: str) -> tuple:
+    """Generate a project into `work` (or a scratch directory) next to the bench harness.
+    Returns (directory, project, items)."""
+    import tempfile
+    if not Path(project_file).exists(): raise FileNotFoundError(f"no such file: {project_file}")
+    pm = ProjectManager(project_file, work or tempfile.mkdtemp(prefix=prefix))
+    project = pm.load_project(); pm.save_project(project)
+    items = _bench_items(project)
+    (pm.out_dir / "bench_main.cpp").write_text(_bench_source(items), encoding="utf-8")
+    return pm.out_dir, project, items
+
+def _bench_compile(d: Path, src: str, exe: str, *flags: str):
+    import subprocess
+    res = subprocess.run(["g++", *BENCH_FLAGS, *flags, src, "ui_layout.cpp", "-o", exe], cwd=d, capture_output=True, text=True)
+    if res.returncode != 0: raise RuntimeError(f"{src} failed to compile:\n{res.stderr}")
+
+def bench_project(project_file: str, baud: int = 115200, work: Optional[str] = None) -> Dict[str, Any]:
+    """Generate a project, run every screen and test case in ANSI and binary mode, plain and
+    compressed, on the host mock; return bytes, wire time at `baud` and CPU time per item."""
+    import subprocess
+    d, project, items = _bench_setup(project_file, work, "uibench_")
+    (d / "ui_viewer.cpp").write_text(UI_VIEWER_SOURCE, encoding="utf-8")
+    _bench_compile(d, "bench_main.cpp", "bench")
+    _bench_compile(d, "ui_viewer.cpp", "ui_viewer")
+    def run(*args: str, out: Optional[str] = None, src: Optional[str] = None) -> List[tuple]:
+        with open(d / out if out else os.devnull, "wb") as o, open(d / src if src else os.devnull, "rb") as i:
+            res = subprocess.run([f"./{a}" if n == 0 else a for n, a in enumerate(args)], cwd=d, stdin=i, stdout=o, stderr=subprocess.PIPE, text=True)
+        if res.returncode != 0: raise RuntimeError(f"{' '.join(args)} exited with {res.returncode}")
+        return [tuple(int(v) for v in ln.split("\t")) for ln in res.stderr.splitlines() if ln.count("\t") == 3]
+    runs = {mode: run("bench", mode, out=f"{mode}.out") for mode in BENCH_MODES}
+    # the viewer must turn every other capture into the same screen as the ANSI one
+    run("ui_viewer", out="b.dec", src="b.out")
+    run("ui_viewer", "--lz", "--ansi", out="az.dec", src="az.out")
+    run("ui_viewer", "--lz", out="bz.dec", src="bz.out")
+    w, h = max((s.width for s in project.screens), default=80), max((s.height for s in project.screens), default=24)
+    grids = []
+    for f in ("a.out", "b.dec", "bz.dec"):
+        r = AnsiRenderer(w, h); r.feed((d / f).read_bytes().decode("utf-8", "replace")); grids.append(r.grid)
+    # AnsiRenderer (the Visual Output pane) on the ANSI capture repeated to about 2M chars,
+    # fed in random chunk sizes; it must end up where a single feed does
+    import random
+    text = (d / "a.out").read_bytes().decode("utf-8", "replace")
+    big = text * max(1, (2 << 20) // max(1, len(text)))
+    rng = random.Random(1); chunked = AnsiRenderer(w, h); i = 0
+    t0 = time.perf_counter()
+    while i < len(big):
+        n = rng.randint(1, 4096); chunked.feed(big[i:i + n]); i += n
+    render_s = time.perf_counter() - t0
+    whole = AnsiRenderer(w, h); whole.feed(big)
+    # compressor cost per byte of ANSI, from the same input with compression off and on
+    ansi = (d / "a.out").read_bytes()[:1 << 16]
+    off, on = run("bench", "c", "a.out", str(max(1, (1 << 20) // max(1, len(ansi)))), out="cost.out")
+    lz_ns = max(0, on[3] - off[3]) / max(1, off[2])
+    # decoder throughput on the binary capture repeated to about 1 MB
+    blob = (d / "b.out").read_bytes(); reps = max(1, (1 << 20) // max(1, len(blob)))
+    (d / "big.bin").write_bytes(blob * reps)
+    t0 = time.perf_counter()
+    run("ui_viewer", src="big.bin")
+    dec_s = time.perf_counter() - t0
+    wire = lambda n: round(n * 10 * 1000 / baud, 2)  # 8N1
+    rows = []
+    for (label, _), a, b, az, bz in zip(items, *(runs[m] for m in BENCH_MODES)):
+        rows.append({'item': label, 'ansi_bytes': a[2], 'bin_bytes': b[2], 'lz_bytes': az[2], 'bin_lz_bytes': bz[2],
+                     'ansi_ms': wire(a[2]), 'bin_ms': wire(b[2]), 'lz_ms': wire(az[2]),
+                     'ansi_cpu_us': round(a[3] / 1000, 1), 'bin_cpu_us': round(b[3] / 1000, 1), 'lz_cpu_us': round(az[3] / 1000, 1)})
+    mhz = _host_mhz()
+    return {'project': project_file, 'baud': baud, 'items': rows,
+            'viewer_match': grids[0] == grids[1], 'lz_match': (d / "az.dec").read_bytes() == (d / "a.out").read_bytes() and grids[0] == grids[2],
+            'viewer_mb_s': round(len(blob) * reps / dec_s / 1e6, 1) if dec_s > 0 else 0.0,
+            'lz_ns_per_byte': round(lz_ns, 1), 'lz_host_mhz': mhz, 'lz_cycles_per_byte': round(lz_ns * mhz / 1000, 1) if mhz else None,
+            'renderer_chars': len(big), 'renderer_mchars_s': round(len(big) / render_s / 1e6, 2) if render_s > 0 else 0.0,
+            'renderer_match': chunked.grid == whole.grid and chunked.colors == whole.colors,
+            'lanes_match': lanes_check(work=str(d / "lanes"))['match']}
+
+TRACE_FLAGS = ["-DSERIALUI_TRACE", "-DSERIALUI_TRACE_SITES=32", "-DSERIALUI_TRACE_RING=32"]
+
+def trace_project(project_file: str, work: Optional[str] = None, chrome: Optional[str] = None, baud: int = 115200) -> str:
+    """Build the bench harness with SERIALUI_TRACE, run every screen and test case once
+    in ANSI mode, and return UI_Trace's dump: the costliest call sites, then the latest calls.
+    With `chrome`, output crosses a simulated link at `baud` and the run is also written
+    there as Chrome trace-event JSON."""
+    import subprocess
+    d, _, _ = _bench_setup(project_file, work, "uitrace_")
+    _bench_compile(d, "bench_main.cpp", "trace", *TRACE_FLAGS, *(["-DSERIALUI_ASYNC_TX", "-pthread"] if chrome else []))
+    mode = ["t", str(Path(chrome).resolve()), str(baud)] if chrome else ["a"]
+    res = subprocess.run(["./trace", *mode], cwd=d, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    if res.returncode != 0: raise RuntimeError(f"trace exited with {res.returncode}")
+    dump = "\n".join(ln for ln in res.stderr.splitlines() if ln.count("\t") != 3)
+    if chrome:
+        events = json.loads(Path(chrome).read_text(encoding="utf-8"))["traceEvents"]
+        dump += f"\nwrote {len(events)} trace events to {chrome} (open in ui.perfetto.dev or chrome://tracing)"
+    return dump
+
+SWEEP_BAUDS = (9600, 19200, 38400, 57600, 115200, 230400, 500000, 1000000, 2000000)
+_NOT_GLYPH = re.compile(rb"\x1b\[[0-?]*[ -/]*[@-~]|\x1b.|[\x00-\x20\x7f]", re.S)
+
+def _first_glyph_end(data: bytes) -> int:
+    """Index one past the first visible character in ANSI output, or 0 if there is none."""
+    i = 0
+    while i < len(data):
+        m = _NOT_GLYPH.match(data, i)
+        if not m: break
+        i = m.end()
+    if i >= len(data): return 0
+    j = i + 1
+    while j < len(data) and data[j] & 0xC0 == 0x80: j += 1  # UTF-8 continuation bytes
+    return j
+
+def _link_times(n: int, cpu_us: float, baud: int, fifo: int) -> List[float]:
+    """Time (us from the call) at which each of `n` bytes has left an idle 8N1 UART at `baud`.
+    The code produces them evenly over `cpu_us` and blocks while `fifo` bytes are queued."""
+    bt, step = 10e6 / baud, cpu_us / n if n else 0.0
+    done, made = [], 0.0
+    for i in range(n):
+        made += step
+        if i >= fifo: made = max(made, done[i - fifo])
+        done.append(max(made, done[-1] if done else 0.0) + bt)
+    return done
+
+def sweep_project(project_file: str, bauds=SWEEP_BAUDS, work: Optional[str] = None,
+                  fifo: int = 64, cpu_scale: float = 1.0) -> Dict[str, Any]:
+    """Run every screen and test case once on the host mock, then replay each item's ANSI
+    bytes over a simulated link at every baud rate. Returns time to the first visible
+    character and to the last byte per item and baud. CPU time is the host's, times `cpu_scale`."""
+    import subprocess
+    d, project, items = _bench_setup(project_file, work, "uisweep_")
+    _bench_compile(d, "bench_main.cpp", "bench")
+    with open(d / "a.out", "wb") as o:
+        res = subprocess.run(["./bench", "a"], cwd=d, stdout=o, stderr=subprocess.PIPE, text=True)
+    if res.returncode != 0: raise RuntimeError(f"bench exited with {res.returncode}")
+    runs = [tuple(int(v) for v in ln.split("\t")) for ln in res.stderr.splitlines() if ln.count("\t") == 3]
+    out = (d / "a.out").read_bytes()
+    rows = []
+    for k, ((label, _), (_, at, n, ns)) in enumerate(zip(items, runs)):
+        data, cpu = out[at:at + n], ns / 1000 * cpu_scale
+        first = _first_glyph_end(data)
+        row = {'item': label, 'paint': k < len(project.screens), 'bytes': n, 'cpu_us': round(cpu, 1), 'first_ms': {}, 'full_ms': {}}
+        for baud in bauds:
+            t = _link_times(n, cpu, baud, fifo)
+            row['first_ms'][baud] = round(t[first - 1] / 1000, 2) if first else None
+            row['full_ms'][baud] = round((t[-1] if t else cpu) / 1000, 2)
+        rows.append(row)
+    summary = []
+    for baud in bauds:
+        paints = [r for r in rows if r['paint']]; updates = [r['full_ms'][baud] for r in rows if not r['paint']]
+        firsts = [r['first_ms'][baud] for r in paints if r['first_ms'][baud] is not None]
+        avg = sum(updates) / len(updates) if updates else None
+        summary.append({'baud': baud, 'first_paint_ms': max(firsts, default=None),
+                        'repaint_ms': max((r['full_ms'][baud] for r in paints), default=None),
+                        'update_avg_ms': round(avg, 2) if avg is not None else None,
+                        'update_max_ms': max(updates, default=None),
+                        'updates_per_s': round(1000 / avg, 1) if avg else None})
+    return {'project': project_file, 'fifo': fifo, 'cpu_scale': cpu_scale, 'bauds': list(bauds), 'items': rows, 'summary': summary}
+
+def _host_mhz() -> Optional[float]:
+    try:
+        for ln in Path("/proc/cpuinfo").read_text().splitlines():
+            if ln.lower().startswith("cpu mhz"): return float(ln.split(":")[1])
+    except Exception: pass
+    return None
+
+def _print_bench(r: Dict[str, Any]):
+    cols = ('ansi_bytes', 'bin_bytes', 'lz_bytes', 'bin_lz_bytes', 'ansi_ms', 'bin_ms', 'lz_ms', 'ansi_cpu_us', 'bin_cpu_us', 'lz_cpu_us')
+    w = max([len(i['item']) for i in r['items']] + [5]); w = min(w, 48)
+    print(f"{r['project']} at {r['baud']} baud (ms = time on the wire, 8N1)")
+    print(f"{'item':<{w}} " + " ".join(f"{c:>12}" for c in cols))
+    for i in r['items']:
+        print(f"{i['item'][:w]:<{w}} " + " ".join(f"{i[c]:>12}" for c in cols))
+    tot = {c: round(sum(i[c] for i in r['items']), 1) for c in cols}
+    print(f"{'total':<{w}} " + " ".join(f"{tot[c]:>12}" for c in cols))
+    a = max(1, tot['ansi_bytes'])
+    print(f"vs ANSI: binary {tot['bin_bytes'] / a:.2f}, compressed {tot['lz_bytes'] / a:.2f}, binary compressed {tot['bin_lz_bytes'] / a:.2f}")
+    print(f"viewer: {'output matches the ANSI run' if r['viewer_match'] else 'OUTPUT DIFFERS from the ANSI run'}, decodes {r['viewer_mb_s']} MB/s")
+    print(f"compression: {'round trip matches' if r['lz_match'] else 'ROUND TRIP DIFFERS'}, {r['lz_ns_per_byte']} ns/byte"
+          + (f" ({r['lz_cycles_per_byte']} cycles/byte at {r['lz_host_mhz']:.0f} MHz, host)" if r['lz_cycles_per_byte'] is not None else ""))
+    print(f"renderer: {r['renderer_chars']} chars in random chunks at {r['renderer_mchars_s']} Mchar/s, "
+          + ("same screen as one feed" if r['renderer_match'] else "SCREEN DIFFERS from one feed"))
+    print(f"priority lanes: {'screens match the unlaned run' if r['lanes_match'] else 'SCREENS DIFFER from the unlaned run'}")
+
+def _print_sweep(r: Dict[str, Any], budget_ms: float = 100.0):
+    ms = lambda v: "-" if v is None else f"{v:.2f}"
+    cols = ('first_paint_ms', 'repaint_ms', 'update_avg_ms', 'update_max_ms', 'updates_per_s')
+    print(f"{r['project']}: 8N1, {r['fifo']}-byte TX FIFO, CPU time x{r['cpu_scale']:g} (worst screen, per-update latency)")
+    print(f"{'baud':>8} " + " ".join(f"{c:>15}" for c in cols))
+    for s in r['summary']:
+        print(f"{s['baud']:>8} " + " ".join(f"{ms(s[c]):>15}" for c in cols))
+    w = min(max([len(i['item']) for i in r['items']] + [5]), 40)
+    for key, title in (('first_ms', "time to first visible character, ms"), ('full_ms', "time to last byte, ms")):
+        print(f"\n{title}")
+        print(f"{'item':<{w}} " + " ".join(f"{b:>9}" for b in r['bauds']))
+        for i in r['items']:
+            if key == 'first_ms' and not i['paint']: continue
+            print(f"{i['item'][:w]:<{w}} " + " ".join(f"{ms(i[key][b]):>9}" for b in r['bauds']))
+    ok = [s['baud'] for s in r['summary'] if all(s[c] is None or s[c] <= budget_ms for c in ('first_paint_ms', 'update_max_ms'))]
+    print(f"\nslowest baud with first paint and every update within {budget_ms:g} ms: {ok[0] if ok else 'none in this sweep'}")
+
+# ------------------------------
+# Synthetic stress projects (--stress)
+# ------------------------------
+STRESS_MIX = {"BOX": 3, "TEXT": 4, "LINE": 1, "FREEHAND": 1, "BIGNUM": 1}
+STRESS_GROUP = 4  # leaves per MetaObject chain when nesting
+
+def synth_project(elements: int = 100, screens: int = 1, mix: Optional[Dict[str, int]] = None, overlap: float = 0.3,
+                  depth: int = 0, text_len: int = 12, width: int = 80, height: int = 24, seed: int = 1) -> Project:
+    """Deterministic synthetic project for scaling benchmarks.
+
+    `elements` leaves are spread over `screens`, with types drawn by weight from `mix`.
+    A fraction `overlap` of them is placed over an earlier element, the rest anywhere.
+    With `depth`, every STRESS_GROUP leaves sit `depth` MetaObjects deep. Texts and
+    freehand rows are about `text_len` characters. Each screen gets an update function
+    with two test cases that rewrite a few texts and big numbers.
+    """
+    import random
+    rng = random.Random(seed); mix = mix or STRESS_MIX
+    for k in mix:
+        if k not in STRESS_MIX: raise ValueError(f"unknown element type in mix: {k} (use {', '.join(t.lower() for t in STRESS_MIX)})")
+    kinds = [k for k in mix if mix[k] > 0]; weights = [mix[k] for k in kinds]
+    if not kinds: raise ValueError("empty type mix")
+    colors = [c for c in Color if not c.name.startswith("BG_")]
+    glyphs = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789 "
+    W, H = width - depth, height - depth  # room left once every level is offset by (1, 1)
+    if W < 4 or H < 3: raise ValueError(f"{width}x{height} canvas is too small for depth {depth}")
+    proj = Project([], [])
+    for si in range(max(1, screens)):
+        n = elements // max(1, screens) + (1 if si < elements % max(1, screens) else 0)
+        leaves: List[UIElement] = []; rects: List[tuple] = []
+        for i in range(n):
+            kind = rng.choices(kinds, weights)[0]; color = rng.choice(colors)
+            length = max(1, min(W, rng.randint(max(1, text_len // 2), max(1, text_len * 3 // 2))))
+            if kind == "BOX": w, h = rng.randint(3, min(W, 24)), rng.randint(2, min(H, 8))
+            elif kind == "LINE":
+                w, h = (rng.randint(2, min(W, 24)), 1) if rng.random() < 0.5 else (1, rng.randint(2, H))
+            elif kind == "FREEHAND": w, h = length, min(H, 3)
+            elif kind == "BIGNUM":
+                digits = rng.randint(1, max(1, min(6, W // 4))); w, h = 4 * digits, 3
+            else: w, h = length, 1
+            if rects and rng.random() < overlap:
+                a = rng.choice(rects); x, y = rng.randint(a[0], a[2]), rng.randint(a[1], a[3])
+            else:
+                x, y = rng.randint(0, W - 1), rng.randint(0, H - 1)
+            x, y = max(0, min(x, W - w)), max(0, min(y, H - h))
+            rects.append((x, y, x + w - 1, y + h - 1))
+            name = f"{kind.lower()}{i}"; x += depth; y += depth
+            if kind == "BOX": o: UIElement = Box(name, color, x=x, y=y, w=w, h=h)
+            elif kind == "LINE": o = Line(name, color, x1=x, y1=y, x2=x + w - 1, y2=y + h - 1)
+            elif kind == "FREEHAND":
+                o = Freehand(name, color, x=x, y=y, lines=["".join(rng.choice("#*+-=|/\\.o") for _ in range(w)) for _ in range(h)])
+            elif kind == "BIGNUM":
+                o = BigNum(name, color, x=x, y=y, digits=digits, sample="".join(rng.choice("0123456789") for _ in range(digits)))
+            else: o = Text(name, color, x=x, y=y, content="".join(rng.choice(glyphs) for _ in range(w)))
+            o.layer = i; leaves.append(o)
+        objs: List[UIElement] = leaves
+        if depth:
+            for leaf in leaves:  # each level sits at (1, 1) in its parent
+                if isinstance(leaf, Line): leaf.x1 -= depth; leaf.y1 -= depth; leaf.x2 -= depth; leaf.y2 -= depth
+                else: leaf.x -= depth; leaf.y -= depth
+            objs = []
+            for g in range(0, len(leaves), STRESS_GROUP):
+                node = MetaObject(f"n{depth - 1}", x=1, y=1, children=leaves[g:g + STRESS_GROUP])
+                for lv in range(depth - 1, 0, -1): node = MetaObject(f"n{lv - 1}", x=1, y=1, children=[node])
+                node.name = f"g{g // STRESS_GROUP}"; objs.append(node)
+        scr = Screen(f"S{si}", objs, width, height); proj.screens.append(scr)
+        flat = ProjectManager()._flatten(objs)
+        texts = [o for o in flat if isinstance(o, Text)][:4]; nums = [o for o in flat if isinstance(o, BigNum)][:2]
+        body = [f'ui.drawText(Layout_{scr.name}::{o.name}.x, Layout_{scr.name}::{o.name}.y, "{c_escape(o.content[::-1])}", UI_Color::GREEN);' for o in texts]
+        body += [f'ui.drawBigNumber(Layout_{scr.name}::{o.name}, v);' for o in nums]
+        proj.functions.append(UserFunction(f"update_{scr.name}", "long v", "\n    ".join(body) or "(void)v;",
+                                           [f"update_{scr.name}(ui, 1234)", f"update_{scr.name}(ui, 1235)"]))
+    return proj
+
+def _object_size(path: Path) -> int:
+    """text + data of an object file, from binutils size (0 if it is not available)."""
+    import subprocess
+    try:
+        res = subprocess.run(["size", str(path)], capture_output=True, text=True)
+        text, data = res.stdout.splitlines()[1].split()[:2]
+        return int(text) + int(data)
+    except Exception:
+        return 0
+
+def stress_bench(vary: str = "elements", values=(100, 500, 1000, 2000, 5000), work: Optional[str] = None,
+                 build: bool = True, **params) -> List[Dict[str, Any]]:
+    """For each value of synth_project parameter `vary` (the others from `params`), time
+    saving, loading and generating the project. With `build`, also compile ui_layout.cpp
+    on the host and run every screen and test case through the bench harness."""
+    import subprocess, tempfile
+    root = Path(work or tempfile.mkdtemp(prefix="uistress_")); rows = []
+    def gpp(d: Path, *args: str) -> float:
+        t0 = time.perf_counter()
+        res = subprocess.run(["g++", *BENCH_FLAGS, *args], cwd=d, capture_output=True, text=True)
+        if res.returncode != 0: raise RuntimeError(f"g++ {' '.join(args)} failed:\n{res.stderr[:2000]}")
+        return time.perf_counter() - t0
+    for v in values:
+        p = dict(params, **{vary: v}); d = root / f"{vary}_{v}"; d.mkdir(parents=True, exist_ok=True)
+        proj = synth_project(**p); pm = ProjectManager(str(d / "stress.uiproj"), str(d))
+        t0 = time.perf_counter(); pm.save_json_state(proj); save_s = time.perf_counter() - t0
+        t0 = time.perf_counter(); proj = pm.load_project(); load_s = time.perf_counter() - t0
+        m = pm.save_project(proj)
+        row = {vary: v, 'screens': m['screens'], 'elements': m['elements'], 'json_bytes': (d / "stress.uiproj").stat().st_size,
+               'save_ms': round(save_s * 1000, 1), 'load_ms': round(load_s * 1000, 1), 'generate_ms': m['ms'],
+               'h_bytes': m['h_bytes'], 'cpp_bytes': m['cpp_bytes']}
+        if build:
+            items = _bench_items(proj)
+            (d / "bench_main.cpp").write_text(_bench_source(items), encoding="utf-8")
+            row['compile_ms'] = round(gpp(d, "-c", "ui_layout.cpp", "-o", "ui_layout.o") * 1000, 1)
+            row['object_bytes'] = _object_size(d / "ui_layout.o")
+            gpp(d, "bench_main.cpp", "ui_layout.o", "-o", "bench")
+            with open(d / "a.out", "wb") as o:
+                res = subprocess.run(["./bench", "a"], cwd=d, stdout=o, stderr=subprocess.PIPE, text=True)
+            if res.returncode != 0: raise RuntimeError(f"bench exited with {res.returncode}")
+            runs = [tuple(int(x) for x in ln.split("\t")) for ln in res.stderr.splitlines() if ln.count("\t") == 3]
+            paints, updates = runs[:len(proj.screens)], runs[len(proj.screens):]
+            row['paint_bytes'] = max((r[2] for r in paints), default=0)
+            row['paint_cpu_us'] = round(max((r[3] for r in paints), default=0) / 1000, 1)
+            row['update_bytes'] = round(sum(r[2] for r in updates) / max(1, len(updates)))
+            row['update_cpu_us'] = round(sum(r[3] for r in updates) / max(1, len(updates)) / 1000, 1)
+        rows.append(row)
+    return rows
+
+def _print_stress(rows: List[Dict[str, Any]]):
+    if not rows: return
+    cols = list(rows[0])
+    print(" ".join(f"{c:>13}" for c in cols))
+    for r in rows: print(" ".join(f"{r.get(c, '-'):>13}" for c in cols))
+    if 'paint_bytes' in rows[0]:
+        print("paint = the largest screen; update = average test case; CPU time and object size are the host's")
+
 def main():
     project_file = "project.uiproj"
     compile_only = False
     args = sys.argv[1:]
     if "--compile" in args:
         compile_only = True; args.remove("--compile")
-    if args: project_file = args[0]
     if compile_only:
-        pm = ProjectManager(project_file)
+        opts = {'--jobs': '0', '--out': None, '--manifest': None, '--summary': None}
+        for k in opts:
+            if k in args:
+                i = args.index(k); opts[k] = args[i + 1] if i + 1 < len(args) else None; del args[i:i + 2]
+        outs = {}
+        if opts['--manifest']:
+            for p, o in _read_manifest(opts['--manifest']):
+                args.append(p)
+                if o: outs[p] = o
+        projects = args or [project_file]
+        results = compile_batch(projects, opts['--out'], int(opts['--jobs'] or 0), outs)
+        if len(results) == 1 and not opts['--summary']:
+            r = results[0]
+            print(f"Failed: {r['error']}" if 'error' in r else f"Compiled {r['project']} to C++.")
+        else:
+            _print_summary(results)
+        if opts['--summary']:
+            Path(opts['--summary']).write_text(json.dumps(results, indent=2), encoding="utf-8")
+        if any('error' in r for r in results): sys.exit(1)
+        return
+    if "--bench" in args:
+        args.remove("--bench"); opts = {'--baud': '115200', '--json': None, '--work': None}
+        for k in opts:
+            if k in args:
+                i = args.index(k); opts[k] = args[i + 1] if i + 1 < len(args) else None; del args[i:i + 2]
+        try:
+            r = bench_project(args[0] if args else project_file, int(opts['--baud']), opts['--work'])
+        except Exception as e:
+            print(f"Benchmark failed: {e}"); sys.exit(1)
+        _print_bench(r)
+        if opts['--json']: Path(opts['--json']).write_text(json.dumps(r, indent=2), encoding="utf-8")
+        if not (r['viewer_match'] and r['lz_match'] and r['renderer_match'] and r['lanes_match']): sys.exit(1)
+        return
+    if "--sweep" in args:
+        args.remove("--sweep")
+        opts = {'--bauds': None, '--fifo': '64', '--cpu-scale': '1', '--budget': '100', '--json': None, '--work': None}
+        for k in opts:
+            if k in args:
+                i = args.index(k); opts[k] = args[i + 1] if i + 1 < len(args) else None; del args[i:i + 2]
+        try:
+            bauds = tuple(int(b) for b in opts['--bauds'].split(",")) if opts['--bauds'] else SWEEP_BAUDS
+            r = sweep_project(args[0] if args else project_file, bauds, opts['--work'], int(opts['--fifo']), float(opts['--cpu-scale']))
+        except Exception as e:
+            print(f"Sweep failed: {e}"); sys.exit(1)
+        _print_sweep(r, float(opts['--budget']))
+        if opts['--json']: Path(opts['--json']).write_text(json.dumps(r, indent=2), encoding="utf-8")
+        return
+    if "--stress" in args:
+        args.remove("--stress")
+        opts = {'--vary': None, '--elements': '100', '--screens': '1', '--mix': None, '--overlap': '0.3', '--depth': '0',
+                '--text-len': '12', '--size': '80x24', '--seed': '1', '--write': None, '--json': None, '--work': None}
+        for k in opts:
+            if k in args:
+                i = args.index(k); opts[k] = args[i + 1] if i + 1 < len(args) else None; del args[i:i + 2]
+        build = "--no-build" not in args
+        if not build: args.remove("--no-build")
+        try:
+            w, h = (int(v) for v in opts['--size'].lower().split("x"))
+            mix = None
+            if opts['--mix']:
+                mix = {}
+                for t in opts['--mix'].split(","):
+                    kind, sep, weight = t.partition(":")
+                    if not sep: raise ValueError(f"--mix entry {t!r} is not type:weight")
+                    mix[kind.strip().upper()] = int(weight)
+            params = {'elements': int(opts['--elements']), 'screens': int(opts['--screens']), 'mix': mix,
+                      'overlap': float(opts['--overlap']), 'depth': int(opts['--depth']), 'text_len': int(opts['--text-len']),
+                      'width': w, 'height': h, 'seed': int(opts['--seed'])}
+            if opts['--write']:
+                ProjectManager(opts['--write']).save_json_state(synth_project(**params))
+                print(f"Wrote {opts['--write']}."); return
+            vary, values = "elements", (100, 500, 1000, 2000, 5000)
+            if opts['--vary']:
+                vary, vals = opts['--vary'].split("=", 1); vary = vary.replace("-", "_")
+                if vary not in params or vary == 'mix': raise ValueError(f"cannot vary {vary}")
+                values = tuple(type(params[vary])(x) for x in vals.split(","))
+            params.pop(vary)
+            rows = stress_bench(vary, values, opts['--work'], build, **params)
+        except Exception as e:
+            print(f"Stress run failed: {e}"); sys.exit(1)
+        _print_stress(rows)
+        if opts['--json']: Path(opts['--json']).write_text(json.dumps(rows, indent=2), encoding="utf-8")
+        return
+    if "--trace" in args:
+        args.remove("--trace"); opts = {'--work': None, '--chrome': None, '--baud': '115200'}
+        for k in opts:
+            if k in args:
+                i = args.index(k); opts[k] = args[i + 1] if i + 1 < len(args) else None; del args[i:i + 2]
+        try:
+            print(trace_project(args[0] if args else project_file, opts['--work'], opts['--chrome'], int(opts['--baud'])))
+        except Exception as e:
+            print(f"Trace failed: {e}"); sys.exit(1)
+        return
+    if "--snapshot" in args:
+        i = args.index("--snapshot")
         try:
-            proj = pm.load_project(); pm.save_project(proj)
-            print(f"Compiled {project_file} to C++.")
-        except Exception as e: print(f"Failed: {e}")
+            fr = read_frame(args[i + 1] if i + 1 < len(args) else "/dev/shm/serialui")
+        except Exception as e:
+            print(f"Snapshot failed: {e}"); sys.exit(1)
+        print(f"frame {fr['frame']}, {fr['width']}x{fr['height']}, cursor {fr['cursor'][0]},{fr['cursor'][1]}")
+        for row in fr['rows']: print("".join(c for c, *_ in row).rstrip())
         return
+    if "--viewer" in args:
+        i = args.index("--viewer"); out = Path(args[i + 1] if i + 1 < len(args) else ".")
+        out.mkdir(parents=True, exist_ok=True)
+        (out / "ui_viewer.cpp").write_text(UI_VIEWER_SOURCE, encoding="utf-8")
+        (out / ProjectManager.LIB_FILE).write_text(SERIAL_UI_HEADER, encoding="utf-8")
+        print(f"Wrote {out / 'ui_viewer.cpp'}; build it with the project's ui_layout.cpp and -DSERIALUI_BINARY (add -DSERIALUI_COMPRESS for --lz).")
+        return
+    if args: project_file = args[0]
     try:
         curses.wrapper(lambda scr: Designer(scr, project_file).run())
     except Exception as e:
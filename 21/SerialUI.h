@@ -14,17 +14,28 @@
   #include <stdint.h>
   #include <string.h>
   #include <math.h>
+  #include <atomic>
+  #include <thread>
+  #include <mutex>
+  #include <condition_variable>
   #define PROGMEM
   #define pgm_read_ptr(ptr) (*(ptr))
   #define pgm_read_byte(ptr) (*(const uint8_t*)(ptr))
+  #define pgm_read_word(ptr) (*(const uint16_t*)(ptr))
 
   class MockSerial {
   public:
       void begin(long) {}
       void print(const char* s) { if(s) printf("%s", s); }
-      void print(int n) { printf("%d", n); }
+      void print(int n, int base = 10) { printf(base == 16 ? "%x" : "%d", n); }
+      void print(unsigned int n, int base = 10) { printf(base == 16 ? "%x" : "%u", n); }
+      void print(long n, int base = 10) { printf(base == 16 ? "%lx" : "%ld", n); }
+      void print(unsigned long n, int base = 10) { printf(base == 16 ? "%lx" : "%lu", n); }
       void print(float f) { printf("%f", f); }
+      void println(const char* s = "") { printf("%s\n", s); }
+      void println(int n, int base = 10) { print(n, base); printf("\n"); }
       void write(uint8_t c) { putchar(c); }
+      void write(const uint8_t* buf, size_t len) { fwrite(buf, 1, len, stdout); }
       operator bool() { return true; }
   };
   static MockSerial Serial;
@@ -37,6 +48,10 @@
       auto now = std::chrono::steady_clock::now();
       return std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
   }
+  inline uint32_t micros() {
+      static auto start = std::chrono::steady_clock::now();
+      return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  }
   inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
       return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
   }
@@ -59,47 +74,995 @@ struct UI_Text { int16_t x, y; const char* content; UI_Color color; };
 struct UI_Line { int16_t x1, y1, x2, y2; UI_Color color; };
 struct UI_Freehand { int16_t x, y; const char* const* lines; uint8_t count; UI_Color color; };
 
+// Terminal capabilities; drawing falls back to plain ASCII for what is missing.
+enum : uint8_t { UI_CAP_UTF8 = 0x01 };
+#ifndef SERIALUI_CAPS
+  #define SERIALUI_CAPS 0
+#endif
+
+// What a bar, gauge or progress bar currently shows: the fill in 1/8 cells
+// (0xFFFF: unknown, draw all) and its colour. `band` is a hysteresis in value
+// units: the display holds while the value stays within `band` of one that would
+// show the current fill, so noise around a cell boundary does not flicker.
+struct UI_BarState {
+    uint16_t shown = 0xFFFF;
+    uint16_t band = 0;
+    UI_Color color = UI_Color::WHITE;
+    UI_BarState() {}
+    explicit UI_BarState(uint16_t hysteresis) : band(hysteresis) {}
+    void reset() { shown = 0xFFFF; }
+};
+
+// Braille dot canvas over the interior of a box: 2x4 dots per cell. Each cell is
+// one byte of dot bits (the braille pattern) plus one byte for what the terminal
+// shows. Drawing only touches RAM; SerialUI::drawCanvas() sends changed cells.
+// Declare a UI_Canvas<COLS, ROWS>, which holds both buffers.
+class UI_CanvasBase {
+public:
+    UI_CanvasBase(const UI_CanvasBase&) = delete;
+    UI_CanvasBase& operator=(const UI_CanvasBase&) = delete;
+
+    int16_t width() const { return cols * 2; }
+    int16_t height() const { return rows * 4; }
+    void clear() { memset(dots, 0, (size_t)cols * rows); }
+    void setPixel(int16_t x, int16_t y, bool on = true) {
+        if (x < 0 || y < 0 || x >= cols * 2 || y >= rows * 4) return;
+        uint8_t& c = dots[(y >> 2) * cols + (x >> 1)];
+        uint8_t bit = dotBit(x & 1, y & 3);
+        c = on ? (c | bit) : (c & ~bit);
+    }
+    bool pixel(int16_t x, int16_t y) const {
+        if (x < 0 || y < 0 || x >= cols * 2 || y >= rows * 4) return false;
+        return dots[(y >> 2) * cols + (x >> 1)] & dotBit(x & 1, y & 3);
+    }
+    // Bresenham; dots outside the canvas are clipped.
+    void line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, bool on = true) {
+        int16_t dx = x1 > x0 ? x1 - x0 : x0 - x1, dy = y1 > y0 ? y0 - y1 : y1 - y0;
+        int16_t sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1, err = dx + dy;
+        for (;;) {
+            setPixel(x0, y0, on);
+            if (x0 == x1 && y0 == y1) break;
+            int16_t e2 = 2 * err;
+            if (e2 >= dy) { err += dy; x0 += sx; }
+            if (e2 <= dx) { err += dx; y0 += sy; }
+        }
+    }
+    // The next drawCanvas() sends every cell, e.g. after drawScreen_X cleared the area.
+    void invalidate() { stale = true; }
+
+    UI_Box box;
+    UI_Color color;
+
+protected:
+    UI_CanvasBase(const UI_Box& b, UI_Color c, int16_t w, int16_t h, uint8_t* buf)
+        : box(b), color(c), cols(w), rows(h), dots(buf), shown(buf + w * h) { clear(); }
+
+private:
+    friend class SerialUI;
+    // braille dot numbering: 1-3 and 7 down the left column, 4-6 and 8 down the right
+    static uint8_t dotBit(uint8_t dx, uint8_t dy) { return dy < 3 ? 1 << (dy + 3 * dx) : 0x40 << dx; }
+    int16_t cols, rows;
+    uint8_t* dots;
+    uint8_t* shown;
+    bool stale = true;
+};
+
+template<int16_t COLS, int16_t ROWS>
+class UI_Canvas : public UI_CanvasBase {
+public:
+    explicit UI_Canvas(const UI_Box& b, UI_Color c = UI_Color::WHITE) : UI_CanvasBase(b, c, COLS, ROWS, buf) {}
+private:
+    uint8_t buf[2 * COLS * ROWS];
+};
+
+// Seven-segment number, 4 cells per digit (3x3 glyph + gap/decimal point).
+// `shown` is a RAM array of `digits` bytes holding the segments on screen.
+struct UI_BigNum { int16_t x, y; uint8_t digits; UI_Color color; uint8_t* shown; };
+
+// Localized text: the content is string `id` of the current language's table.
+struct UI_LText { int16_t x, y; uint16_t id; UI_Color color; };
+
+// One language's strings in PROGMEM, byte-pair compressed by the generator:
+// bytes flagged in `codes` (a 256-bit set) expand to the pair listed for them in
+// `pairs` (code, first, second), recursively. Strings are 0-terminated in `data`.
+struct UI_StringTable {
+    const uint8_t* data;
+    const uint16_t* offsets;
+    const uint8_t* pairs;
+    const uint8_t* codes;
+    uint8_t npairs;
+};
+
+#ifndef SERIALUI_STR_STACK
+  #define SERIALUI_STR_STACK 8 // pair nesting depth + 1; the generator keeps within it
+#endif
+
+// Streams one decoded string out of a table without a RAM copy.
+class UI_StrReader {
+public:
+    UI_StrReader(const UI_StringTable* t, uint16_t id) {
+        if (!t) return;
+        p = (const uint8_t*)pgm_read_ptr(&t->data) + pgm_read_word((const uint16_t*)pgm_read_ptr(&t->offsets) + id);
+        pairs = (const uint8_t*)pgm_read_ptr(&t->pairs);
+        codes = (const uint8_t*)pgm_read_ptr(&t->codes);
+        np = pgm_read_byte(&t->npairs);
+    }
+    // Next byte of the string, or -1 at its end.
+    int next() {
+        for (;;) {
+            uint8_t c;
+            if (sp) c = stack[--sp];
+            else {
+                if (!p) return -1;
+                c = pgm_read_byte(p++);
+                if (!c) { p = nullptr; return -1; }
+            }
+            if (!(pgm_read_byte(codes + (c >> 3)) & (1 << (c & 7)))) return c;
+            for (uint8_t i = 0; i < np; i++) {
+                if (pgm_read_byte(pairs + 3 * i) != c) continue;
+                stack[sp++] = pgm_read_byte(pairs + 3 * i + 2);
+                stack[sp++] = pgm_read_byte(pairs + 3 * i + 1);
+                break;
+            }
+        }
+    }
+    // Next character cell (a byte plus any UTF-8 continuation bytes) into g; 0 at the end.
+    uint8_t glyph(uint8_t* g) {
+        int c = next();
+        if (c < 0) return 0;
+        uint8_t n = 0; g[n++] = (uint8_t)c;
+        uint8_t tail = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+        while (tail-- && (c = next()) >= 0) g[n++] = (uint8_t)c;
+        return n;
+    }
+private:
+    const uint8_t* p = nullptr;
+    const uint8_t* pairs = nullptr;
+    const uint8_t* codes = nullptr;
+    uint8_t np = 0, sp = 0;
+    uint8_t stack[SERIALUI_STR_STACK];
+};
+
+// Output classes for SERIALUI_PRIORITY_LANES; without lanes everything is sent in call order.
+enum class UI_Priority : uint8_t { CRITICAL = 0, NORMAL = 1, BACKGROUND = 2 };
+
+#ifdef SERIALUI_BINARY
+  #ifdef SERIALUI_PRIORITY_LANES
+    #error "SERIALUI_BINARY cannot be combined with SERIALUI_PRIORITY_LANES"
+  #endif
+// --- BINARY DISPLAY PROTOCOL ---
+// For links where both ends are ours (see UI_BinaryDecoder). Bytes 0x20..0xFF
+// are glyphs and pass through as is; 0x00..0x1F are opcodes with fixed arguments.
+enum : uint8_t {
+    UI_OP_MOVE = 0x01,   // x, y: cursor to cell (x, y), both < 256
+    UI_OP_MOVE16 = 0x02, // x, y as 16-bit little-endian values
+    UI_OP_STYLE = 0x03,  // SGR code, 0 resets
+    UI_OP_FILL = 0x04,   // x, y, w, h, glyph in the current style
+    UI_OP_BLIT = 0x05,   // id (16-bit LE): draw element `id` of the UI_ElementTable
+    UI_OP_HELLO = 0x06,  // version, element count (16-bit LE)
+    UI_OP_LIT = 0x1F     // next byte is literal: control bytes and raw escape sequences
+};
+#define UI_PROTOCOL_VERSION 1
+
+// Layout elements a BLIT can name. The generated ui_layout.cpp registers its
+// table at startup, so a device and a viewer built from it agree on the ids.
+struct UI_ElementRef { const void* e; uint8_t kind; };
+
+class UI_ElementTable {
+public:
+    enum : uint8_t { BOX, TEXT, LINE, FREEHAND };
+    UI_ElementTable(const UI_ElementRef* refs, uint16_t count) : refs(refs), count(count) {
+        for (uint16_t i = 0; i < count; i++) {
+            uintptr_t a = (uintptr_t)pgm_read_ptr(&refs[i].e);
+            if (!i || a < lo) lo = a;
+            if (!i || a > hi) hi = a;
+        }
+        active() = this;
+    }
+    static const UI_ElementTable*& active() { static const UI_ElementTable* t = nullptr; return t; }
+    // Screens draw their elements in table order, so the scan starts after the
+    // last hit and a paint costs O(1) per element. Copies (a recoloured box on
+    // the stack) fall outside the table's address range and miss at once.
+    int16_t find(const void* e) const {
+        uintptr_t a = (uintptr_t)e;
+        if (!count || a < lo || a > hi) return -1;
+        for (uint16_t k = 0, i = next; k < count; k++, i = i + 1 < count ? i + 1 : 0) {
+            if (pgm_read_ptr(&refs[i].e) != e) continue;
+            next = i + 1 < count ? i + 1 : 0;
+            return (int16_t)i;
+        }
+        return -1;
+    }
+    const void* get(uint16_t id, uint8_t& kind) const {
+        if (id >= count) return nullptr;
+        kind = pgm_read_byte(&refs[id].kind);
+        return pgm_read_ptr(&refs[id].e);
+    }
+    const UI_ElementRef* const refs;
+    const uint16_t count;
+private:
+    uintptr_t lo = 0, hi = 0;
+    mutable uint16_t next = 0;
+};
+
+  #ifndef SERIALUI_VIEWPORT
+    // A layout element sent whole is one BLIT (the viewer cannot clip to a window).
+    #define SERIALUI_BLIT(e) if (blit(e)) return
+  #endif
+#endif
+#ifndef SERIALUI_BLIT
+  #define SERIALUI_BLIT(e)
+#endif
+enum class UI_Protocol : uint8_t { ANSI, BINARY };
+
+#ifdef SERIALUI_COMPRESS
+  #ifdef SERIALUI_PRIORITY_LANES
+    #error "SERIALUI_COMPRESS cannot be combined with SERIALUI_PRIORITY_LANES"
+  #endif
+// --- STREAM COMPRESSION ---
+// LZ77 over a sliding window plus a PROGMEM dictionary of escape sequences and
+// the project's strings (emitted by the generator). Literal bytes pass through
+// unchanged; 0xFF, which never occurs in UTF-8, starts a token:
+//   FF 00             literal 0xFF
+//   FF 01 n lo hi     reset: empty window of 1 << n bytes, dictionary of lo|hi<<8 bytes;
+//                     n = 0 ends compression and later bytes pass through as-is
+//   FF L D            L = 2..127: copy L + 1 bytes from D + 1 bytes back in the window
+//   FF L lo hi        L = 128..255: copy L - 125 bytes from dictionary offset lo|hi<<8
+  #ifndef SERIALUI_LZ_WINDOW_BITS
+    #define SERIALUI_LZ_WINDOW_BITS 7   // 128 bytes of RAM; at most 8
+  #endif
+  #define SERIALUI_LZ_WINDOW (1 << SERIALUI_LZ_WINDOW_BITS)
+  #define SERIALUI_LZ_HASH 64           // window hash heads in RAM; the dictionary has 256 in flash
+
+inline uint8_t uiLzHash(uint8_t a, uint8_t b, uint8_t c) { return (uint8_t)((a << 4) ^ (b << 2) ^ c ^ (a >> 4)); }
+
+// Registered at startup by the generated ui_layout.cpp, like UI_ElementTable.
+class UI_LzDict {
+public:
+    UI_LzDict(const uint8_t* data, uint16_t size, const uint16_t* heads) : data(data), size(size), heads(heads) { active() = this; }
+    static const UI_LzDict*& active() { static const UI_LzDict* d = nullptr; return d; }
+    const uint8_t* const data;
+    const uint16_t size;
+    const uint16_t* const heads;  // 256 first offsets per hash, 0xFFFF when none
+};
+#endif
+
+#ifdef SERIALUI_PRIORITY_LANES
+  #ifndef SERIALUI_ASYNC_TX
+    #define SERIALUI_ASYNC_TX
+  #endif
+  // Ring sizes per lane. A record bigger than its lane is sent in pieces.
+  #ifndef SERIALUI_LANE_CRITICAL
+    #define SERIALUI_LANE_CRITICAL 64
+  #endif
+  #ifndef SERIALUI_LANE_NORMAL
+    #define SERIALUI_LANE_NORMAL 256
+  #endif
+  #ifndef SERIALUI_LANE_BACKGROUND
+    #define SERIALUI_LANE_BACKGROUND 128
+  #endif
+  // Pending value updates tracked for latest-value-wins coalescing (0 disables).
+  #ifndef SERIALUI_COALESCE_SLOTS
+    #define SERIALUI_COALESCE_SLOTS 8
+  #endif
+  // Each public drawing call becomes one record: the unit lanes are switched on.
+  // Keyed records target the region they paint; a newer one of the same kind
+  // replaces an unsent older one.
+  #define SERIALUI_RECORD() RecordScope uiRecord_(*this)
+  #define SERIALUI_RECORD_KEYED(kind, x, y, w) RecordScope uiRecord_(*this, kind, x, y, w)
+#else
+  #define SERIALUI_RECORD()
+  #define SERIALUI_RECORD_KEYED(kind, x, y, w)
+#endif
+
+#ifdef SERIALUI_TRACE
+  #ifndef SERIALUI_TRACE_RING
+    #define SERIALUI_TRACE_RING 16  // most recent calls kept
+  #endif
+  #ifndef SERIALUI_TRACE_SITES
+    #define SERIALUI_TRACE_SITES 12 // call sites summed up for dump()
+  #endif
+  #define SERIALUI_TRACE_DEPTH 8    // nesting tracked for self time
+// --- TRACE ---
+// Traced calls (public SerialUI entry points and generated drawScreen_*/user
+// functions) record entry time, duration and the bytes produced while they
+// ran. The ring keeps the latest calls; sites keep totals per call site, with
+// self time and bytes excluding nested traced calls.
+class UI_Trace {
+public:
+    struct Event { const char* name; uint32_t at, us; uint16_t bytes; uint8_t depth; };
+    struct Site { const char* name; uint32_t calls, us, selfUs, maxUs, bytes; };
+    static UI_Trace& get() { static UI_Trace t; return t; }
+
+    uint32_t bytes = 0; // every byte SerialUI has produced
+
+#ifndef ARDUINO
+    // Host tools such as UI_ChromeTrace see every finished call and TX wait.
+    class Observer {
+    public:
+        virtual ~Observer() {}
+        virtual void call(const Event& e) = 0;
+        virtual void blocked(uint32_t at, uint32_t us) = 0;
+    };
+    void setObserver(Observer* o) { observer = o; }
+#endif
+
+    void enter() {
+        if (depth < SERIALUI_TRACE_DEPTH) { childUs[depth] = 0; childBytes[depth] = 0; }
+        depth++;
+    }
+    void leave(const char* name, uint32_t at, uint32_t bytes0) {
+        uint32_t us = micros() - at, b = bytes - bytes0, selfUs = us, selfB = b;
+        depth--;
+        if (depth < SERIALUI_TRACE_DEPTH) { selfUs -= childUs[depth]; selfB -= childBytes[depth]; }
+        if (depth && depth <= SERIALUI_TRACE_DEPTH) { childUs[depth - 1] += us; childBytes[depth - 1] += b; }
+        Event& e = ring[head];
+        e.name = name; e.at = at; e.us = us; e.bytes = b > 0xFFFF ? 0xFFFF : (uint16_t)b; e.depth = depth;
+        head = (head + 1) % SERIALUI_TRACE_RING;
+        if (held < SERIALUI_TRACE_RING) held++;
+        calls++;
+#ifndef ARDUINO
+        if (observer) observer->call(e);
+#endif
+        Site* st = site(name);
+        if (!st) { dropped++; return; }
+        st->calls++; st->us += us; st->selfUs += selfUs; st->bytes += selfB;
+        if (us > st->maxUs) st->maxUs = us;
+    }
+    // Time the composer spent waiting for the TX backend to take a chunk.
+    void blocked(uint32_t at, uint32_t us) {
+        blockedUs += us;
+#ifndef ARDUINO
+        if (observer) observer->blocked(at, us);
+#endif
+    }
+    // i = 0 is the oldest call still in the ring.
+    uint8_t events() const { return held; }
+    const Event& event(uint8_t i) const { return ring[(head + SERIALUI_TRACE_RING - held + i) % SERIALUI_TRACE_RING]; }
+    // Clears the ring and the sites; call it outside traced calls.
+    void reset() { head = held = 0; calls = dropped = blockedUs = 0; memset(sites, 0, sizeof(sites)); }
+
+    // Prints the `top` sites by self time, then the `recent` latest calls. On the
+    // host this goes to stderr, on a board to Serial.
+    void dump(uint8_t top = 8, uint8_t recent = 0) const {
+        char line[96], nm[28];
+        snprintf(line, sizeof(line), "trace: %lu calls, %lu outside the site table, %lu us blocked on TX\n",
+                 (unsigned long)calls, (unsigned long)dropped, (unsigned long)blockedUs);
+        out(line);
+        out("site                          calls   total_us    self_us     max_us      bytes\n");
+        uint32_t shown = 0;
+        for (uint8_t k = 0; k < top; k++) {
+            int8_t best = -1;
+            for (uint8_t i = 0; i < SERIALUI_TRACE_SITES; i++)
+                if (sites[i].name && !(shown >> i & 1) && (best < 0 || sites[i].selfUs > sites[best].selfUs)) best = i;
+            if (best < 0) break;
+            shown |= 1UL << best;
+            const Site& st = sites[best];
+            snprintf(line, sizeof(line), "%-28s %6lu %10lu %10lu %10lu %10lu\n", name(st.name, nm, sizeof(nm)), (unsigned long)st.calls,
+                     (unsigned long)st.us, (unsigned long)st.selfUs, (unsigned long)st.maxUs, (unsigned long)st.bytes);
+            out(line);
+        }
+        if (recent > held) recent = held;
+        for (uint8_t i = held - recent; i < held; i++) {
+            const Event& e = event(i);
+            snprintf(line, sizeof(line), "%10lu %*s%s %luus %ub\n", (unsigned long)e.at, 2 * e.depth, "", name(e.name, nm, sizeof(nm)),
+                     (unsigned long)e.us, (unsigned)e.bytes);
+            out(line);
+        }
+    }
+
+private:
+    static_assert(SERIALUI_TRACE_SITES <= 32, "dump() marks sites in a 32-bit mask");
+    Site* site(const char* name) {
+        for (uint8_t i = 0; i < SERIALUI_TRACE_SITES; i++) {
+            if (sites[i].name == name) return &sites[i];
+            if (!sites[i].name) { sites[i].name = name; return &sites[i]; }
+        }
+        return nullptr;
+    }
+    static const char* name(const char* p, char* buf, uint8_t n) {
+        uint8_t i = 0;
+        for (char c; i < n - 1 && (c = (char)pgm_read_byte(p + i)); i++) buf[i] = c;
+        buf[i] = 0;
+        return buf;
+    }
+#ifdef ARDUINO
+    static void out(const char* s) { Serial.print(s); }
+#else
+    static void out(const char* s) { fputs(s, stderr); }
+#endif
+
+    Event ring[SERIALUI_TRACE_RING];
+    Site sites[SERIALUI_TRACE_SITES] = {};
+    uint32_t childUs[SERIALUI_TRACE_DEPTH], childBytes[SERIALUI_TRACE_DEPTH];
+    uint32_t calls = 0, dropped = 0, blockedUs = 0;
+    uint8_t head = 0, held = 0, depth = 0;
+#ifndef ARDUINO
+    Observer* observer = nullptr;
+#endif
+};
+
+class UI_TraceScope {
+public:
+    explicit UI_TraceScope(const char* name) : name(name), bytes(UI_Trace::get().bytes) { UI_Trace::get().enter(); at = micros(); }
+    ~UI_TraceScope() { UI_Trace::get().leave(name, at, bytes); }
+private:
+    const char* name;
+    uint32_t bytes, at;
+};
+  // Names live in flash; each use is one call site.
+  #define SERIALUI_TRACE_CALL(name) static const char uiTraceName_[] PROGMEM = name; UI_TraceScope uiTrace_(uiTraceName_)
+#else
+  #define SERIALUI_TRACE_CALL(name)
+#endif
+
+#ifdef SERIALUI_SERVICE
+  // Elements and callbacks that can wait for service() at the same time.
+  #ifndef SERIALUI_PENDING
+    #define SERIALUI_PENDING 16
+  #endif
+#endif
+
+#ifdef SERIALUI_VIEWPORT
+  // Terminal size the canvas is shown through until setViewport() is called.
+  #ifndef SERIALUI_VIEW_W
+    #define SERIALUI_VIEW_W 80
+  #endif
+  #ifndef SERIALUI_VIEW_H
+    #define SERIALUI_VIEW_H 24
+  #endif
+#endif
+
+#ifdef SERIALUI_ASYNC_TX
+// --- ASYNC TX BACKEND ---
+// A backend moves one buffer to the wire in the background (DMA, UART ISR,
+// host thread) and calls complete() once the buffer may be reused. SerialUI
+// keeps two chunks: one in flight, one being composed.
+#ifndef SERIALUI_TX_CHUNK
+  #define SERIALUI_TX_CHUNK 64
+#endif
+
+#ifdef ARDUINO
+  typedef volatile bool UI_TxFlag;
+#else
+  typedef std::atomic<bool> UI_TxFlag;
+#endif
+
+class UI_TxBackend {
+public:
+    typedef void (*CompleteFn)(void* ctx);
+    virtual ~UI_TxBackend() {}
+    // buf must stay untouched until the completion callback fires.
+    virtual bool startTransfer(const uint8_t* buf, uint16_t len) = 0;
+    virtual bool busy() const = 0;
+    void setCompleteCallback(CompleteFn fn, void* ctx) { onComplete = fn; onCompleteCtx = ctx; }
+protected:
+    void complete() { if (onComplete) onComplete(onCompleteCtx); }
+private:
+    CompleteFn onComplete = nullptr;
+    void* onCompleteCtx = nullptr;
+};
+
+#ifndef ARDUINO
+// Host stand-in for a DMA UART: a worker thread writes each buffer to `out`
+// and holds the backend busy for as long as the bytes would take on an 8N1
+// link at `baud`, so the pipeline can be exercised without hardware.
+class HostThreadTx : public UI_TxBackend {
+public:
+    explicit HostThreadTx(long baud = 115200, FILE* out = stdout)
+        : baud(baud), out(out), wireFree(std::chrono::steady_clock::now()), worker(&HostThreadTx::run, this) {}
+    ~HostThreadTx() {
+        {
+            std::unique_lock<std::mutex> lk(m);
+            idle.wait(lk, [this] { return !pending && !inFlight; });
+            stop = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+    bool startTransfer(const uint8_t* b, uint16_t n) override {
+        std::lock_guard<std::mutex> lk(m);
+        if (inFlight) return false;
+        buf = b; len = n; inFlight = true; pending = true;
+        wake.notify_one();
+        return true;
+    }
+    bool busy() const override { return inFlight; }
+    void setBaud(long b) { baud = b; }
+    // Called on the worker thread for each buffer with its slot on the simulated
+    // wire, in micros() time.
+    typedef void (*WireFn)(uint32_t at, uint32_t us, uint16_t n, void* ctx);
+    void setWireHook(WireFn fn, void* ctx) { std::lock_guard<std::mutex> lk(m); wireFn = fn; wireCtx = ctx; }
+    uint32_t bytesSent() const { return sent; }
+    // Total time the simulated wire spent shifting bytes out.
+    uint32_t wireMicros() const { return wireUs; }
+private:
+    void run() {
+        std::unique_lock<std::mutex> lk(m);
+        while (true) {
+            wake.wait(lk, [this] { return stop || pending; });
+            if (!pending) return;
+            const uint8_t* b = buf; uint16_t n = len; long bd = baud;
+            WireFn hook = wireFn; void* hookCtx = wireCtx;
+            pending = false;
+            lk.unlock();
+            if (out) { fwrite(b, 1, n, out); fflush(out); }
+            auto dur = std::chrono::microseconds((long long)n * 10 * 1000000 / (bd > 0 ? bd : 1));
+            auto now = std::chrono::steady_clock::now();
+            if (wireFree < now) wireFree = now;
+            if (hook) hook(micros() + (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(wireFree - now).count(),
+                           (uint32_t)dur.count(), n, hookCtx);
+            wireFree += dur;
+            std::this_thread::sleep_until(wireFree);
+            sent += n; wireUs += (uint32_t)dur.count();
+            inFlight = false;
+            complete();
+            lk.lock();
+            idle.notify_all();
+        }
+    }
+    long baud;
+    FILE* out;
+    std::chrono::steady_clock::time_point wireFree;
+    std::mutex m;
+    std::condition_variable wake, idle;
+    const uint8_t* buf = nullptr;
+    uint16_t len = 0;
+    std::atomic<bool> inFlight{false};
+    bool pending = false, stop = false;
+    std::atomic<uint32_t> sent{0}, wireUs{0};
+    WireFn wireFn = nullptr;
+    void* wireCtx = nullptr;
+    std::thread worker;
+};
+#endif
+#endif
+
+#ifdef SERIALUI_FRAME_SINK
+  #ifdef ARDUINO
+    #error "SERIALUI_FRAME_SINK needs a POSIX host (Linux)"
+  #endif
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+// --- FRAME CAPTURE ---
+// Keeps the cells the terminal shows in a memory-mapped file (e.g. under
+// /dev/shm), so screenshotters and test harnesses can read the screen without
+// parsing the serial stream. A seqlock guards the cells: seq is odd while they
+// change and every publish makes it even, so a reader copies the cells, reads
+// seq again, and retries if it moved or was odd.
+struct UI_FrameHeader {
+    uint32_t magic;             // 'SUIF'
+    uint16_t version, headerSize;
+    uint16_t width, height;
+    std::atomic<uint32_t> seq;  // seq / 2 frames published
+    int16_t cursorX, cursorY;
+    uint32_t reserved;
+};
+// fg/bg hold SGR codes (0 = terminal default); attr bits are bold, dim,
+// italic, underline, blink, reverse from bit 0.
+struct UI_Cell { uint32_t ch; uint8_t fg, bg, attr, pad; };
+static_assert(sizeof(UI_FrameHeader) == 24 && sizeof(UI_Cell) == 8, "frame file layout");
+
+class UI_FrameSink {
+public:
+    UI_FrameSink(const char* path, uint16_t w = 80, uint16_t h = 24) : w(w), h(h), bot(h - 1) {
+        size = sizeof(UI_FrameHeader) + (size_t)w * h * sizeof(UI_Cell);
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, (off_t)size)) { if (fd >= 0) close(fd); return; }
+        void* m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (m == MAP_FAILED) return;
+        hdr = new (m) UI_FrameHeader();
+        hdr->magic = 0x46495553; hdr->version = 1; hdr->headerSize = sizeof(UI_FrameHeader);
+        hdr->width = w; hdr->height = h;
+        cells = (UI_Cell*)(hdr + 1);
+        clear(0, (size_t)w * h);
+        publish();
+    }
+    ~UI_FrameSink() { if (hdr) munmap(hdr, size); }
+    UI_FrameSink(const UI_FrameSink&) = delete;
+    UI_FrameSink& operator=(const UI_FrameSink&) = delete;
+
+    bool ok() const { return hdr != nullptr; }
+    uint32_t frames() const { return hdr ? hdr->seq.load(std::memory_order_relaxed) / 2 : 0; }
+
+    // Ends a frame: readers see every cell written so far.
+    void publish() {
+        if (!writing) return;
+        writing = false;
+        hdr->cursorX = cx; hdr->cursorY = cy;
+        hdr->seq.store(hdr->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // One byte of the ANSI stream, as the terminal would interpret it.
+    void put(uint8_t c) {
+        if (!hdr) return;
+        if (state == 1) { esc(c); return; }
+        if (state == 2) { csi(c); return; }
+        if (utfLeft) {
+            if ((c & 0xC0) == 0x80) { utf = utf << 6 | (c & 0x3F); if (--utfLeft == 0) glyph(utf); return; }
+            utfLeft = 0;
+        }
+        if (c == 0x1b) state = 1;
+        else if (c == '\r') cx = 0;
+        else if (c == '\n') { if (cy < h - 1) cy++; }
+        else if (c == '\b') { if (cx) cx--; }
+        else if (c >= 0xC0) { utf = c & (c >= 0xF0 ? 0x07 : c >= 0xE0 ? 0x0F : 0x1F); utfLeft = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : 1; }
+        else if (c >= 0x20 && c != 0x7F) glyph(c);
+    }
+
+private:
+    void esc(uint8_t c) {
+        state = 0;
+        if (c == '[') { state = 2; np = 0; par[0] = 0; priv = false; }
+        else if (c == '7') { sx = cx; sy = cy; sfg = fg; sbg = bg; sattr = attr; }
+        else if (c == '8') { cx = sx; cy = sy; fg = sfg; bg = sbg; attr = sattr; }
+    }
+    void csi(uint8_t c) {
+        if (c >= '0' && c <= '9') { par[np] = par[np] * 10 + (c - '0'); return; }
+        if (c == ';') { if (np < 7) par[++np] = 0; return; }
+        if (c == '?') { priv = true; return; }
+        state = 0;
+        if (priv) return;
+        uint16_t n = par[0] ? par[0] : 1;
+        int ex = std::min<int>(cx, w - 1); // past the last glyph cx == w; erase as a pending wrap would
+        switch (c) {
+            case 'H': case 'f': cy = clampY(n - 1); cx = clampX((np ? (par[1] ? par[1] : 1) : 1) - 1); break;
+            case 'A': cy = clampY(cy - n); break;
+            case 'B': cy = clampY(cy + n); break;
+            case 'C': cx = clampX(cx + n); break;
+            case 'D': cx = clampX(cx - n); break;
+            case 'G': cx = clampX(n - 1); break;
+            case 'J':
+                if (par[0] == 0) clear(at(ex, cy), (size_t)w * h);
+                else if (par[0] == 1) clear(0, at(ex, cy) + 1);
+                else clear(0, (size_t)w * h);
+                break;
+            case 'K':
+                if (par[0] == 0) clear(at(ex, cy), at(0, cy) + w);
+                else if (par[0] == 1) clear(at(0, cy), at(ex, cy) + 1);
+                else clear(at(0, cy), at(0, cy) + w);
+                break;
+            case 'X': clear(at(cx, cy), at(cx, cy) + std::min<int>(n, w - cx)); break;
+            case 'P': case '@': shiftRow(c == 'P' ? n : -(int)n); break;
+            case 'S': case 'T': scroll(c == 'S' ? n : -(int)n); break;
+            case 'r': // scroll region, cursor homes
+                top = (int16_t)(n - 1); bot = (int16_t)(np && par[1] ? par[1] - 1 : h - 1);
+                if (top >= bot || bot >= h) { top = 0; bot = h - 1; }
+                cx = cy = 0;
+                break;
+            case 'm': for (uint8_t i = 0; i <= np; i++) sgr(par[i]); break;
+        }
+    }
+    void sgr(uint16_t p) {
+        static const uint8_t bits[] = { 0, 1, 2, 4, 8, 16, 0, 32 };
+        if (p == 0) { fg = bg = attr = 0; }
+        else if (p <= 7) attr |= bits[p];
+        else if ((p >= 30 && p <= 37) || (p >= 90 && p <= 97)) fg = (uint8_t)p;
+        else if ((p >= 40 && p <= 47) || (p >= 100 && p <= 107)) bg = (uint8_t)p;
+        else if (p == 39) fg = 0;
+        else if (p == 49) bg = 0;
+    }
+    void glyph(uint32_t ch) {
+        if (cx >= w) return; // no autowrap; the library positions every run
+        begin();
+        UI_Cell& k = cells[at(cx, cy)];
+        k.ch = ch; k.fg = fg; k.bg = bg; k.attr = attr;
+        cx++;
+    }
+    void clear(size_t from, size_t to) {
+        begin();
+        for (size_t i = from; i < to; i++) { cells[i].ch = ' '; cells[i].fg = 0; cells[i].bg = bg; cells[i].attr = 0; cells[i].pad = 0; }
+    }
+    void shiftRow(int n) {
+        if (n >= w - cx) n = w - cx;
+        if (-n >= w - cx) n = cx - w;
+        begin();
+        UI_Cell* row = cells + at(0, cy);
+        if (n > 0) { memmove(row + cx, row + cx + n, (w - cx - n) * sizeof(UI_Cell)); clear(at(w - n, cy), at(0, cy) + w); }
+        else if (n < 0) { memmove(row + cx - n, row + cx, (w - cx + n) * sizeof(UI_Cell)); clear(at(cx, cy), at(cx - n, cy)); }
+    }
+    void scroll(int n) {
+        int span = bot - top + 1;
+        if (n > span) n = span;
+        if (n < -span) n = -span;
+        begin();
+        UI_Cell* band = cells + at(0, top);
+        size_t rows = (size_t)(span - (n > 0 ? n : -n)) * w;
+        if (n > 0) { memmove(band, band + (size_t)n * w, rows * sizeof(UI_Cell)); clear(at(0, top) + rows, at(0, bot + 1)); }
+        else if (n < 0) { memmove(band - (ptrdiff_t)n * w, band, rows * sizeof(UI_Cell)); clear(at(0, top), at(0, top - n)); }
+    }
+    void begin() {
+        if (writing) return;
+        writing = true;
+        hdr->seq.store(hdr->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    size_t at(int x, int y) const { return (size_t)y * w + x; }
+    int16_t clampX(int x) const { return (int16_t)(x < 0 ? 0 : x >= w ? w - 1 : x); }
+    int16_t clampY(int y) const { return (int16_t)(y < 0 ? 0 : y >= h ? h - 1 : y); }
+
+    UI_FrameHeader* hdr = nullptr;
+    UI_Cell* cells = nullptr;
+    size_t size = 0;
+    uint16_t w, h;
+    int16_t cx = 0, cy = 0, sx = 0, sy = 0, top = 0, bot = 0;
+    uint8_t fg = 0, bg = 0, attr = 0, sfg = 0, sbg = 0, sattr = 0;
+    uint8_t state = 0, np = 0, utfLeft = 0;
+    uint16_t par[8];
+    uint32_t utf = 0;
+    bool priv = false, writing = false;
+};
+#endif
+
 class SerialUI {
 public:
+#ifdef SERIALUI_PRIORITY_LANES
+    SerialUI() {
+        lanes[0].init(laneMem, SERIALUI_LANE_CRITICAL);
+        lanes[1].init(laneMem + SERIALUI_LANE_CRITICAL, SERIALUI_LANE_NORMAL);
+        lanes[2].init(laneMem + SERIALUI_LANE_CRITICAL + SERIALUI_LANE_NORMAL, SERIALUI_LANE_BACKGROUND);
+    }
+#endif
+
     void begin(long baud = 115200) {
+        SERIALUI_TRACE_CALL("begin");
+        SERIALUI_RECORD();
         Serial.begin(baud);
         while (!Serial) delay(10);
-        Serial.print("\x1b[?25l"); // Hide cursor
+        put("\x1b[?25l"); // Hide cursor
         clearScreen();
     }
-    void clearScreen() { Serial.print("\x1b[2J\x1b[H"); }
-    void resetAttr() { Serial.print("\x1b[0m"); }
+    void clearScreen() { SERIALUI_RECORD(); SERIALUI_TRACE_CALL("clearScreen"); put("\x1b[2J\x1b[H"); settle(); }
+#ifdef SERIALUI_VIEWPORT
+    // Colours are held back until something visible is drawn, so elements
+    // that are entirely clipped cost no bytes at all.
+    void resetAttr() {
+        pendFg = pendBg = 0;
+        if (attrSent) { attrSent = false; sgr(0); }
+        settle();
+    }
 
     void setColor(UI_Color color) {
-        Serial.print("\x1b["); Serial.print((int)color); Serial.print("m");
+        int c = (int)color;
+        if ((c >= 40 && c <= 47) || c >= 100) pendBg = (uint8_t)c; else pendFg = (uint8_t)c;
     }
+#else
+    void resetAttr() { sgr(0); settle(); }
+
+    void setColor(UI_Color color) { sgr((uint8_t)color); }
+#endif
 
     void moveCursor(int x, int y) {
-        Serial.print("\x1b["); Serial.print(y + 1); Serial.print(";"); Serial.print(x + 1); Serial.print("H");
+#ifdef SERIALUI_VIEWPORT
+        vcx = x; vcy = y;
+        curValid = visible(x, y);
+        if (!curValid) return;
+        x -= vpX; y -= vpY;
+#endif
+        cursorTo(x, y);
+    }
+
+#ifdef SERIALUI_COMPRESS
+    // Compresses everything sent from now on (ANSI or binary). A reset token
+    // starts the stream, so a decoder can join at that point.
+    void setCompression(bool on) {
+        SERIALUI_TRACE_CALL("setCompression");
+        lzFlush();
+        if (!on && !lzOn) return;
+        lzOn = false;
+        const UI_LzDict* d = UI_LzDict::active();
+        uint16_t n = on && d ? d->size : 0;
+        uint8_t hdr[5] = { 0xFF, 0x01, (uint8_t)(on ? SERIALUI_LZ_WINDOW_BITS : 0), (uint8_t)(n & 0xFF), (uint8_t)(n >> 8) };
+        for (uint8_t i = 0; i < 5; i++) wireByte(hdr[i]);
+        if (!on) return;
+        memset(lzHead, 0, sizeof(lzHead));
+        lzPos = 0; lzFill = 0; lzHeld = 0; lzLen = 0;
+        lzOn = true;
+    }
+    // Bytes handed to the compressor and bytes that left it, for the ratio.
+    uint32_t rawBytes() const { return lzRaw; }
+    uint32_t wireBytes() const { return lzWire; }
+#endif
+
+#ifdef SERIALUI_FRAME_SINK
+    // Mirrors the ANSI output into a capture file; nullptr detaches. Each drawing
+    // call publishes one frame. Binary output is not interpreted: capture it
+    // with the viewer's --capture instead.
+    void setFrameSink(UI_FrameSink* s) { settle(); frameSink = s; }
+#endif
+
+#ifdef SERIALUI_BINARY
+    // Switches between ANSI and the binary protocol; drawing code stays the same.
+    // Switching to BINARY announces it, so a viewer can check its layout.
+    void setProtocol(UI_Protocol p) {
+        SERIALUI_TRACE_CALL("setProtocol");
+        bin = p == UI_Protocol::BINARY;
+        if (!bin) return;
+        const UI_ElementTable* t = UI_ElementTable::active();
+        uint16_t n = t ? t->count : 0;
+        putByte(UI_OP_HELLO); putByte(UI_PROTOCOL_VERSION); putByte(n & 0xFF); putByte(n >> 8);
+    }
+    UI_Protocol protocol() const { return bin ? UI_Protocol::BINARY : UI_Protocol::ANSI; }
+#endif
+
+#ifdef SERIALUI_ASYNC_TX
+    ~SerialUI() { flush(); }
+
+    // Route all output through a background transmitter; nullptr returns to Serial.
+    void setTxBackend(UI_TxBackend* backend) {
+        SERIALUI_TRACE_CALL("setTxBackend");
+        flush();
+        tx = backend;
+        if (tx) tx->setCompleteCallback(&SerialUI::txDone, this);
+    }
+    // Hands a partially composed chunk to the backend if it is idle. Call from loop().
+    void poll() {
+        SERIALUI_TRACE_CALL("poll");
+        settle();
+        if (!tx) return;
+#ifdef SERIALUI_PRIORITY_LANES
+        if (!recDepth) laneCommit(lanes[(uint8_t)prio], 0);
+        fillChunk();
+#endif
+        if (txLen && !txInFlight && !tx->busy()) sendChunk();
+    }
+    // Blocks until every composed byte has left the backend.
+    void flush() {
+        SERIALUI_TRACE_CALL("flush");
+        settle();
+        if (!tx) return;
+#ifdef SERIALUI_PRIORITY_LANES
+        laneCommit(lanes[(uint8_t)prio], 0);
+        for (fillChunk(); txLen; fillChunk()) sendChunk();
+#else
+        if (txLen) sendChunk();
+#endif
+        txDrain();
+    }
+#else
+    void poll() { SERIALUI_TRACE_CALL("poll"); settle(); }
+    void flush() { SERIALUI_TRACE_CALL("flush"); settle(); }
+#endif
+
+#ifdef SERIALUI_PRIORITY_LANES
+    // Updates dropped because a newer one for the same region replaced them.
+    uint32_t coalescedCount() const { return coalesced; }
+#endif
+
+    // Selects the lane for subsequent drawing calls and returns the previous one.
+    // CRITICAL output overtakes queued NORMAL/BACKGROUND output.
+    UI_Priority setPriority(UI_Priority p) {
+        SERIALUI_TRACE_CALL("setPriority");
+        UI_Priority prev = prio;
+#ifdef SERIALUI_PRIORITY_LANES
+        if (p != prio) laneCommit(lanes[(uint8_t)prio], 0);
+#endif
+        prio = p;
+        return prev;
     }
 
+    typedef void (*RedrawFn)(SerialUI& ui);
+
+#ifdef SERIALUI_SERVICE
+    // Marks a layout element, canvas or render callback (e.g. one that prints a
+    // value) for the next service(). Marking one that is already pending costs
+    // nothing, so the app may invalidate as often as it produces data. With the
+    // table full the item is drawn at once and false is returned.
+    bool invalidate(const UI_Box& e) { return pend(item(&e, PEND_BOX, e.x, e.y)); }
+    bool invalidate(const UI_Line& e) { return pend(item(&e, PEND_LINE, e.x1 < e.x2 ? e.x1 : e.x2, e.y1 < e.y2 ? e.y1 : e.y2)); }
+    bool invalidate(const UI_Freehand& e) { return pend(item(&e, PEND_FREEHAND, e.x, e.y)); }
+    bool invalidate(const UI_Text& e) { return pend(item(&e, PEND_TEXT, e.x, e.y)); }
+    bool invalidate(const UI_LText& e) { return pend(item(&e, PEND_LTEXT, e.x, e.y)); }
+    // A big number is drawn from the value it was last invalidated with.
+    bool invalidate(const UI_BigNum& e, long value, uint8_t decimals = 0) {
+        Pending p = item(&e, PEND_BIGNUM, e.x, e.y); p.value = value; p.decimals = decimals;
+        return pend(p);
+    }
+    bool invalidate(UI_CanvasBase& e) { return pend(item(&e, PEND_CANVAS, e.box.x, e.box.y)); }
+    bool invalidate(RedrawFn fn) { Pending p = item(nullptr, PEND_FN, 0x7FFF, 0x7FFF); p.fn = fn; return pend(p); }
+    uint8_t pendingCount() const { return nPending; }
+
+    // Draws what is pending: frames first, then lines and art, then text, canvases
+    // and callbacks, each group top to bottom and left to right so cursor moves stay
+    // short. No new item is started once budgetUs microseconds have passed (0: no
+    // limit); the rest waits for the next call. Returns the number drawn.
+    uint8_t service(uint32_t budgetUs = 0) {
+        SERIALUI_TRACE_CALL("service");
+        uint32_t t0 = micros();
+        uint8_t done = 0;
+        while (nPending) {
+            uint8_t best = 0;
+            for (uint8_t i = 1; i < nPending; i++)
+                if (pendBefore(pendq[i], pendq[best])) best = i;
+            Pending p = pendq[best];
+            pendq[best] = pendq[--nPending];
+            pendDraw(p);
+            done++;
+            if (budgetUs && micros() - t0 >= budgetUs) break;
+        }
+        poll();
+        return done;
+    }
+#endif
+
+#ifdef SERIALUI_VIEWPORT
+    // Drawing uses canvas coordinates; the terminal shows a w x h window of it in
+    // its top h rows. Rows below the window (a status line) are left alone, but w
+    // must be the terminal's full width: DCH/ICH shift whole terminal rows.
+    void setViewport(int16_t w, int16_t h) { vpW = w; vpH = h; clipAll(); }
+    int16_t viewX() const { return vpX; }
+    int16_t viewY() const { return vpY; }
+
+    // Moves the window to canvas (x, y). What stays in view is shifted on the
+    // terminal (SU/SD within a DECSTBM region for rows, DCH/ICH for columns) and
+    // redraw runs with output clipped to the rows, then the columns, that came
+    // into view. A jump of a whole window or more clears and redraws the window.
+    void scrollTo(int16_t x, int16_t y, RedrawFn redraw) {
+        SERIALUI_TRACE_CALL("scrollTo");
+        int16_t dx = x - vpX, dy = y - vpY;
+        if (!dx && !dy) return;
+        resetAttr();
+        vpX = x; vpY = y; curValid = false;
+        if (abs(dx) >= vpW || abs(dy) >= vpH) {
+            if (vpH > 1) scrollRows(vpH);
+            else put("\x1b[H\x1b[2K"); // a one-row region is invalid
+            clipAll();
+            if (redraw) redraw(*this);
+        } else {
+            if (dy) scrollRows(dy);
+            // rows outside the vertical band: shifted sideways, then their new columns drawn
+            int16_t keep0 = dy > 0 ? 0 : -dy, keep1 = dy > 0 ? vpH - dy : vpH;
+            if (dx) {
+                for (int16_t r = keep0; r < keep1; r++) {
+                    put("\x1b["); putNum(r + 1); put(";1H\x1b["); putNum(abs(dx)); put(dx > 0 ? "P" : "@");
+                }
+            }
+            if (dy && redraw) { clipX0 = 0; clipX1 = vpW; clipY0 = dy > 0 ? keep1 : 0; clipY1 = dy > 0 ? vpH : keep0; redraw(*this); }
+            if (dx && redraw) { clipX0 = dx > 0 ? vpW - dx : 0; clipX1 = dx > 0 ? vpW : -dx; clipY0 = keep0; clipY1 = keep1; redraw(*this); }
+            clipAll();
+        }
+        curValid = false;
+#ifdef SERIALUI_PRIORITY_LANES
+        // output composed after this point is already translated; keep CRITICAL from overtaking the shift
+        flush();
+#endif
+    }
+#endif
+
     // --- DRAWING METHODS ---
     void draw(const UI_Text& t) {
-        setColor(t.color); moveCursor(t.x, t.y); Serial.print(t.content); resetAttr();
+        SERIALUI_TRACE_CALL("draw(UI_Text)");
+        SERIALUI_RECORD();
+        SERIALUI_BLIT(&t);
+        setColor(t.color); moveCursor(t.x, t.y); putText(t.content); resetAttr();
     }
 
     void draw(const UI_Box& b) {
+        SERIALUI_TRACE_CALL("draw(UI_Box)");
+        SERIALUI_RECORD();
+        SERIALUI_BLIT(&b);
         setColor(b.color);
-        for (int i = 0; i < b.w; i++) { moveCursor(b.x + i, b.y); Serial.print("-"); moveCursor(b.x + i, b.y + b.h - 1); Serial.print("-"); }
-        for (int i = 0; i < b.h; i++) { moveCursor(b.x, b.y + i); Serial.print("|"); moveCursor(b.x + b.w - 1, b.y + i); Serial.print("|"); }
-        moveCursor(b.x, b.y); Serial.print("+"); moveCursor(b.x + b.w - 1, b.y); Serial.print("+");
-        moveCursor(b.x, b.y + b.h - 1); Serial.print("+"); moveCursor(b.x + b.w - 1, b.y + b.h - 1); Serial.print("+");
+        for (int i = 0; i < b.w; i++) { moveCursor(b.x + i, b.y); putGlyph('-'); moveCursor(b.x + i, b.y + b.h - 1); putGlyph('-'); }
+        for (int i = 0; i < b.h; i++) { moveCursor(b.x, b.y + i); putGlyph('|'); moveCursor(b.x + b.w - 1, b.y + i); putGlyph('|'); }
+        moveCursor(b.x, b.y); putGlyph('+'); moveCursor(b.x + b.w - 1, b.y); putGlyph('+');
+        moveCursor(b.x, b.y + b.h - 1); putGlyph('+'); moveCursor(b.x + b.w - 1, b.y + b.h - 1); putGlyph('+');
         resetAttr();
     }
 
     void draw(const UI_Line& l) {
+        SERIALUI_TRACE_CALL("draw(UI_Line)");
+        SERIALUI_RECORD();
+        SERIALUI_BLIT(&l);
         setColor(l.color);
         int dx = abs(l.x2 - l.x1), sx = l.x1 < l.x2 ? 1 : -1;
         int dy = -abs(l.y2 - l.y1), sy = l.y1 < l.y2 ? 1 : -1;
         int err = dx + dy, e2;
         int x = l.x1, y = l.y1;
         while (true) {
-            moveCursor(x, y); Serial.print("#");
+            moveCursor(x, y); putGlyph('#');
             if (x == l.x2 && y == l.y2) break;
             e2 = 2 * err;
             if (e2 >= dy) { err += dy; x += sx; }
@@ -109,24 +1072,216 @@ public:
     }
 
     void draw(const UI_Freehand& f) {
+        SERIALUI_TRACE_CALL("draw(UI_Freehand)");
+        SERIALUI_RECORD();
+        SERIALUI_BLIT(&f);
         setColor(f.color);
         for(int i=0; i<f.count; i++) {
             moveCursor(f.x, f.y + i);
             const char* strPtr = (const char*)pgm_read_ptr(&(f.lines[i]));
-            while(uint8_t c = pgm_read_byte(strPtr++)) { Serial.write(c); }
+            while(uint8_t c = pgm_read_byte(strPtr++)) { putGlyph(c); }
         }
         resetAttr();
     }
 
+    void draw(const UI_LText& t) {
+        SERIALUI_TRACE_CALL("draw(UI_LText)");
+        SERIALUI_RECORD();
+        setColor(t.color); moveCursor(t.x, t.y);
+        UI_StrReader r(table(lang), t.id);
+        for (int c; (c = r.next()) >= 0; ) putGlyph((uint8_t)c);
+        resetAttr();
+    }
+
+    // Clears the digit area; the next drawBigNumber() then draws every lit segment.
+    void draw(const UI_BigNum& b) {
+        SERIALUI_TRACE_CALL("draw(UI_BigNum)");
+        fillRect(b.x, b.y, b.digits * 4, 3, ' ', b.color);
+        memset(b.shown, 0, b.digits);
+    }
+
+    // Shows text right-aligned (digits, '-', ' ', '.', and A b C d E F H L n o P r U _).
+    // Only segments that differ from what is shown are sent; a '.' lights the decimal
+    // point of the glyph before it. Text that does not fit shows all dashes.
+    void drawBigNumber(const UI_BigNum& b, const char* text) {
+        SERIALUI_TRACE_CALL("drawBigNumber");
+        uint8_t m[16], n = 0, t[16];
+        for (const char* p = text; *p; p++) {
+            if (*p == '.' || *p == ',') { if (!n) m[n++] = 0; m[n - 1] |= 0x80; continue; }
+            if (n == sizeof(m)) { n = 0xFF; break; }
+            m[n++] = segMask(*p);
+        }
+        uint8_t digits = b.digits < sizeof(t) ? b.digits : sizeof(t);
+        for (uint8_t d = 0; d < digits; d++) t[d] = n > digits ? 0x40 : (d + n >= digits ? m[d + n - digits] : 0);
+        if (!memcmp(t, b.shown, digits)) return;
+        SERIALUI_RECORD();
+        setColor(b.color);
+        // row-major walk over changed cells; gaps of a few cells are bridged by
+        // resending what they show, which is cheaper than a cursor move
+        for (uint8_t row = 0; row < 3; row++) {
+            int16_t at = -1;
+            for (int16_t cx = 0; cx < digits * 4; cx++) {
+                uint8_t d = cx >> 2, bit = segBit(row, cx & 3);
+                if (!bit || !((t[d] ^ b.shown[d]) & bit)) continue;
+                if (at < 0 || cx - at > 4) moveCursor(b.x + cx, b.y + row);
+                else for (int16_t g = at; g < cx; g++) putGlyph((t[g >> 2] & segBit(row, g & 3)) ? segGlyph(g & 3) : ' ');
+                putGlyph((t[d] & bit) ? segGlyph(cx & 3) : ' ');
+                at = cx + 1;
+            }
+        }
+        memcpy(b.shown, t, digits);
+        resetAttr();
+    }
+
+    // Terminal capability flags (UI_CAP_*), SERIALUI_CAPS by default.
+    void setCaps(uint8_t c) { capFlags = c; }
+    uint8_t caps() const { return capFlags; }
+
+    // Horizontal bar in the box interior, value out of full. With UI_CAP_UTF8 it
+    // moves in 1/8-cell steps using the left block elements, otherwise in whole
+    // cells of '#'. Only the cells between the old and new end of the fill are
+    // sent: a change within one cell rewrites one cell per row.
+    void drawBar(const UI_Box& b, uint16_t value, uint16_t full, UI_Color color, UI_BarState& st) {
+        SERIALUI_TRACE_CALL("drawBar");
+        fillBar(b, value, full, color, st, false, capFlags & UI_CAP_UTF8);
+    }
+
+    // Vertical gauge filling the box interior from the bottom, with the lower
+    // block elements for 1/8-cell steps; otherwise as drawBar().
+    void drawGauge(const UI_Box& b, uint16_t value, uint16_t full, UI_Color color, UI_BarState& st) {
+        SERIALUI_TRACE_CALL("drawGauge");
+        fillBar(b, value, full, color, st, true, capFlags & UI_CAP_UTF8);
+    }
+
+    // Integer drawProgressBar: whole cells of '#' on any terminal, no float math,
+    // and no output unless the number of filled cells or the colour changes.
+    // With UI_BarState(band) the value must move `band` past a cell boundary.
+    void drawProgress(const UI_Box& b, uint16_t value, uint16_t full, UI_Color color, UI_BarState& st) {
+        SERIALUI_TRACE_CALL("drawProgress");
+        fillBar(b, value, full, color, st, false, false);
+    }
+
+    // Sends the canvas cells whose dot pattern changed since the last call (every
+    // cell after invalidate()); nothing at all if none did. Without UI_CAP_UTF8 a
+    // cell shows ' . \' :' depending on which half has dots.
+    void drawCanvas(UI_CanvasBase& c) {
+        SERIALUI_TRACE_CALL("drawCanvas");
+        size_t n = (size_t)c.cols * c.rows;
+        if (!c.stale && !memcmp(c.dots, c.shown, n)) return;
+        SERIALUI_RECORD();
+        setColor(c.color);
+        for (int16_t r = 0; r < c.rows; r++) {
+            const uint8_t* d = c.dots + r * c.cols;
+            uint8_t* s = c.shown + r * c.cols;
+            int16_t at = -1;
+            for (int16_t x = 0; x < c.cols; x++) {
+                if (!c.stale && d[x] == s[x]) continue;
+                if (at < 0 || x - at > 2) moveCursor(c.box.x + 1 + x, c.box.y + 1 + r);
+                else for (int16_t g = at; g < x; g++) putDots(d[g]);
+                putDots(d[x]);
+                s[x] = d[x];
+                at = x + 1;
+            }
+        }
+        c.stale = false;
+        resetAttr();
+    }
+
+    // Integer or fixed-point value: drawBigNumber(b, 2315, 2) shows 23.15.
+    void drawBigNumber(const UI_BigNum& b, long value, uint8_t decimals = 0) {
+        SERIALUI_TRACE_CALL("drawBigNumber(value)");
+        char buf[24]; uint8_t i = sizeof(buf) - 1; // every digit of a 64-bit long, '.' and '-'
+        bool neg = value < 0;
+        unsigned long v = neg ? 0ul - (unsigned long)value : (unsigned long)value;
+        buf[i] = 0;
+        do {
+            buf[--i] = (char)('0' + v % 10); v /= 10;
+            if (decimals && !--decimals) buf[--i] = '.';
+        } while ((v || decimals || buf[i] == '.') && i > 2);
+        if (neg) buf[--i] = '-';
+        drawBigNumber(b, buf + i);
+    }
+
+    // --- LOCALIZED STRINGS ---
+    // Tables are emitted by the generator as UI_STRINGS[UI_Lang::COUNT]; drawScreen_*
+    // and relabelScreen_* install them, so sketches normally only pick a language.
+    void setStrings(const UI_StringTable* tables) { strTables = tables; }
+    void setLanguage(uint8_t l) { lang = l; }
+    uint8_t language() const { return lang; }
+
+    // Copies string `id` of the current language into buf (always terminated).
+    size_t getString(uint16_t id, char* buf, size_t n) {
+        UI_StrReader r(table(lang), id);
+        size_t i = 0;
+        for (int c; i + 1 < n && (c = r.next()) >= 0; ) buf[i++] = (char)c;
+        if (n) buf[i] = 0;
+        return i;
+    }
+
+    // Repaints t after a language change, sending only the cells whose glyph
+    // differs from what language `prev` showed there. Strings with escape
+    // sequences or line breaks are blanked and redrawn whole.
+    void relabel(const UI_LText& t, uint8_t prev) {
+        SERIALUI_TRACE_CALL("relabel");
+        if (prev == lang) return;
+        SERIALUI_RECORD();
+        if (!plainString(prev, t.id) || !plainString(lang, t.id)) {
+            UI_StrReader o(table(prev), t.id);
+            moveCursor(t.x, t.y);
+            for (int c, esc = 0; (c = o.next()) >= 0; ) {
+                if (esc) { if (esc == 1) esc = c == '[' ? 2 : 0; else if (c >= 0x40 && c <= 0x7E) esc = 0; continue; }
+                if (c == 0x1b) esc = 1;
+                else if (c == '\n') putGlyph('\n');
+                else if ((c & 0xC0) != 0x80) putGlyph(' ');
+            }
+            draw(t);
+            return;
+        }
+        setColor(t.color);
+        UI_StrReader a(table(prev), t.id), b(table(lang), t.id);
+        uint8_t ga[4], gb[4], gap[4], gapLen = 0;
+        bool placed = false; // terminal cursor sits at cell x
+        for (int16_t x = t.x; ; x++) {
+            uint8_t na = a.glyph(ga), nb = b.glyph(gb);
+            if (!na && !nb) break;
+            if (na == nb && !memcmp(ga, gb, na)) {
+                // short unchanged runs are resent instead of paying for a cursor move
+                if (placed && na == 1 && gapLen < sizeof(gap)) gap[gapLen++] = ga[0];
+                else { placed = false; gapLen = 0; }
+                continue;
+            }
+            if (!placed) moveCursor(x, t.y);
+            for (uint8_t i = 0; i < gapLen; i++) putGlyph(gap[i]);
+            gapLen = 0; placed = true;
+            if (nb) for (uint8_t i = 0; i < nb; i++) putGlyph(gb[i]);
+            else putGlyph(' ');
+        }
+        resetAttr();
+    }
+
+    void printfText(const UI_LText& text, ...) {
+        SERIALUI_TRACE_CALL("printfText(UI_LText)");
+        char fmt[64], buffer[128];
+        getString(text.id, fmt, sizeof(fmt));
+        va_list args;
+        va_start(args, text);
+        vsnprintf(buffer, sizeof(buffer), fmt, args);
+        va_end(args);
+        drawText(text.x, text.y, buffer, text.color);
+    }
+
     // --- DEVELOPER HELPER METHODS ---
     void drawText(int16_t x, int16_t y, const char* text, UI_Color color) {
+        SERIALUI_TRACE_CALL("drawText");
+        SERIALUI_RECORD_KEYED(KEY_TEXT, x, y, strlen(text));
         setColor(color);
         moveCursor(x, y);
-        Serial.print(text);
+        putText(text);
         resetAttr();
     }
 
     void printfText(const UI_Text& text, ...) {
+        SERIALUI_TRACE_CALL("printfText");
         char buffer[128]; // Be mindful of stack size
         va_list args;
         va_start(args, text);
@@ -136,15 +1291,28 @@ public:
     }
 
     void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, char c, UI_Color color) {
+        SERIALUI_TRACE_CALL("fillRect");
+        SERIALUI_RECORD();
         setColor(color);
+#if defined(SERIALUI_BINARY) && !defined(SERIALUI_VIEWPORT)
+        if (bin && x >= 0 && y >= 0 && x < 256 && y < 256 && w > 0 && h > 0 && w < 256 && h < 256 && (uint8_t)c >= 0x20) {
+            uint8_t op[6] = { UI_OP_FILL, (uint8_t)x, (uint8_t)y, (uint8_t)w, (uint8_t)h, (uint8_t)c };
+            for (uint8_t i = 0; i < 6; i++) putByte(op[i]);
+            resetAttr();
+            return;
+        }
+#endif
         for (int i = 0; i < h; i++) {
             moveCursor(x, y + i);
-            for (int j = 0; j < w; j++) Serial.write(c);
+            for (int j = 0; j < w; j++) putGlyph(c);
         }
         resetAttr();
     }
 
+    // Repaints the whole interior on every call; see drawProgress() for updates.
     void drawProgressBar(const UI_Box& b, float percent, UI_Color color) {
+        SERIALUI_TRACE_CALL("drawProgressBar");
+        SERIALUI_RECORD_KEYED(KEY_BAR, b.x + 1, b.y + 1, b.w > 2 ? b.w - 2 : 0); // the interior it repaints
         if (percent < 0) percent = 0;
         if (percent > 100) percent = 100;
         int innerWidth = b.w - 2;
@@ -152,5 +1320,877 @@ public:
         fillRect(b.x + 1, b.y + 1, fillWidth, b.h - 2, '#', color);
         fillRect(b.x + 1 + fillWidth, b.y + 1, innerWidth - fillWidth, b.h - 2, ' ', color);
     }
+
+    // --- OUTPUT ---
+    // Every byte the library produces passes through here.
+    void putByte(uint8_t c) {
+#ifdef SERIALUI_TRACE
+        UI_Trace::get().bytes++;
+#endif
+#if defined(SERIALUI_FRAME_SINK) && defined(SERIALUI_BINARY)
+        if (frameSink && !bin) frameSink->put(c);
+#elif defined(SERIALUI_FRAME_SINK)
+        if (frameSink) frameSink->put(c);
+#endif
+#ifdef SERIALUI_COMPRESS
+        lzRaw++;
+        if (lzOn) { lzPut(c); return; }
+#endif
+        wireByte(c);
+    }
+
+    // Bytes as they go on the wire.
+    void wireByte(uint8_t c) {
+#ifdef SERIALUI_COMPRESS
+        lzWire++;
+#endif
+#ifdef SERIALUI_ASYNC_TX
+        if (tx) {
+#ifdef SERIALUI_PRIORITY_LANES
+            lanePut(c);
+#else
+            txBuf[txFill][txLen++] = c;
+            if (txLen == SERIALUI_TX_CHUNK) sendChunk();
+#endif
+            return;
+        }
+#endif
+        Serial.write(c);
+    }
+
+    void put(const char* s) {
+#ifdef SERIALUI_VIEWPORT
+        if (pendFg || pendBg) flushAttr(); // raw output may depend on the colour set before it
+#endif
+#ifdef SERIALUI_BINARY
+        if (bin) { while (*s) putLit((uint8_t)*s++); return; }
+#endif
+#if defined(SERIALUI_COMPRESS) || defined(SERIALUI_FRAME_SINK) || defined(SERIALUI_TRACE)
+        while (*s) putByte((uint8_t)*s++); // every byte must reach the coder, the capture and the count
+        return;
+#endif
+#ifdef SERIALUI_ASYNC_TX
+        if (tx) { while (*s) putByte((uint8_t)*s++); return; }
+#endif
+        Serial.print(s);
+    }
+
+    // Visible content from the drawing methods. With SERIALUI_VIEWPORT glyphs are
+    // clipped to the window, escape sequences embedded in content pass through,
+    // and the cursor is re-placed only when output re-enters the window.
+    void putGlyph(uint8_t c) {
+#ifdef SERIALUI_VIEWPORT
+        if (gEsc) {
+            putLit(c);
+            if (gEsc == 1) gEsc = c == '[' ? 2 : 0;
+            else if (c >= 0x40 && c <= 0x7E) gEsc = 0;
+            return;
+        }
+        if (c == 0x1b) { if (pendFg || pendBg) flushAttr(); gEsc = 1; putLit(c); return; } // keep SGR order
+        if ((c & 0xC0) == 0x80) { if (curValid) putByte(c); return; } // UTF-8 tail of the previous glyph
+        if (!visible(vcx, vcy)) { curValid = false; vcx++; return; }
+        if (pendFg || pendBg) flushAttr();
+        if (!curValid) { cursorTo(vcx - vpX, vcy - vpY); curValid = true; }
+        vcx++;
+#endif
+        putLit(c);
+    }
+
+    // A content byte; in binary mode control bytes are escaped so they cannot read as opcodes.
+    void putLit(uint8_t c) {
+#ifdef SERIALUI_BINARY
+        if (bin && c < 0x20) putByte(UI_OP_LIT);
+#endif
+        putByte(c);
+    }
+
+    void putText(const char* s) {
+#ifdef SERIALUI_VIEWPORT
+        while (*s) putGlyph((uint8_t)*s++);
+#else
+        put(s);
+#endif
+    }
+
+    void putNum(int n) {
+        char buf[8]; int i = sizeof(buf) - 1;
+        bool neg = n < 0;
+        unsigned int v = neg ? 0u - (unsigned int)n : (unsigned int)n;
+        buf[i] = 0;
+        do { buf[--i] = (char)('0' + v % 10); v /= 10; } while (v && i > 1);
+        if (neg) buf[--i] = '-';
+        put(buf + i);
+    }
+
+private:
+    // Terminal-position cursor move and SGR attribute, in the current protocol.
+    void cursorTo(int x, int y) {
+#ifdef SERIALUI_BINARY
+        if (bin) {
+            if (x >= 0 && y >= 0 && x < 256 && y < 256) { putByte(UI_OP_MOVE); putByte(x); putByte(y); }
+            else { putByte(UI_OP_MOVE16); putByte(x & 0xFF); putByte((x >> 8) & 0xFF); putByte(y & 0xFF); putByte((y >> 8) & 0xFF); }
+            return;
+        }
+#endif
+        put("\x1b["); putNum(y + 1); put(";"); putNum(x + 1); put("H");
+    }
+    void sgr(uint8_t code) {
+#ifdef SERIALUI_BINARY
+        if (bin) { putByte(UI_OP_STYLE); putByte(code); return; }
+#endif
+        if (!code) { put("\x1b[0m"); return; }
+        put("\x1b["); putNum(code); put("m");
+    }
+    // Where a drawing call ends: nothing stays in the compressor and capture
+    // readers get a whole frame.
+    void settle() {
+        lzFlush();
+#ifdef SERIALUI_FRAME_SINK
+        if (frameSink) frameSink->publish();
+#endif
+    }
+#ifdef SERIALUI_FRAME_SINK
+    UI_FrameSink* frameSink = nullptr;
+#endif
+
+#ifdef SERIALUI_COMPRESS
+    // Greedy streaming match: up to three bytes wait for a match to start, and a
+    // match grows while the input keeps following its source. A window match may
+    // overlap its own output (period lzD), which turns runs into one token.
+    // Nothing is held across settle().
+    void lzPut(uint8_t c) {
+        if (lzLen) {
+            if (lzLen < (lzDict ? 130 : 128) && lzNext() == c) {
+                lzLen++;
+                if (!lzDict && ++lzK == lzD) lzK = 0;
+                return;
+            }
+            lzEmitMatch();
+        }
+        lzHold[lzHeld++] = c;
+        if (lzHeld < 3) return;
+        if (lzFind()) { lzLen = 3; lzHeld = 0; lzK = lzD == 3 ? 0 : 3; return; }
+        lzLiteral(lzHold[0]);
+        lzHold[0] = lzHold[1]; lzHold[1] = lzHold[2]; lzHeld = 2;
+    }
+    void lzFlush() {
+        if (!lzOn) return;
+        if (lzLen) lzEmitMatch();
+        for (uint8_t i = 0; i < lzHeld; i++) lzLiteral(lzHold[i]);
+        lzHeld = 0;
+    }
+    int16_t lzNext() const {
+        if (!lzDict) return lzWin[(lzSrc + lzK) & (SERIALUI_LZ_WINDOW - 1)];
+        const UI_LzDict* d = UI_LzDict::active();
+        return lzSrc + lzLen < d->size ? pgm_read_byte(d->data + lzSrc + lzLen) : -1;
+    }
+    bool lzFind() {
+        uint8_t h = uiLzHash(lzHold[0], lzHold[1], lzHold[2]);
+        uint8_t p = lzHead[h & (SERIALUI_LZ_HASH - 1)];
+        uint16_t d = (lzPos - p) & (SERIALUI_LZ_WINDOW - 1);
+        if (!d) d = SERIALUI_LZ_WINDOW;
+        // heads point at complete trigrams, so d >= 3 and the candidate lies in the past
+        if (d >= 3 && d <= lzFill && lzWin[p] == lzHold[0] && lzWin[(p + 1) & (SERIALUI_LZ_WINDOW - 1)] == lzHold[1]
+            && lzWin[(p + 2) & (SERIALUI_LZ_WINDOW - 1)] == lzHold[2]) {
+            lzDict = false; lzSrc = p; lzD = d;
+            return true;
+        }
+        const UI_LzDict* t = UI_LzDict::active();
+        if (!t) return false;
+        uint16_t off = pgm_read_word(t->heads + h);
+        if (off == 0xFFFF || off + 3 > t->size) return false;
+        for (uint8_t i = 0; i < 3; i++)
+            if (pgm_read_byte(t->data + off + i) != lzHold[i]) return false;
+        lzDict = true; lzSrc = off; lzD = 0;
+        return true;
+    }
+    void lzEmitMatch() {
+        uint8_t n = lzLen;
+        lzLen = 0;
+        if (n >= (lzDict ? 5 : 4)) { // shorter ones cost no less than their literals
+            if (lzDict) { wireByte(0xFF); wireByte(n + 125); wireByte(lzSrc & 0xFF); wireByte(lzSrc >> 8); }
+            else { wireByte(0xFF); wireByte(n - 1); wireByte(lzD - 1); }
+            for (uint8_t i = 0; i < n; i++) lzAppend(lzCopy(i));
+        } else {
+            for (uint8_t i = 0; i < n; i++) lzLiteral(lzCopy(i));
+        }
+    }
+    // Byte i of the match, read as the decoder does: appending one byte ahead
+    // of the source lets an overlapping copy see its own output.
+    uint8_t lzCopy(uint8_t i) const {
+        if (lzDict) return pgm_read_byte(UI_LzDict::active()->data + lzSrc + i);
+        return lzWin[(lzSrc + i) & (SERIALUI_LZ_WINDOW - 1)];
+    }
+    void lzLiteral(uint8_t c) {
+        wireByte(c);
+        if (c == 0xFF) wireByte(0x00);
+        lzAppend(c);
+    }
+    void lzAppend(uint8_t c) {
+        lzWin[lzPos] = c;
+        lzPos = (lzPos + 1) & (SERIALUI_LZ_WINDOW - 1);
+        if (lzFill < SERIALUI_LZ_WINDOW) lzFill++;
+        if (lzFill >= 3) {
+            uint8_t p = (lzPos - 3) & (SERIALUI_LZ_WINDOW - 1);
+            lzHead[uiLzHash(lzWin[p], lzWin[(p + 1) & (SERIALUI_LZ_WINDOW - 1)], c) & (SERIALUI_LZ_HASH - 1)] = p;
+        }
+    }
+
+    uint8_t lzWin[SERIALUI_LZ_WINDOW];
+    uint8_t lzHead[SERIALUI_LZ_HASH];
+    uint8_t lzHold[3];
+    uint8_t lzHeld = 0, lzLen = 0;
+    uint16_t lzPos = 0, lzFill = 0, lzSrc = 0, lzD = 0, lzK = 0;
+    bool lzDict = false, lzOn = false;
+    uint32_t lzRaw = 0, lzWire = 0;
+#else
+    void lzFlush() {}
+#endif
+
+#ifdef SERIALUI_BINARY
+    bool blit(const void* e) {
+        const UI_ElementTable* t = UI_ElementTable::active();
+        int16_t id = bin && t ? t->find(e) : -1;
+        if (id < 0) return false;
+        putByte(UI_OP_BLIT); putByte(id & 0xFF); putByte(id >> 8);
+        return true;
+    }
+    bool bin = false;
+#endif
+
+    // Segment bits: a b c d e f g dp = 0..7. Each lights one cell of the 4x3 digit.
+    static uint8_t segMask(char c) {
+        static const char chars[] PROGMEM = "0123456789-_ AbCdEFHLnoPrU";
+        static const uint8_t masks[] PROGMEM = {
+            0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F, 0x40, 0x08, 0x00,
+            0x77, 0x7C, 0x39, 0x5E, 0x79, 0x71, 0x76, 0x38, 0x54, 0x5C, 0x73, 0x50, 0x3E };
+        if (c >= 'a' && c <= 'z' && c != 'b' && c != 'd' && c != 'n' && c != 'o' && c != 'r') c -= 32;
+        for (uint8_t i = 0; i < sizeof(masks); i++) if ((char)pgm_read_byte(chars + i) == c) return pgm_read_byte(masks + i);
+        return 0x40;
+    }
+#ifdef SERIALUI_SERVICE
+    enum : uint8_t { PEND_BOX, PEND_LINE, PEND_FREEHAND, PEND_TEXT, PEND_LTEXT, PEND_BIGNUM, PEND_CANVAS, PEND_FN };
+    struct Pending {
+        union { const void* e; RedrawFn fn; };
+        int16_t x, y;
+        uint8_t kind;
+        uint8_t decimals; long value; // PEND_BIGNUM
+    };
+
+    static Pending item(const void* e, uint8_t kind, int16_t x, int16_t y) {
+        Pending p; p.e = e; p.kind = kind; p.x = x; p.y = y; p.decimals = 0; p.value = 0;
+        return p;
+    }
+    bool pend(const Pending& p) {
+        for (uint8_t i = 0; i < nPending; i++) {
+            Pending& q = pendq[i];
+            if (q.kind == p.kind && (p.kind == PEND_FN ? q.fn == p.fn : q.e == p.e)) {
+                q.value = p.value; q.decimals = p.decimals; // latest value wins
+                return true;
+            }
+        }
+        if (nPending == SERIALUI_PENDING) { pendDraw(p); return false; }
+        pendq[nPending++] = p;
+        return true;
+    }
+    // Paint order: frames under lines/art under text and values, then row-major.
+    static uint8_t pendLayer(uint8_t kind) { return kind == PEND_BOX ? 0 : kind <= PEND_FREEHAND ? 1 : 2; }
+    static bool pendBefore(const Pending& a, const Pending& b) {
+        uint8_t la = pendLayer(a.kind), lb = pendLayer(b.kind);
+        if (la != lb) return la < lb;
+        return a.y != b.y ? a.y < b.y : a.x < b.x;
+    }
+    void pendDraw(const Pending& p) {
+        switch (p.kind) {
+            case PEND_BOX: draw(*(const UI_Box*)p.e); break;
+            case PEND_LINE: draw(*(const UI_Line*)p.e); break;
+            case PEND_FREEHAND: draw(*(const UI_Freehand*)p.e); break;
+            case PEND_TEXT: draw(*(const UI_Text*)p.e); break;
+            case PEND_LTEXT: draw(*(const UI_LText*)p.e); break;
+            case PEND_BIGNUM: drawBigNumber(*(const UI_BigNum*)p.e, p.value, p.decimals); break;
+            case PEND_CANVAS: drawCanvas(*(UI_CanvasBase*)const_cast<void*>(p.e)); break;
+            case PEND_FN: p.fn(*this); break;
+        }
+    }
+#endif
+
+    void fillBar(const UI_Box& b, uint16_t value, uint16_t full, UI_Color color, UI_BarState& st, bool vertical, bool blocks) {
+        int16_t w = b.w - 2, h = b.h - 2, c0, c1;
+        if (w <= 0 || h <= 0 || !full) return;
+        int16_t cells = vertical ? h : w;
+        uint16_t n = barLevel(st, value, full, cells, blocks);
+        if (!barSpan(st, n, color, cells, c0, c1)) return;
+        SERIALUI_RECORD();
+        setColor(color);
+        if (vertical) {
+            for (int16_t c = c0; c <= c1; c++) {
+                moveCursor(b.x + 1, b.y + b.h - 2 - c);
+                for (int16_t i = 0; i < w; i++) putLevel(n, c, true, blocks);
+            }
+        } else {
+            for (int16_t r = 0; r < h; r++) {
+                moveCursor(b.x + 1 + c0, b.y + 1 + r);
+                for (int16_t c = c0; c <= c1; c++) putLevel(n, c, false, blocks);
+            }
+        }
+        resetAttr();
+    }
+    static uint16_t quantize(uint16_t value, uint16_t full, int16_t cells, bool blocks) {
+        uint16_t n = (uint16_t)((uint32_t)value * (uint16_t)cells * 8 / full);
+        return blocks ? n : (uint16_t)(n & ~7u);
+    }
+    // Fill for value, or the shown one while value is within the hysteresis band of it.
+    static uint16_t barLevel(const UI_BarState& st, uint16_t value, uint16_t full, int16_t cells, bool blocks) {
+        if (value > full) value = full;
+        uint16_t n = quantize(value, full, cells, blocks);
+        if (!st.band || st.shown == 0xFFFF || st.shown == n || !value || value == full) return n; // ends are exact
+        uint16_t lo = quantize(value > st.band ? value - st.band : 0, full, cells, blocks);
+        uint16_t hi = quantize(full - value > st.band ? value + st.band : full, full, cells, blocks);
+        return (st.shown >= lo && st.shown <= hi) ? st.shown : n;
+    }
+    // Cells [c0, c1] whose content differs between the shown fill and n; false if none.
+    static bool barSpan(UI_BarState& st, uint16_t n, UI_Color color, int16_t cells, int16_t& c0, int16_t& c1) {
+        uint16_t o = st.shown;
+        bool recolor = st.color != color;
+        if (o == n && !recolor) return false;
+        st.shown = n; st.color = color;
+        if (o == 0xFFFF || recolor) { c0 = 0; c1 = cells - 1; return true; }
+        uint16_t lo = o < n ? o : n, hi = o < n ? n : o;
+        c0 = lo / 8; c1 = (hi - 1) / 8;
+        if (c1 >= cells) c1 = cells - 1;
+        return true;
+    }
+    // Cell `cell` of a fill of n eighths: blank, full, or a partial block.
+    void putLevel(uint16_t n, int16_t cell, bool vertical, bool blocks) {
+        int16_t k = (int16_t)n - cell * 8;
+        if (k <= 0) { putGlyph(' '); return; }
+        if (!blocks) { putGlyph('#'); return; }
+        if (k > 8) k = 8;
+        putGlyph(0xE2); putGlyph(0x96); putGlyph((uint8_t)(vertical ? 0x80 + k : 0x90 - k)); // U+2581.., U+258F..2588
+    }
+
+    void putDots(uint8_t p) {
+        if (capFlags & UI_CAP_UTF8) { putGlyph(0xE2); putGlyph(0xA0 | (p >> 6)); putGlyph(0x80 | (p & 0x3F)); return; } // U+2800 + p
+        bool top = p & 0x1B, bottom = p & 0xE4;
+        putGlyph(top ? (bottom ? ':' : '\'') : (bottom ? '.' : ' '));
+    }
+
+    // Cell (col, row) of a digit: the segment bit it shows (0 = none) and its character.
+    static uint8_t segBit(uint8_t row, uint8_t col) {
+        static const uint8_t bits[12] PROGMEM = { 0, 0x01, 0, 0, 0x20, 0x40, 0x02, 0, 0x10, 0x08, 0x04, 0x80 };
+        return pgm_read_byte(bits + row * 4 + col);
+    }
+    static char segGlyph(uint8_t col) { return col == 1 ? '_' : col == 3 ? '.' : '|'; }
+
+    const UI_StringTable* table(uint8_t l) const { return strTables ? strTables + l : nullptr; }
+    bool plainString(uint8_t l, uint16_t id) const {
+        UI_StrReader r(table(l), id);
+        for (int c; (c = r.next()) >= 0; ) if (c == 0x1b || c == '\n') return false;
+        return true;
+    }
+
+    const UI_StringTable* strTables = nullptr;
+    uint8_t lang = 0;
+    uint8_t capFlags = SERIALUI_CAPS;
+
+#ifdef SERIALUI_VIEWPORT
+    bool visible(int x, int y) const {
+        int sx = x - vpX, sy = y - vpY;
+        return sx >= clipX0 && sx < clipX1 && sy >= clipY0 && sy < clipY1;
+    }
+    void clipAll() { clipX0 = 0; clipY0 = 0; clipX1 = vpW; clipY1 = vpH; }
+    // SU/SD confined to the window's rows; resetting the region homes the cursor.
+    void scrollRows(int16_t n) {
+        put("\x1b[1;"); putNum(vpH); put("r\x1b["); putNum(abs(n)); put(n > 0 ? "S" : "T"); put("\x1b[r");
+    }
+    void flushAttr() {
+        uint8_t fg = pendFg, bg = pendBg;
+        pendFg = pendBg = 0; attrSent = true;
+        if (fg) sgr(fg);
+        if (bg) sgr(bg);
+    }
+
+    int16_t vpX = 0, vpY = 0, vpW = SERIALUI_VIEW_W, vpH = SERIALUI_VIEW_H;
+    int16_t clipX0 = 0, clipY0 = 0, clipX1 = SERIALUI_VIEW_W, clipY1 = SERIALUI_VIEW_H; // window-relative, exclusive
+    int vcx = 0, vcy = 0;   // canvas position of the next glyph
+    bool curValid = false;  // terminal cursor is at (vcx, vcy)
+    uint8_t gEsc = 0;       // inside an escape sequence embedded in content
+    uint8_t pendFg = 0, pendBg = 0; // SGR codes set but not yet sent
+    bool attrSent = false;  // an SGR went out since the last reset
+#endif
+
+#ifdef SERIALUI_ASYNC_TX
+    static void txDone(void* ctx) { ((SerialUI*)ctx)->txInFlight = false; }
+
+    void txWait() {
+#ifdef ARDUINO
+        yield();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    // Waits until the backend has finished the chunk in flight.
+    void txDrain() {
+        if (!txInFlight && !tx->busy()) return;
+#ifdef SERIALUI_TRACE
+        uint32_t at = micros();
+#endif
+        while (txInFlight || tx->busy()) txWait();
+#ifdef SERIALUI_TRACE
+        UI_Trace::get().blocked(at, micros() - at);
+#endif
+    }
+
+    // Waits for the previous chunk, then ships the composed one and flips buffers.
+    void sendChunk() {
+        txDrain();
+        uint8_t* buf = txBuf[txFill];
+        uint16_t len = txLen;
+        txFill ^= 1; txLen = 0;
+        txInFlight = true;
+        if (!tx->startTransfer(buf, len)) {
+            txInFlight = false;
+            Serial.write(buf, len); // backend refused: fall back to blocking output
+        }
+    }
+
+    UI_TxBackend* tx = nullptr;
+    uint8_t txBuf[2][SERIALUI_TX_CHUNK];
+    uint16_t txLen = 0;
+    uint8_t txFill = 0;
+    UI_TxFlag txInFlight{false};
+#endif
+
+#ifdef SERIALUI_PRIORITY_LANES
+    // Lane rings hold records: a 2-byte header (12-bit length, 4 flag bits)
+    // followed by the bytes. Only committed records are visible to fillChunk().
+    enum : uint8_t { REC_CONT = 1, REC_DEAD = 2 };
+
+    struct Lane {
+        uint8_t* data; uint16_t size;
+        uint16_t head, tail, used, ready; // ready = committed bytes at the tail
+        uint16_t hdr, body; bool open;    // record being written
+        void init(uint8_t* mem, uint16_t n) { data = mem; size = n; head = tail = used = ready = hdr = body = 0; open = false; }
+        uint8_t pop() { uint8_t v = data[tail]; tail = (tail + 1) % size; used--; ready--; return v; }
+    };
+
+    struct RecordScope {
+        SerialUI& ui;
+        explicit RecordScope(SerialUI& u) : ui(u) { if (ui.recDepth++ == 0) ui.recKeyed = false; }
+        RecordScope(SerialUI& u, uint8_t kind, int16_t x, int16_t y, size_t w) : ui(u) { if (ui.recDepth++ == 0) ui.recordKey(kind, x, y, w); }
+        ~RecordScope() { if (--ui.recDepth == 0) ui.recordEnd(); }
+    };
+
+    // Latest-value-wins: a committed keyed record marks the previous unsent
+    // record of the same kind and origin dead if it covers at least the same width.
+    enum : uint8_t { KEY_TEXT, KEY_BAR };
+    struct KeySlot { uint16_t key, hdr; uint8_t kind, lane, w; bool used; };
+
+    void recordKey(uint8_t kind, int16_t x, int16_t y, size_t w) {
+        laneCommit(lanes[(uint8_t)prio], 0); // keep earlier loose output out of the keyed record
+        recKeyed = SERIALUI_COALESCE_SLOTS > 0 && x >= 0 && x < 256 && y >= 0 && y < 256;
+        recKey = (uint16_t)((y << 8) | x); recKind = kind;
+        recW = (uint8_t)(w > 255 ? 255 : w);
+    }
+
+    void coalesce(const Lane& L, uint8_t lane) {
+        KeySlot* slot = nullptr;
+        for (uint8_t i = 0; i < SERIALUI_COALESCE_SLOTS; i++) {
+            KeySlot& k = keySlots[i];
+            if (k.used && k.key == recKey && k.kind == recKind) { slot = &k; break; }
+            if (!k.used && !slot) slot = &k;
+        }
+        if (!slot) return; // table full: sent as-is
+        if (slot->used && recW >= slot->w) {
+            Lane& old = lanes[slot->lane];
+            old.data[(slot->hdr + 1) % old.size] |= (uint8_t)(REC_DEAD << 4);
+            coalesced++;
+        }
+        slot->key = recKey; slot->kind = recKind; slot->hdr = L.hdr; slot->lane = lane; slot->w = recW; slot->used = true;
+    }
+
+    // Pops a record header from a lane; its key slot is released once it is on its way.
+    uint16_t popHeader(uint8_t lane) {
+        Lane& L = lanes[lane];
+        for (uint8_t i = 0; i < SERIALUI_COALESCE_SLOTS; i++)
+            if (keySlots[i].used && keySlots[i].lane == lane && keySlots[i].hdr == L.tail) keySlots[i].used = false;
+        uint16_t h = L.pop(); h |= (uint16_t)L.pop() << 8;
+        return h;
+    }
+
+    // Squeezes dead records out of a lane without touching the wire. The record
+    // the transmitter is part-way through stays where it is.
+    bool laneReclaim(uint8_t lane) {
+        Lane& L = lanes[lane];
+        uint16_t skip = 0;
+        if (cur == lane) skip = curRemain;
+        else if (saved && resumeLane == lane) skip = resumeRemain;
+        uint16_t rd = (L.tail + skip) % L.size, wr = rd, left = L.ready - skip, freed = 0;
+        while (left) {
+            uint16_t h = L.data[rd] | ((uint16_t)L.data[(rd + 1) % L.size] << 8);
+            uint16_t n = (h & 0x0FFF) + 2;
+            if ((h >> 12) & REC_DEAD) {
+                freed += n;
+            } else if (freed) {
+                for (uint8_t i = 0; i < SERIALUI_COALESCE_SLOTS; i++)
+                    if (keySlots[i].used && keySlots[i].lane == lane && keySlots[i].hdr == rd) keySlots[i].hdr = wr;
+                for (uint16_t i = 0; i < n; i++) L.data[(wr + i) % L.size] = L.data[(rd + i) % L.size];
+            }
+            if (!((h >> 12) & REC_DEAD)) wr = (wr + n) % L.size;
+            rd = (rd + n) % L.size; left -= n;
+        }
+        if (!freed) return false;
+        if (L.open) { // the record being written moves down too
+            uint16_t n = L.body + 2;
+            for (uint16_t i = 0; i < n; i++) L.data[(wr + i) % L.size] = L.data[(rd + i) % L.size];
+            L.hdr = wr; wr = (wr + n) % L.size;
+        }
+        L.head = wr; L.used -= freed; L.ready -= freed;
+        return true;
+    }
+
+    void recordEnd() {
+        if (!tx) return;
+        laneCommit(lanes[(uint8_t)prio], 0);
+        fillChunk();
+        if (txLen && !txInFlight && !tx->busy()) sendChunk();
+    }
+
+    void laneOpen(Lane& L) {
+        while (L.size - L.used < 3) laneMakeRoom(L); // header plus one byte
+        L.hdr = L.head; L.head = (L.head + 2) % L.size; L.used += 2;
+        L.body = 0; L.open = true;
+    }
+
+    void laneCommit(Lane& L, uint8_t flags) {
+        if (!L.open) return;
+        L.open = false;
+        if (!L.body) { L.head = L.hdr; L.used -= 2; return; }
+        uint16_t h = (uint16_t)(L.body | (flags << 12));
+        L.data[L.hdr] = (uint8_t)h; L.data[(L.hdr + 1) % L.size] = (uint8_t)(h >> 8);
+        L.ready += L.body + 2;
+        if (flags & REC_CONT) recKeyed = false;
+        else if (recKeyed) { coalesce(L, (uint8_t)(&L - lanes)); recKeyed = false; }
+    }
+
+    void lanePut(uint8_t c) {
+        Lane& L = lanes[(uint8_t)prio];
+        if (!L.open) laneOpen(L);
+        if (L.used == L.size && laneReclaim((uint8_t)prio)) {}
+        else if (L.used == L.size || L.body == 0x0FFF) { laneCommit(L, REC_CONT); laneOpen(L); }
+        L.data[L.head] = c; L.head = (L.head + 1) % L.size;
+        L.used++; L.body++;
+    }
+
+    void laneMakeRoom(Lane& L) {
+        if (laneReclaim((uint8_t)(&L - lanes))) return;
+        fillChunk();
+        if (txLen) sendChunk(); else txDrain();
+    }
+
+    void txRaw(uint8_t c) { txBuf[txFill][txLen++] = c; }
+
+    // Tracks whether the byte stream is between escape sequences / UTF-8 characters.
+    void escTrack(uint8_t c) {
+        if (escState == 1) escState = (c == '[') ? 2 : 0;
+        else if (escState == 2) { if (c >= 0x40 && c <= 0x7E) escState = 0; }
+        else if (c == 0x1b) escState = 1;
+        else if (c >= 0xC0) utf8Left = c >= 0xF0 ? 3 : (c >= 0xE0 ? 2 : 1);
+        else if (c >= 0x80) { if (utf8Left) utf8Left--; }
+        else utf8Left = 0;
+    }
+
+    // Moves committed bytes into the compose buffer, highest lane first. Lanes
+    // change at record boundaries; CRITICAL may also cut into a record between
+    // sequences, bracketed by DECSC/DECRC so the interrupted record's cursor
+    // and attributes come back. The critical record starts from reset attributes.
+    void fillChunk() {
+        while (txLen < SERIALUI_TX_CHUNK) {
+            Lane* L = &lanes[cur];
+            bool midRecord = curRemain || curCont;
+            if (midRecord && !saved && cur != 0 && lanes[0].ready && !escState && !utf8Left) {
+                if (SERIALUI_TX_CHUNK - txLen < 6) return;
+                txRaw(0x1b); txRaw('7'); txRaw(0x1b); txRaw('['); txRaw('0'); txRaw('m');
+                saved = true; resumeLane = cur; resumeRemain = curRemain; resumeCont = curCont;
+                cur = 0; curRemain = 0; curCont = false;
+                continue;
+            }
+            if (!curRemain) {
+                uint8_t next;
+                if (curCont) {
+                    if (!L->ready) return; // continuation not committed yet
+                    next = cur;
+                } else if (saved) {
+                    if (!lanes[0].ready) {
+                        if (SERIALUI_TX_CHUNK - txLen < 2) return;
+                        txRaw(0x1b); txRaw('8');
+                        saved = false; cur = resumeLane; curRemain = resumeRemain; curCont = resumeCont;
+                        continue;
+                    }
+                    next = 0;
+                } else {
+                    next = 0;
+                    while (next < 3 && !lanes[next].ready) next++;
+                    if (next == 3) return;
+                }
+                cur = next; L = &lanes[cur];
+                uint16_t h = popHeader(cur);
+                curRemain = h & 0x0FFF; curCont = (h >> 12) & REC_CONT;
+                if ((h >> 12) & REC_DEAD) { while (curRemain) { L->pop(); curRemain--; } }
+                continue;
+            }
+            uint8_t c = L->pop(); curRemain--;
+            txRaw(c); escTrack(c);
+        }
+    }
+
+    uint8_t laneMem[SERIALUI_LANE_CRITICAL + SERIALUI_LANE_NORMAL + SERIALUI_LANE_BACKGROUND];
+    Lane lanes[3];
+    uint8_t recDepth = 0;
+    uint8_t cur = 0, resumeLane = 0;
+    uint16_t curRemain = 0, resumeRemain = 0;
+    bool curCont = false, resumeCont = false, saved = false;
+    uint8_t escState = 0, utf8Left = 0;
+    KeySlot keySlots[SERIALUI_COALESCE_SLOTS > 0 ? SERIALUI_COALESCE_SLOTS : 1] = {};
+    bool recKeyed = false;
+    uint16_t recKey = 0;
+    uint8_t recW = 0, recKind = 0;
+    uint32_t coalesced = 0;
+#endif
+#ifdef SERIALUI_SERVICE
+    Pending pendq[SERIALUI_PENDING];
+    uint8_t nPending = 0;
+#endif
+    UI_Priority prio = UI_Priority::NORMAL;
+};
+
+#if defined(SERIALUI_BINARY) && !defined(ARDUINO)
+// Host side of the binary protocol: replays a device's byte stream on a SerialUI
+// in ANSI mode, which writes standard escape sequences to stdout. BLITs are drawn
+// from this build's UI_ElementTable, so link the same ui_layout.cpp as the device.
+class UI_BinaryDecoder {
+public:
+    explicit UI_BinaryDecoder(SerialUI& out) : ui(out) {}
+    void feed(const uint8_t* buf, size_t n) { while (n--) feed(*buf++); }
+    void feed(uint8_t c) {
+        if (need) {
+            arg[got++] = c;
+            if (got == need) { need = 0; run(); }
+            return;
+        }
+        switch (c) {
+            case UI_OP_MOVE: expect(c, 2); break;
+            case UI_OP_MOVE16: expect(c, 4); break;
+            case UI_OP_STYLE: expect(c, 1); break;
+            case UI_OP_FILL: expect(c, 5); break;
+            case UI_OP_BLIT: expect(c, 2); break;
+            case UI_OP_HELLO: expect(c, 3); break;
+            case UI_OP_LIT: expect(c, 1); break;
+            default: if (c >= 0x20) ui.putByte(c); // unknown control bytes are dropped
+        }
+    }
+    // The last HELLO named another protocol version or element count; BLITs are ignored.
+    bool layoutMismatch() const { return mismatch; }
+
+private:
+    void expect(uint8_t o, uint8_t n) { op = o; need = n; got = 0; }
+    void run() {
+        switch (op) {
+            case UI_OP_MOVE: ui.moveCursor(arg[0], arg[1]); break;
+            case UI_OP_MOVE16: ui.moveCursor((int16_t)(arg[0] | arg[1] << 8), (int16_t)(arg[2] | arg[3] << 8)); break;
+            case UI_OP_STYLE: if (arg[0]) ui.setColor((UI_Color)arg[0]); else ui.resetAttr(); break;
+            case UI_OP_FILL:
+                for (uint8_t r = 0; r < arg[3]; r++) {
+                    ui.moveCursor(arg[0], arg[1] + r);
+                    for (uint8_t i = 0; i < arg[2]; i++) ui.putByte(arg[4]);
+                }
+                break;
+            case UI_OP_BLIT: blit(arg[0] | arg[1] << 8); break;
+            case UI_OP_HELLO: {
+                const UI_ElementTable* t = UI_ElementTable::active();
+                mismatch = arg[0] != UI_PROTOCOL_VERSION || (t ? t->count : 0) != (arg[1] | arg[2] << 8);
+                break;
+            }
+            case UI_OP_LIT: ui.putByte(arg[0]); break;
+        }
+    }
+    void blit(uint16_t id) {
+        const UI_ElementTable* t = UI_ElementTable::active();
+        uint8_t kind = 0;
+        const void* e = t && !mismatch ? t->get(id, kind) : nullptr;
+        if (!e) return;
+        switch (kind) {
+            case UI_ElementTable::BOX: ui.draw(*(const UI_Box*)e); break;
+            case UI_ElementTable::TEXT: ui.draw(*(const UI_Text*)e); break;
+            case UI_ElementTable::LINE: ui.draw(*(const UI_Line*)e); break;
+            case UI_ElementTable::FREEHAND: ui.draw(*(const UI_Freehand*)e); break;
+        }
+    }
+
+    SerialUI& ui;
+    uint8_t op = 0, need = 0, got = 0;
+    uint8_t arg[5];
+    bool mismatch = false;
+};
+#endif
+
+#if defined(SERIALUI_COMPRESS) && !defined(ARDUINO)
+// Host side of stream compression: undoes the coder and hands the original bytes
+// to a sink. Dictionary copies resolve against this build's UI_LzDict, so link
+// the same ui_layout.cpp as the device. Until the first reset token the input
+// passes through unchanged.
+class UI_LzDecoder {
+public:
+    typedef void (*Sink)(uint8_t c, void* ctx);
+    UI_LzDecoder(Sink sink, void* ctx) : sink(sink), ctx(ctx) {}
+    void feed(const uint8_t* buf, size_t n) { while (n--) feed(*buf++); }
+    void feed(uint8_t c) {
+        if (need) {
+            arg[got++] = c;
+            if (got == need) { need = 0; run(); }
+            return;
+        }
+        if (esc) {
+            esc = false;
+            if (c == 0x01) { expect(c, 3); return; }
+            if (!on) { sink(0xFF, ctx); feed(c); return; }
+            if (c == 0x00) emit(0xFF);
+            else expect(c, c < 128 ? 1 : 2);
+            return;
+        }
+        if (c == 0xFF) esc = true;
+        else if (on) emit(c);
+        else sink(c, ctx);
+    }
+    // The last reset named a dictionary of another size; its copies are garbage.
+    bool dictionaryMismatch() const { return mismatch; }
+
+private:
+    void expect(uint8_t t, uint8_t n) { tok = t; need = n; got = 0; }
+    void run() {
+        if (tok == 0x01) {
+            const UI_LzDict* d = UI_LzDict::active();
+            on = arg[0] != 0;
+            mask = (uint8_t)((1u << (arg[0] > 8 ? 8 : arg[0])) - 1);
+            pos = 0;
+            mismatch = on && (d ? d->size : 0) != (arg[1] | arg[2] << 8);
+        } else if (tok < 128) {
+            for (uint8_t i = 0, n = tok + 1; i < n; i++) emit(win[(uint8_t)(pos - arg[0] - 1) & mask]);
+        } else {
+            const UI_LzDict* d = UI_LzDict::active();
+            uint16_t off = arg[0] | arg[1] << 8, n = tok - 125;
+            if (!d || off + n > d->size) { mismatch = true; return; }
+            for (uint16_t i = 0; i < n; i++) emit(pgm_read_byte(d->data + off + i));
+        }
+    }
+    void emit(uint8_t c) { win[pos] = c; pos = (pos + 1) & mask; sink(c, ctx); }
+
+    Sink sink;
+    void* ctx;
+    uint8_t win[256];
+    uint8_t pos = 0, mask = 0xFF, tok = 0, need = 0, got = 0;
+    uint8_t arg[3];
+    bool esc = false, on = false, mismatch = false;
+};
+#endif
+
+#if defined(SERIALUI_TRACE) && !defined(ARDUINO)
+// Writes trace events as Chrome trace-event JSON for chrome://tracing or
+// ui.perfetto.dev. Tracks: traced calls (nested), frames marked with frame(),
+// waits for the TX backend and, with watch(), each buffer's time on the
+// simulated wire. Counters follow the bytes produced and the bytes sent.
+class UI_ChromeTrace : public UI_Trace::Observer {
+public:
+    explicit UI_ChromeTrace(const char* path) : f(fopen(path, "w")) {
+        if (!f) return;
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+        const char* tracks[] = { "calls", "frames", "blocked on TX", "wire" };
+        for (int i = 0; i < 4; i++) event("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", i + 1, tracks[i]);
+        UI_Trace::get().setObserver(this);
+    }
+    ~UI_ChromeTrace() { close(); }
+    UI_ChromeTrace(const UI_ChromeTrace&) = delete;
+    UI_ChromeTrace& operator=(const UI_ChromeTrace&) = delete;
+
+    bool ok() const { return f != nullptr; }
+#ifdef SERIALUI_ASYNC_TX
+    // Adds the backend's wire slots; call close() before the backend goes away.
+    void watch(HostThreadTx& tx) { link = &tx; tx.setWireHook(&UI_ChromeTrace::wire, this); }
+#endif
+    // One frame of the application, e.g. a loop() pass: micros() at its start and its length.
+    void frame(const char* label, uint32_t at, uint32_t us) {
+        char esc[128];
+        size_t k = 0;
+        for (; *label && k < sizeof(esc) - 7; label++) {
+            uint8_t c = (uint8_t)*label;
+            if (c == '"' || c == '\\') { esc[k++] = '\\'; esc[k++] = (char)c; }
+            else if (c < 0x20) k += snprintf(esc + k, 7, "\\u%04x", c);
+            else esc[k++] = (char)c;
+        }
+        esc[k] = 0;
+        label = esc;
+        event("{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":1,\"tid\":2}", label,
+              (unsigned long)at, (unsigned long)us);
+    }
+    // Detaches from the trace (and backend) and completes the JSON file.
+    void close() {
+        UI_Trace::get().setObserver(nullptr);
+#ifdef SERIALUI_ASYNC_TX
+        if (link) link->setWireHook(nullptr, nullptr);
+        link = nullptr;
+#endif
+        std::lock_guard<std::mutex> lk(m);
+        if (f) { fputs("\n]}\n", f); fclose(f); f = nullptr; }
+    }
+
+    void call(const UI_Trace::Event& e) override {
+        event("{\"name\":\"%s\",\"cat\":\"call\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":1,\"tid\":1,\"args\":{\"bytes\":%u}}",
+              e.name, (unsigned long)e.at, (unsigned long)e.us, (unsigned)e.bytes);
+        event("{\"name\":\"bytes produced\",\"ph\":\"C\",\"ts\":%lu,\"pid\":1,\"args\":{\"bytes\":%lu}}",
+              (unsigned long)(e.at + e.us), (unsigned long)UI_Trace::get().bytes);
+    }
+    void blocked(uint32_t at, uint32_t us) override {
+        event("{\"name\":\"blocked on TX\",\"cat\":\"tx\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":1,\"tid\":3}",
+              (unsigned long)at, (unsigned long)us);
+    }
+
+private:
+    static void wire(uint32_t at, uint32_t us, uint16_t n, void* ctx) {
+        UI_ChromeTrace* t = (UI_ChromeTrace*)ctx;
+        t->event("{\"name\":\"wire\",\"cat\":\"tx\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":1,\"tid\":4,\"args\":{\"bytes\":%u}}",
+                 (unsigned long)at, (unsigned long)us, (unsigned)n);
+        t->event("{\"name\":\"bytes sent\",\"ph\":\"C\",\"ts\":%lu,\"pid\":1,\"args\":{\"bytes\":%lu}}",
+                 (unsigned long)(at + us), (unsigned long)(t->sent += n));
+    }
+    // Events come from the drawing thread and the backend's worker.
+    void event(const char* fmt, ...) {
+        std::lock_guard<std::mutex> lk(m);
+        if (!f) return;
+        if (n++) fputs(",\n", f);
+        va_list ap;
+        va_start(ap, fmt);
+        vfprintf(f, fmt, ap);
+        va_end(ap);
+    }
+
+    FILE* f;
+    std::mutex m;
+    unsigned long n = 0, sent = 0;
+#ifdef SERIALUI_ASYNC_TX
+    HostThreadTx* link = nullptr;
+#endif
+};
+#endif
+
+// Routes drawing calls in this scope to a lane, e.g. for an alarm value:
+//   { UI_PriorityScope p(ui, UI_Priority::CRITICAL); ui.printfText(Layout_Main::alarm, v); }
+class UI_PriorityScope {
+public:
+    UI_PriorityScope(SerialUI& ui, UI_Priority p) : ui(ui), prev(ui.setPriority(p)) {}
+    ~UI_PriorityScope() { ui.setPriority(prev); }
+private:
+    SerialUI& ui;
+    UI_Priority prev;
 };
 #endif
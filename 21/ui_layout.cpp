@@ -10,6 +10,7 @@ const UI_Box Layout_Dashboard::status_box = { 40, 2, 30, 5, UI_Color::MAGENTA };
 const UI_Text Layout_Dashboard::status_text = { 42, 4, "SYSTEM: INITIALIZING", UI_Color::WHITE };
 
 void drawScreen_Dashboard(SerialUI& ui) {
+    SERIALUI_TRACE_CALL("drawScreen_Dashboard");
     ui.draw(Layout_Dashboard::bg);
     ui.draw(Layout_Dashboard::temp_gauge);
     ui.draw(Layout_Dashboard::temp_label);
@@ -18,8 +19,29 @@ void drawScreen_Dashboard(SerialUI& ui) {
     ui.draw(Layout_Dashboard::status_text);
 }
 
+#ifdef SERIALUI_BINARY
+// Element ids for the binary protocol: a BLIT names the index in this table.
+static const UI_ElementRef UI_ELEMENTS[] PROGMEM = {
+    { &Layout_Dashboard::bg, UI_ElementTable::BOX },
+    { &Layout_Dashboard::temp_gauge, UI_ElementTable::BOX },
+    { &Layout_Dashboard::temp_label, UI_ElementTable::TEXT },
+    { &Layout_Dashboard::temp_val, UI_ElementTable::TEXT },
+    { &Layout_Dashboard::status_box, UI_ElementTable::BOX },
+    { &Layout_Dashboard::status_text, UI_ElementTable::TEXT },
+};
+static const UI_ElementTable UI_ELEMENT_TABLE(UI_ELEMENTS, 6);
+#endif
+
+#ifdef SERIALUI_COMPRESS
+// Stream compression dictionary: common escape sequences, then the project's strings.
+static const uint8_t LZ_DICT[] PROGMEM = { 27, 91, 48, 109, 27, 91, 27, 91, 63, 50, 53, 108, 27, 91, 50, 74, 27, 91, 72, 27, 91, 51, 51, 109, 27, 91, 27, 91, 51, 52, 109, 27, 91, 27, 91, 51, 53, 109, 27, 91, 27, 91, 51, 54, 109, 27, 91, 27, 91, 51, 55, 109, 27, 91, 84, 69, 77, 80, 69, 82, 65, 84, 85, 82, 69, 27, 91, 48, 109, 37, 48, 46, 49, 102, 32, 67, 27, 91, 48, 109, 83, 89, 83, 84, 69, 77, 58, 32, 73, 78, 73, 84, 73, 65, 76, 73, 90, 73, 78, 71, 27, 91, 48, 109 };
+static const uint16_t LZ_HEADS[256] PROGMEM = { 65535, 65535, 80, 75, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 8, 65535, 14, 60, 65535, 65535, 65535, 74, 65535, 65535, 1, 65535, 65535, 65535, 54, 65535, 65535, 65535, 82, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 63, 65535, 65535, 65535, 65535, 65535, 55, 65535, 65535, 65535, 65535, 65535, 65535, 13, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 71, 65535, 65535, 57, 65535, 65535, 65535, 65535, 65535, 65535, 20, 65535, 34, 27, 48, 41, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 62, 65535, 84, 65535, 65535, 58, 65535, 65535, 65535, 65535, 65535, 64, 65535, 65535, 65535, 65535, 87, 65535, 86, 65535, 65535, 93, 65535, 65535, 65535, 65535, 68, 65535, 65535, 59, 65535, 65535, 65535, 65535, 65535, 7, 65535, 65535, 65535, 65535, 65535, 65535, 5, 65535, 65535, 65535, 42, 65535, 65535, 52, 35, 65535, 65535, 81, 17, 65535, 65535, 65535, 21, 15, 89, 16, 65535, 65535, 65535, 65535, 65535, 9, 22, 65535, 65535, 65535, 53, 65535, 65535, 65535, 65535, 73, 65535, 65535, 65535, 65535, 65535, 72, 2, 65535, 65535, 65535, 65535, 65535, 65535, 18, 65535, 95, 65535, 65535, 65535, 65535, 94, 65535, 69, 65535, 65535, 65535, 65535, 65535, 65535, 79, 65535, 65535, 4, 65535, 65535, 65535, 65535, 65535, 43, 65535, 65535, 96, 65535, 56, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 65535, 50, 65535, 65535, 65535, 65535, 3, 6, 98, 78, 88, 65535, 65535, 65535, 65535, 65535, 97, 29, 0, 19, 12, 65535, 11, 65535, 65535, 65535, 65535, 65535, 65535, 10, 65535, 65535, 65535, 36, 65535, 65535, 65535 };
+static const UI_LzDict UI_LZ_DICT(LZ_DICT, 104, LZ_HEADS);
+#endif
+
 // USER FUNCTIONS IMPLEMENTATION
 void update_dashboard(SerialUI& ui, float temp, bool ok) {
+    SERIALUI_TRACE_CALL("update_dashboard");
     ui.drawProgressBar(Layout_Dashboard::temp_gauge, temp, temp > 80 ? UI_Color::RED : UI_Color::GREEN);
     ui.printfText(Layout_Dashboard::temp_val, "%0.1f C", temp);
     if (ok) {
@@ -3,6 +3,7 @@
 #include "SerialUI.h"
 
 struct Layout_Dashboard {
+    enum : int16_t { WIDTH = 80, HEIGHT = 24 };
     static const UI_Box bg;
     static const UI_Box temp_gauge;
     static const UI_Text temp_label;